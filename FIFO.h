@@ -42,7 +42,7 @@ int NAME ## Fifo_Put (TYPE data){       \
     return(FAIL);      \
   }                    \
   NAME ## Fifo[ NAME ## PutI &(SIZE-1)] = data; \
-  NAME ## PutI ## ++;  \
+  NAME ## PutI++;      \
   return(SUCCESS);     \
 }                      \
 int NAME ## Fifo_Get (TYPE *datapt){  \
@@ -50,7 +50,7 @@ int NAME ## Fifo_Get (TYPE *datapt){  \
     return(FAIL);      \
   }                    \
   *datapt = NAME ## Fifo[ NAME ## GetI &(SIZE-1)];  \
-  NAME ## GetI ## ++;  \
+  NAME ## GetI++;      \
   return(SUCCESS);     \
 }                      \
 unsigned short NAME ## Fifo_Size (void){  \
@@ -90,7 +90,7 @@ int NAME ## Fifo_Get (TYPE *datapt){    \
   if( NAME ## PutPt == NAME ## GetPt ){ \
     return(FAIL);                       \
   }                                     \
-  *datapt = *( NAME ## GetPt ## ++);    \
+  *datapt = *( NAME ## GetPt++);        \
   if( NAME ## GetPt == &NAME ## Fifo[SIZE]){ \
     NAME ## GetPt = &NAME ## Fifo[0];   \
   }                                     \
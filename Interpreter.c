@@ -22,10 +22,13 @@
 #include "../RTOS_Labs_common/ADC.h"
 #include "../inc/tm4c123gh6pm.h"
 #include "../inc/Launchpad.h"
-#include "../RTOS_Lab5_ProcessLoader/loader.h"
+#include "../RTOS_Labs_common/elfload.h"
 #include "../RTOS_Labs_common/esp8266.h"
 #include "../inc/Timer1A.h"
 #include "../RTOS_Labs_common/heap.h"
+#include "../RTOS_Labs_common/bench.h"
+#include "../RTOS_Labs_common/workload.h"
+#include "../RTOS_Labs_common/heapstress.h"
 
 #define CMD_NEXT_LINE() \
           UART_OutChar('\n'); \
@@ -34,9 +37,11 @@
 uint8_t LCD_screen = 0;
 uint8_t LCD_line[2] = {0, 0};
 
-static const ELFSymbol_t symtab[] = {
+#if CFG_EFILE && CFG_LCD
+static const ELF_Symbol_t symtab[] = {
   {"ST7735_Message", ST7735_Message}
 };
+#endif
 
 // Print jitter histogram
 void Jitter(int32_t MaxJitter, uint32_t const JitterSize, uint32_t JitterHistogram[]){
@@ -96,8 +101,10 @@ void select_screen(char* screen) {
 }
 
 void print_line(char* string, char* value) {
+#if CFG_LCD
   ST7735_Message(LCD_screen, LCD_line[LCD_screen], string, atoi(value));
   next_line();
+#endif
 }
 
 void get_adc_value(void) {
@@ -136,10 +143,12 @@ void led_toggle(void) {
 }
 
 void help(void) {
+#if CFG_LCD
   UART_OutString("lcd [bot/top]");
   CMD_NEXT_LINE();
   UART_OutString("print [string] [int]");
   CMD_NEXT_LINE();
+#endif
   UART_OutString("adc_in");
   CMD_NEXT_LINE();
   UART_OutString("os_time [reset/read]");
@@ -152,6 +161,7 @@ void help(void) {
   CMD_NEXT_LINE();
   UART_OutString("y");
   CMD_NEXT_LINE();
+#if CFG_EFILE
   UART_OutString("format");
   CMD_NEXT_LINE();
   UART_OutString("dprint");
@@ -164,18 +174,136 @@ void help(void) {
   CMD_NEXT_LINE();
   UART_OutString("fdel");
   CMD_NEXT_LINE();
+#endif
+#if SEMA_PROFILE
+  UART_OutString("locks");
+  CMD_NEXT_LINE();
+#endif
+  UART_OutString("heap");
+  CMD_NEXT_LINE();
+#if HEAP_DEBUG
+  UART_OutString("leaks");
+  CMD_NEXT_LINE();
+#endif
+  UART_OutString("bench");
+  CMD_NEXT_LINE();
+  UART_OutString("heapstress [seed]");
+  CMD_NEXT_LINE();
+  UART_OutString("workload [0-");
+  UART_OutUDec(Workload_Count() - 1);
+  UART_OutChar(']');
+  CMD_NEXT_LINE();
+}
+
+#if SEMA_PROFILE
+// print the most contended semaphores, times in us
+void print_locks(void) {
+  Sema4Type* list[SEMA_REGISTRYSIZE];
+  uint32_t count = OS_HottestSemaphores(list, SEMA_REGISTRYSIZE);
+  UART_OutString("name acq cont total_us max_us waiters");
+  CMD_NEXT_LINE();
+  for(int i = 0; i < count; i++) {
+    if(list[i]->name != NULL) {
+      UART_OutString((char*) list[i]->name);
+    }
+    else {
+      UART_OutString("?");
+    }
+    UART_OutChar(' ');
+    UART_OutUDec(list[i]->acquisitions);
+    UART_OutChar(' ');
+    UART_OutUDec(list[i]->contended);
+    UART_OutChar(' ');
+    UART_OutUDec((uint32_t) (list[i]->blockedTime/80));
+    UART_OutChar(' ');
+    UART_OutUDec(list[i]->maxBlockedTime/80);
+    for(int j = 0; j < SEMA_TOPWAITERS; j++) {
+      if(list[i]->waiters[j].blockedTime != 0) {
+        UART_OutChar(' ');
+        UART_OutUDec(list[i]->waiters[j].id);
+        UART_OutChar(':');
+        UART_OutUDec(list[i]->waiters[j].blockedTime/80);
+      }
+    }
+    CMD_NEXT_LINE();
+  }
+}
+#endif
+
+#define MAXPOOLS 8    // pools listed by the heap command
+#define MAPCOLUMNS 64 // width of the heap map
+
+// print heap usage, fragmentation, a map of the kernel heap
+// and the statistics of every pool
+void print_heap(void) {
+  heap_stats_ex_t stats;
+  char map[MAPCOLUMNS + 1];
+  Heap_StatsEx(NULL, &stats);
+  UART_OutString("heap size used free peak ");
+  UART_OutUDec(stats.size);
+  UART_OutChar(' ');
+  UART_OutUDec(stats.used);
+  UART_OutChar(' ');
+  UART_OutUDec(stats.free);
+  UART_OutChar(' ');
+  UART_OutUDec(stats.peakUsed);
+  CMD_NEXT_LINE();
+  UART_OutString("largest blocks frag ");
+  UART_OutUDec(stats.largestFree);
+  UART_OutChar(' ');
+  UART_OutUDec(stats.freeBlocks);
+  UART_OutChar(' ');
+  UART_OutUDec(stats.fragmentation);
+  UART_OutString(" hist");
+  for(int i = 0; i < HEAP_BUCKETS; i++) {
+    UART_OutChar(' ');
+    UART_OutUDec(stats.histogram[i]);
+  }
+  CMD_NEXT_LINE();
+  UART_OutString("malloc free realloc fail ");
+  UART_OutUDec(stats.mallocs);
+  UART_OutChar(' ');
+  UART_OutUDec(stats.frees);
+  UART_OutChar(' ');
+  UART_OutUDec(stats.reallocs);
+  UART_OutChar(' ');
+  UART_OutUDec(stats.failures);
+  CMD_NEXT_LINE();
+  Heap_Map(map, MAPCOLUMNS);
+  UART_OutString(map);
+  CMD_NEXT_LINE();
+  
+  PoolType* list[MAXPOOLS];
+  uint32_t count = OS_Pools(list, MAXPOOLS);
+  UART_OutString("pool size count used high fail");
+  CMD_NEXT_LINE();
+  for(int i = 0; i < count; i++) {
+    UART_OutString(list[i]->name != NULL ? (char*) list[i]->name : "?");
+    UART_OutChar(' ');
+    UART_OutUDec(list[i]->blockSize);
+    UART_OutChar(' ');
+    UART_OutUDec(list[i]->count);
+    UART_OutChar(' ');
+    UART_OutUDec(list[i]->used);
+    UART_OutChar(' ');
+    UART_OutUDec(list[i]->highWater);
+    UART_OutChar(' ');
+    UART_OutUDec(list[i]->failures);
+    CMD_NEXT_LINE();
+  }
 }
 
+#if CFG_EFILE
 void format(void) {
   eFile_Format();
 };
 
 void print_directory(void) {
   eFile_DOpen("");
-  for(int i = 0; i < 10; i++) {
-    char* name;
+  for(int i = 0; i < MAXFILES; i++) {
+    char name[8];
     unsigned long size;
-    if(eFile_DirNext(&name, &size) == 0){
+    if(eFile_DirNext(name, &size) == 0){
       UART_OutString(name);
       UART_OutChar(' ');
       UART_OutUDec(size);
@@ -202,9 +330,12 @@ void write_file(char* name, char* data) {
 
 void print_file(char* name) {
   eFile_ROpen(name);
-  char buf;
-  while(!eFile_ReadNext(&buf)) {
-    UART_OutChar(buf);
+  char buf[64];
+  uint32_t count;
+  while(!eFile_Read(buf, sizeof(buf), &count) && count != 0) {
+    for(uint32_t i = 0; i < count; i++) {
+      UART_OutChar(buf[i]);
+    }
   }
   CMD_NEXT_LINE();
   eFile_RClose();
@@ -213,6 +344,7 @@ void print_file(char* name) {
 void delete_file(char* name) {
   eFile_Delete(name);
 };
+#endif
 
 // returns 0 if token exists, 1 if no more tokens
 int Grab_Token(char* buf) {
@@ -250,7 +382,11 @@ void Interpreter(void){
     strcpy(next_command, token);
         
     // Go to next function
-    if(!strcmp(next_command, "lcd")) {
+    if(!strcmp(next_command, "help")) {
+      help();
+    }
+#if CFG_LCD
+    else if(!strcmp(next_command, "lcd")) {
       char next_parameter[16];
       if(Grab_Token(next_parameter)) {
         // missing parameter
@@ -273,6 +409,7 @@ void Interpreter(void){
       
       print_line(next_parameter_1, next_parameter_2);
     }
+#endif
     else if(!strcmp(next_command, "adc_in")) {
       // Don't care about anything extra
       get_adc_value();
@@ -293,9 +430,7 @@ void Interpreter(void){
       
       led_toggle();
     }
-    else if(!strcmp(next_command, "help")) {
-      help();
-    }
+#if CFG_EFILE
     else if(!strcmp(next_command, "format")) {
       format();
     }
@@ -341,14 +476,55 @@ void Interpreter(void){
     else if(!strcmp(next_command, "unmount")) {
       eFile_Unmount();
     }
+#endif
+#if CFG_EFILE && CFG_LCD
     else if(!strcmp(next_command, "loadp")) {
-      ELFEnv_t env = {symtab, 1};
-      // call elf loader
-      if(!exec_elf("User.axf", &env)){ //success
+      // call elf loader, optional arena size in bytes
+      char next_parameter[16];
+      uint32_t arenaSize = ARENASIZE;
+      if(!Grab_Token(next_parameter)) {
+        arenaSize = atoi(next_parameter);
+      }
+      if(ELF_Exec("User.axf", symtab, 1, 128, 1, arenaSize) == ELF_OK){ //success
         UART_OutString("loaded user program");
         CMD_NEXT_LINE();
       }
     }
+#endif
+#if SEMA_PROFILE
+    else if(!strcmp(next_command, "locks")) {
+      print_locks();
+    }
+#endif
+    else if(!strcmp(next_command, "heap")) {
+      print_heap();
+    }
+#if HEAP_DEBUG
+    else if(!strcmp(next_command, "leaks")) {
+      Heap_DebugReport();
+    }
+#endif
+    else if(!strcmp(next_command, "bench")) {
+      Bench_Run();
+    }
+    else if(!strcmp(next_command, "heapstress")) {
+      char next_parameter[16];
+      if(Grab_Token(next_parameter)) {
+        HeapStress_Run(1);
+      }
+      else {
+        HeapStress_Run(atoi(next_parameter));
+      }
+    }
+    else if(!strcmp(next_command, "workload")) {
+      char next_parameter[16];
+      if(Grab_Token(next_parameter)) {
+        Workload_Run(0);
+      }
+      else {
+        Workload_Run(atoi(next_parameter));
+      }
+    }
     else if(!strcmp(next_command, "wifi")) {
       //OS_AddThread(&WebServer, 128, 0);
     }
@@ -359,6 +535,7 @@ void Interpreter(void){
   }
 }
 
+#if CFG_ESP8266 && CFG_EFILE && CFG_LCD
 char cr[2] = {CR, '\0'};
 char newline[2] = {'\n', '\0'};
 int test = 0;
@@ -516,10 +693,10 @@ void InterpreterWeb(void){
     }
     else if(!strcmp(next_command, "8")) {
       eFile_DOpen("");
-      for(int i = 0; i < 10; i++) {
-        char* name;
+      for(int i = 0; i < MAXFILES; i++) {
+        char name[8];
         unsigned long size;
-        if(eFile_DirNext(&name, &size) == 0){
+        if(eFile_DirNext(name, &size) == 0){
           ESP8266_Send(name);
           char buffer[2] = {' ', '\0'};
           ESP8266_Send(buffer);
@@ -590,9 +767,8 @@ void InterpreterWeb(void){
       eFile_Unmount();
     }
     else if(!strcmp(next_command, "15")) {
-      ELFEnv_t env = {symtab, 1};
       // call elf loader
-      if(!exec_elf("User.axf", &env)){ //success
+      if(ELF_Exec("User.axf", symtab, 1, 128, 1, ARENASIZE) == ELF_OK){ //success
         //ESP8266_Send("loaded");
         //ESP8266_Send(cr);
         //ESP8266_Send(newline);
@@ -731,3 +907,4 @@ void TypingTest(void) {
   test = 0;
   OS_Kill();
 }
+#endif
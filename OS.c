@@ -40,18 +40,15 @@ uint32_t const JitterSize2=JITTERSIZE;
 uint32_t JitterHistogram1[JITTERSIZE]={0,};
 uint32_t JitterHistogram2[JITTERSIZE]={0,};
 
-#define NUMTHREADS 10
-#define NUMPROCESSES 10
-#define STACKSIZE 128
-#define OSFIFOSIZE 64
+// NUMTHREADS, NUMPROCESSES, STACKSIZE, OSFIFOSIZE and PRI are in OSConfig.h
 #define FIFOSUCCESS 1         // return on FIFO success
 #define FIFOFAIL 0            // return on FIFO fail
 
-#define PRI 1
-
 // OS System Time only shared between TimerInit.c and OS.c
 uint32_t msSystemTime;
 uint32_t tensecSystemTime;
+// Timer5A timeouts since OS_Init, upper part of OS_Time64, never cleared
+volatile uint64_t TimerTicks;
 
 //THREADS
 // Active thread linked list
@@ -62,19 +59,34 @@ TCB_t* NextRunPt = NULL;
 // Linked list of sleeping threads
 TCB_t* SleepPt = NULL;
 
+// Threads blocked in OS_WaitTimeout, linked through nextTimed
+static TCB_t* TimedPt = NULL;
+
 // Allocate TCBs
 static TCB_t TCBStack[NUMTHREADS];
-static uint32_t ThreadCount;
 static uint32_t ActiveThreads = 0;
-// Allocate stacks
-static uint32_t stack[NUMTHREADS][STACKSIZE];
+// Unused TCBs, handed out in the order they were freed
+static TCB_t* FreeTCBHead;
+static TCB_t* FreeTCBTail;
+// A thread that called OS_Kill stays RunPt and keeps using its stack until
+// PendSV has saved its context, so its TCB is only freed after the switch
+static TCB_t* Zombie;
+// Allocate stacks, each top is 8-byte aligned (AAPCS) because the array
+// is and STACKSIZE is an even number of words
+static uint32_t stack[NUMTHREADS][STACKSIZE] __attribute__((aligned(8)));
+STATIC_ASSERT(__alignof__(stack) >= 8, stack_align8);
 // Currently allocated threads
 static uint8_t CurrentThreads[NUMTHREADS];
 
+// Join support, indexed by thread ID
+static Sema4Type JoinSema[NUMTHREADS];        // threads waiting in OS_Join
+static int32_t ExitCode[NUMTHREADS];          // exit code of the last thread with this ID
+static uint32_t ThreadGeneration[NUMTHREADS]; // counts exits, names one run of an ID in a handle
+static uint32_t LastAddedId;                  // ID given out by the last OS_AddThread_Process
+
 //PROCESSES
 static PCB_t PCBStack[NUMPROCESSES];
-static uint8_t CurrentProcesses[NUMPROCESSES];
-static uint32_t ProcessCount;
+static PCB_t* FreePCB; // unused PCBs
 
 // Mailbox semaphores
 Sema4Type DataValid;
@@ -90,9 +102,70 @@ Sema4Type OSFIFODataLeft;
 // Indicates whether OS has started
 static uint8_t OS_Active = 0;
 
+#if SEMA_PROFILE
+// Semaphores seen by OS_InitSemaphore, for the contention profiler
+static Sema4Type* SemaRegistry[SEMA_REGISTRYSIZE];
+static uint32_t SemaRegistryCount = 0;
+#endif
+
 // User defined time slice
 uint32_t TimeSlice;
 
+static void TCBFree(TCB_t* tcb);
+
+// free the TCB of a killed thread once PendSV has switched away from it
+// called with interrupts disabled
+static void ZombieFree(void) {
+  if(Zombie != NULL && Zombie != RunPt) {
+    TCBFree(Zombie);
+    Zombie = NULL;
+  }
+}
+
+// take a TCB from the free list, NULL if all are in use
+// called with interrupts disabled
+static TCB_t* TCBAlloc(void) {
+  ZombieFree();
+  TCB_t* tcb = FreeTCBHead;
+  if(tcb != NULL) {
+    FreeTCBHead = tcb->nextFree;
+    if(FreeTCBHead == NULL) {
+      FreeTCBTail = NULL;
+    }
+  }
+  return tcb;
+}
+
+// put a TCB at the end of the free list
+// called with interrupts disabled
+static void TCBFree(TCB_t* tcb) {
+  tcb->nextFree = NULL;
+  if(FreeTCBTail == NULL) {
+    FreeTCBHead = tcb;
+  }
+  else {
+    FreeTCBTail->nextFree = tcb;
+  }
+  FreeTCBTail = tcb;
+}
+
+// take a PCB from the free list, NULL if all are in use
+// called with interrupts disabled
+static PCB_t* PCBAlloc(void) {
+  PCB_t* pcb = FreePCB;
+  if(pcb != NULL) {
+    FreePCB = pcb->nextFree;
+  }
+  return pcb;
+}
+
+// give a PCB back to the free list
+// called with interrupts disabled
+static void PCBFree(PCB_t* pcb) {
+  pcb->nextFree = FreePCB;
+  FreePCB = pcb;
+}
+
 // will switch with equal priority
 static TCB_t* FindNextRunLax(void) {
   TCB_t* next = RunPt->next;
@@ -126,6 +199,72 @@ static TCB_t* GetPrevious(TCB_t* tcb) {
   return temp;
 }
 
+// find the first thread of the highest priority group in the active list
+// the list is kept circularly sorted, so that is the one place where
+// priority improves going forward
+static TCB_t* FindRingHead(TCB_t* start) {
+  TCB_t* previous = start;
+  TCB_t* thread = start->next;
+  do {
+    if(thread->priority < previous->priority) {
+      return thread;
+    }
+    previous = thread;
+    thread = thread->next;
+  } while(previous != start);
+  
+  return start; // all the same priority
+}
+
+// insert thread into a NULL terminated wait list
+// by priority, after threads of equal priority
+static void InsertIntoWaitList(TCB_t** head, TCB_t* tcb) {
+  TCB_t** link = head;
+#if PRI
+  while(*link != NULL && (*link)->priority <= tcb->priority) {
+    link = &((*link)->next);
+  }
+#else
+  while(*link != NULL) {
+    link = &((*link)->next);
+  }
+#endif
+  tcb->next = *link;
+  *link = tcb;
+}
+
+// move a thread of the active list to its place for a new priority
+// returns the first thread of the highest priority group
+static TCB_t* MoveInActive(TCB_t* tcb, uint32_t priority) {
+  tcb->priority = priority;
+  if(tcb->next == tcb) {
+    return tcb;
+  }
+  GetPrevious(tcb)->next = tcb->next;
+  TCB_t* head = FindRingHead(tcb->next);
+  TCB_t* thread = head;
+  while(thread->priority <= priority) {
+    thread = thread->next;
+    if(thread == head) {
+      break;
+    }
+  }
+  GetPrevious(thread)->next = tcb;
+  tcb->next = thread;
+  return FindRingHead(tcb);
+}
+
+static void RemoveFromWaitList(TCB_t** head, TCB_t* tcb) {
+  TCB_t** link = head;
+  while(*link != NULL) {
+    if(*link == tcb) {
+      *link = tcb->next;
+      return;
+    }
+    link = &((*link)->next);
+  }
+}
+
 // will switch to thread with highest priority
 static TCB_t* FindNextRunReq(void) {
   TCB_t* next = RunPt->next;
@@ -229,6 +368,23 @@ static uint8_t InsertIntoActive(TCB_t* tcb) {
   }
 }
 
+// adaptive slices: a thread preempted at the end of its slice gets
+// twice as long, one that blocks in the first half gets half as long
+static void SliceUsedUp(TCB_t* tcb) {
+  if(tcb->adaptive) {
+    tcb->timeSlice = (tcb->timeSlice >= SLICE_MAX/2) ? SLICE_MAX : tcb->timeSlice*2;
+  }
+}
+
+static void SliceBlocked(TCB_t* tcb) {
+  if(tcb->adaptive && tcb->elapsedTime < tcb->timeSlice/2) {
+    tcb->timeSlice = (tcb->timeSlice <= SLICE_MIN*2) ? SLICE_MIN : tcb->timeSlice/2;
+    if(tcb->elapsedTime >= tcb->timeSlice) {
+      tcb->elapsedTime = 0; // carry-over would not fit, start a fresh slice
+    }
+  }
+}
+
 static void ContextSwitchHelper(void) {
   // make sure next thread is valid
   if(ActiveThreads == 0) {
@@ -241,7 +397,10 @@ static void ContextSwitchHelper(void) {
     return;
   }
   else{
-    RunPt->elapsedTime = TimeSlice - NVIC_ST_CURRENT_R; // save elapsed time so far
+    RunPt->elapsedTime = RunPt->timeSlice - NVIC_ST_CURRENT_R; // save elapsed time so far
+    if(RunPt->status == 1 || RunPt->sleep_state != 0) {
+      SliceBlocked(RunPt);
+    }
     ContextSwitch();
   }
   return; // no available thread to switch to, do nothing
@@ -270,6 +429,7 @@ void SysTick_Handler(void) {
     }
     else{
       ContextSwitchHelper();
+      SliceUsedUp(RunPt); // after the helper saved elapsedTime against the old slice
     }
   }
   
@@ -320,7 +480,9 @@ void OS_Init(void){
   // put Lab 2 (and beyond) solution here
   DisableInterrupts();
   PLL_Init(Bus80MHz);
+#if CFG_LCD
   ST7735_InitR(INITR_REDTAB); // LCD initialization
+#endif
   LaunchPad_Init();  // debugging profile on PF1
   //ADC_Init(3);
   UART_Init();
@@ -328,6 +490,19 @@ void OS_Init(void){
   OS_ClearMsTime();
   // eFile_Init();
   Heap_Init();
+  // every TCB and PCB starts on its free list
+  FreeTCBHead = FreeTCBTail = NULL;
+  Zombie = NULL;
+  for(int i = 0; i < NUMTHREADS; i++) {
+    TCBFree(&TCBStack[i]);
+  }
+  FreePCB = NULL;
+  for(int i = NUMPROCESSES - 1; i >= 0; i--) {
+    PCBFree(&PCBStack[i]);
+  }
+#if HEAP_DEBUG && HEAP_SWEEP_MS
+  OS_AddThread(Heap_DebugSweeper, 128, HEAP_SWEEP_PRIORITY);
+#endif
 }; 
 
 // ******** OS_InitSemaphore ************
@@ -338,8 +513,117 @@ void OS_InitSemaphore(Sema4Type *semaPt, int32_t value){
   // put Lab 2 (and beyond) solution here
   semaPt->Value = value;
   semaPt->head = NULL;
+#if SEMA_PROFILE
+  long sr = StartCritical();
+  semaPt->name = NULL;
+  semaPt->acquisitions = 0;
+  semaPt->contended = 0;
+  semaPt->blockedTime = 0;
+  semaPt->maxBlockedTime = 0;
+  for(int i = 0; i < SEMA_TOPWAITERS; i++) {
+    semaPt->waiters[i].id = 0;
+    semaPt->waiters[i].blockedTime = 0;
+  }
+  // register once, semaphores like LCDFree get initialized more than once
+  uint32_t i;
+  for(i = 0; i < SemaRegistryCount; i++) {
+    if(SemaRegistry[i] == semaPt) {
+      break;
+    }
+  }
+  if(i == SemaRegistryCount && SemaRegistryCount < SEMA_REGISTRYSIZE) {
+    SemaRegistry[SemaRegistryCount] = semaPt;
+    SemaRegistryCount++;
+  }
+  EndCritical(sr);
+#endif
 }; 
 
+#if SEMA_PROFILE
+// ******** OS_NameSemaphore ************
+// attach a label to a semaphore for the contention profiler
+// call after OS_InitSemaphore
+// input:  pointer to a semaphore, constant string
+// output: none
+void OS_NameSemaphore(Sema4Type *semaPt, const char *name){
+  semaPt->name = name;
+}
+
+// record the blocked time of a thread leaving the semaphore wait list
+// called with interrupts disabled
+static void SemaProfileWake(Sema4Type *semaPt, TCB_t* thread) {
+  uint64_t span = OS_Time64() - thread->blockStart;
+  uint32_t blocked = (span > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)span;
+  semaPt->blockedTime += blocked;
+  if(blocked > semaPt->maxBlockedTime) {
+    semaPt->maxBlockedTime = blocked;
+  }
+  
+  // update this thread's entry, or replace the lightest waiter
+  SemaWaiter_t* waiters = semaPt->waiters;
+  int i;
+  for(i = 0; i < SEMA_TOPWAITERS - 1; i++) {
+    if(waiters[i].id == thread->id && waiters[i].blockedTime != 0) {
+      break;
+    }
+  }
+  if(waiters[i].id == thread->id && waiters[i].blockedTime != 0) {
+    waiters[i].blockedTime += blocked;
+  }
+  else if(blocked > waiters[i].blockedTime) {
+    waiters[i].id = thread->id;
+    waiters[i].blockedTime = blocked;
+  }
+  else {
+    return;
+  }
+  
+  // bubble the updated entry up to keep the list sorted
+  while(i > 0 && waiters[i].blockedTime > waiters[i-1].blockedTime) {
+    SemaWaiter_t temp = waiters[i];
+    waiters[i] = waiters[i-1];
+    waiters[i-1] = temp;
+    i--;
+  }
+}
+
+// ******** OS_HottestSemaphores ************
+// list the profiled semaphores, most blocked time first
+// input:  array to fill, size of the array
+// output: number of entries filled in
+uint32_t OS_HottestSemaphores(Sema4Type *list[], uint32_t max){
+  long sr = StartCritical();
+  uint32_t count = 0;
+  if(max == 0) {
+    EndCritical(sr);
+    return 0;
+  }
+  for(uint32_t i = 0; i < SemaRegistryCount; i++) {
+    // insertion sort over the whole registry, keeping the top max
+    Sema4Type* sema = SemaRegistry[i];
+    uint32_t j = count;
+    if(count == max) {
+      j = max - 1; // full, sema replaces the coldest entry if it beats it
+      if(list[j]->blockedTime > sema->blockedTime ||
+         (list[j]->blockedTime == sema->blockedTime && list[j]->contended >= sema->contended)) {
+        continue;
+      }
+    }
+    else {
+      count++;
+    }
+    while(j > 0 && (list[j-1]->blockedTime < sema->blockedTime ||
+         (list[j-1]->blockedTime == sema->blockedTime && list[j-1]->contended < sema->contended))) {
+      list[j] = list[j-1];
+      j--;
+    }
+    list[j] = sema;
+  }
+  EndCritical(sr);
+  return count;
+}
+#endif
+
 /*
  * @brief Insert thread into blocked linked list
  */
@@ -386,6 +670,70 @@ void OS_InsertIntoBlocked(Sema4Type *semaPt) {
 #endif
 }
 
+// take a thread out of the timed wait list
+// called with interrupts disabled
+static void CancelTimeout(TCB_t* tcb) {
+  TCB_t** link = &TimedPt;
+  while(*link != NULL) {
+    if(*link == tcb) {
+      *link = tcb->nextTimed;
+      break;
+    }
+    link = &((*link)->nextTimed);
+  }
+  tcb->timedSema = NULL;
+}
+
+// count down the timed waits, put the expired ones back in the active list
+// called from Timer5A_Handler with interrupts disabled
+// returns 1 if one of them should preempt RunPt
+static int ExpireTimeouts(void) {
+  int result = 0;
+  TCB_t** link = &TimedPt;
+  while(*link != NULL) {
+    TCB_t* thread = *link;
+    thread->timeout--;
+    if(thread->timeout == 0) {
+      *link = thread->nextTimed;
+      RemoveFromWaitList(&thread->timedSema->head, thread);
+      thread->timedSema->Value++; // undo the decrement of OS_Wait
+      thread->timedSema = NULL;
+      thread->timedOut = 1;
+      thread->status = 0;
+      if(InsertIntoActive(thread)) {
+        result = 1;
+      }
+      ActiveThreads++;
+    }
+    else {
+      link = &thread->nextTimed;
+    }
+  }
+  return result;
+}
+
+// ******** OS_WaitTimeout ************
+// decrement semaphore, block for at most timeout ms if less than zero
+// input:  pointer to a counting semaphore, timeout in ms, 0 waits forever
+// output: 1 if decremented, 0 on timeout
+int OS_WaitTimeout(Sema4Type *semaPt, uint32_t timeout){
+  if(timeout == 0) {
+    OS_Wait(semaPt);
+    return 1;
+  }
+  DisableInterrupts();
+  RunPt->timedOut = 0;
+  if(semaPt->Value <= 0) {
+    // going to block, Timer5A_Handler wakes it if OS_Signal does not
+    RunPt->timedSema = semaPt;
+    RunPt->timeout = timeout;
+    RunPt->nextTimed = TimedPt;
+    TimedPt = RunPt;
+  }
+  OS_Wait(semaPt); // enables interrupts, the switch happens here
+  return !RunPt->timedOut;
+};
+
 // ******** OS_Wait ************
 // decrement semaphore 
 // Lab2 spinlock
@@ -396,9 +744,17 @@ void OS_Wait(Sema4Type *semaPt){
   // put Lab 2 (and beyond) solution here
   DisableInterrupts();
   semaPt->Value--;
+#if SEMA_PROFILE
+  semaPt->acquisitions++;
+#endif
   
   if(semaPt->Value < 0) {
+#if SEMA_PROFILE
+    semaPt->contended++;
+    RunPt->blockStart = OS_Time64();
+#endif
     RunPt->status = 1;
+    RunPt->waitList = &semaPt->head;
     NextRunPt = FindNextRunReq(); // need to find next AVAILABLE highest priority thread
     
     // insert into blocked linked list
@@ -432,6 +788,12 @@ void OS_Signal(Sema4Type *semaPt){
   if(semaPt->Value <= 0) {
     TCB_t* nextHead = semaPt->head->next;
     semaPt->head->status = 0;
+    if(semaPt->head->timedSema != NULL) {
+      CancelTimeout(semaPt->head);
+    }
+#if SEMA_PROFILE
+    SemaProfileWake(semaPt, semaPt->head);
+#endif
     
     // insert semaPt->head to linked list (by priority)
     if(InsertIntoActive(semaPt->head)) {
@@ -443,6 +805,42 @@ void OS_Signal(Sema4Type *semaPt){
   EndCritical(sr);
 }; 
 
+// ******** OS_TryWait ************
+// decrement semaphore only if that does not block
+// input:  pointer to a counting semaphore
+// output: 1 if decremented, 0 if the semaphore was not available
+int OS_TryWait(Sema4Type *semaPt){
+  long sr = StartCritical();
+  if(semaPt->Value > 0) {
+    semaPt->Value--;
+#if SEMA_PROFILE
+    semaPt->acquisitions++;
+#endif
+    EndCritical(sr);
+    return 1;
+  }
+  EndCritical(sr);
+  return 0;
+};
+
+// ******** OS_bTryWait ************
+// take binary semaphore only if it is free
+// input:  pointer to a binary semaphore
+// output: 1 if taken, 0 if the semaphore was busy
+int OS_bTryWait(Sema4Type *semaPt){
+  long sr = StartCritical();
+  if(semaPt->Value != 0) {
+    semaPt->Value = 0;
+#if SEMA_PROFILE
+    semaPt->acquisitions++;
+#endif
+    EndCritical(sr);
+    return 1;
+  }
+  EndCritical(sr);
+  return 0;
+};
+
 // ******** OS_bWait ************
 // Lab2 spinlock, set to 0
 // Lab3 block if less than zero
@@ -451,9 +849,17 @@ void OS_Signal(Sema4Type *semaPt){
 void OS_bWait(Sema4Type *semaPt){
   // put Lab 2 (and beyond) solution here
   DisableInterrupts();
+#if SEMA_PROFILE
+  semaPt->acquisitions++;
+#endif
   
   if(semaPt->Value == 0) {
+#if SEMA_PROFILE
+    semaPt->contended++;
+    RunPt->blockStart = OS_Time64();
+#endif
     RunPt->status = 1;
+    RunPt->waitList = &semaPt->head;
     NextRunPt = FindNextRunReq();
     
     // insert into blocked linked list
@@ -487,6 +893,9 @@ void OS_bSignal(Sema4Type *semaPt){
   if(semaPt->head != NULL) {
     TCB_t* nextHead = semaPt->head->next;
     semaPt->head->status = 0;
+#if SEMA_PROFILE
+    SemaProfileWake(semaPt, semaPt->head);
+#endif
     
     // insert semaPt->head to linked list (by priority)
     if(InsertIntoActive(semaPt->head)) {
@@ -502,28 +911,436 @@ void OS_bSignal(Sema4Type *semaPt){
   EndCritical(sr);
 }; 
 
+// ******** OS_InitRWLock ************
+// initialize reader-writer lock, free
+// input:  pointer to a lock, RWLOCK_WRITERPREF or RWLOCK_FAIR
+// output: none
+void OS_InitRWLock(RWLockType *lockPt, uint8_t policy){
+  lockPt->readers = 0;
+  lockPt->writer = 0;
+  lockPt->policy = policy;
+  lockPt->waitingReaders = 0;
+  lockPt->waitingWriters = 0;
+  OS_InitSemaphore(&lockPt->readQueue, 0);
+  OS_InitSemaphore(&lockPt->writeQueue, 0);
+};
+
+// ******** OS_ReadLock ************
+// take the lock shared, blocks while a writer holds it or waits for it
+// input:  pointer to a lock
+// output: none
+void OS_ReadLock(RWLockType *lockPt){
+  long sr = StartCritical();
+  if(lockPt->writer == 0 && lockPt->waitingWriters == 0) {
+    lockPt->readers++;
+    EndCritical(sr);
+    return;
+  }
+  // block, the releasing writer counts us in readers before waking us
+  lockPt->waitingReaders++;
+  OS_Wait(&lockPt->readQueue);
+  EndCritical(sr);
+};
+
+// ******** OS_ReadUnlock ************
+// release a shared hold, the last reader hands over to a waiting writer
+// input:  pointer to a lock
+// output: none
+void OS_ReadUnlock(RWLockType *lockPt){
+  long sr = StartCritical();
+  lockPt->readers--;
+  if(lockPt->readers == 0 && lockPt->waitingWriters > 0) {
+    lockPt->waitingWriters--;
+    lockPt->writer = 1;
+    OS_Signal(&lockPt->writeQueue);
+  }
+  EndCritical(sr);
+};
+
+// ******** OS_WriteLock ************
+// take the lock exclusive, blocks while readers or a writer hold it
+// input:  pointer to a lock
+// output: none
+void OS_WriteLock(RWLockType *lockPt){
+  long sr = StartCritical();
+  if(lockPt->writer == 0 && lockPt->readers == 0) {
+    lockPt->writer = 1;
+    EndCritical(sr);
+    return;
+  }
+  // block, the releasing thread sets writer before waking us
+  lockPt->waitingWriters++;
+  OS_Wait(&lockPt->writeQueue);
+  EndCritical(sr);
+};
+
+// ******** OS_WriteUnlock ************
+// release an exclusive hold, wakes the next writer or all waiting
+// readers depending on the policy
+// input:  pointer to a lock
+// output: none
+void OS_WriteUnlock(RWLockType *lockPt){
+  long sr = StartCritical();
+  lockPt->writer = 0;
+  if(lockPt->waitingReaders > 0 &&
+     (lockPt->policy == RWLOCK_FAIR || lockPt->waitingWriters == 0)) {
+    // let the whole batch of waiting readers in
+    lockPt->readers += lockPt->waitingReaders;
+    while(lockPt->waitingReaders > 0) {
+      lockPt->waitingReaders--;
+      OS_Signal(&lockPt->readQueue);
+    }
+  }
+  else if(lockPt->waitingWriters > 0) {
+    lockPt->waitingWriters--;
+    lockPt->writer = 1;
+    OS_Signal(&lockPt->writeQueue);
+  }
+  EndCritical(sr);
+};
+
+// move RunPt from the active list onto a wait list
+// caller has interrupts disabled and calls ContextSwitchHelper after
+static void BlockOnList(TCB_t** head) {
+  RunPt->status = 1;
+  RunPt->waitList = head;
+  NextRunPt = FindNextRunReq();
+  GetPrevious(RunPt)->next = RunPt->next;
+  InsertIntoWaitList(head, RunPt);
+  ActiveThreads--;
+}
+
+// wake up to count threads from a wait list, highest priority first
+// the wait list is sorted like the active list, so the woken threads are
+// merged into it in one walk, with one context switch at most
+// called with interrupts disabled
+// returns number of threads woken
+static uint32_t WakeList(TCB_t** head, uint32_t count) {
+  if(*head == NULL || count == 0) {
+    return 0;
+  }
+  // the list is ordered around RunPt, or around NextRunPt while RunPt
+  // is being blocked, put to sleep or killed (see InsertIntoActive)
+  uint8_t running = !(RunPt->next == NULL || RunPt->status == 1 ||
+                      RunPt->sleep_state != 0 || RunPt != NextRunPt);
+  TCB_t* reference = running ? RunPt : NextRunPt;
+  uint8_t preempt = 0;
+#if PRI
+  if((*head)->priority < reference->priority) {
+    NextRunPt = *head;
+    preempt = running;
+  }
+  // walk the sorted ring once from its highest priority thread, each
+  // woken thread goes after the threads of its own priority
+  TCB_t* ringHead = FindRingHead(reference);
+  TCB_t* previous = GetPrevious(ringHead);
+  TCB_t* thread = ringHead;
+  uint8_t wrapped = 0;
+#else
+  // round robin, the woken threads queue up behind everyone else
+  TCB_t* previous = GetPrevious(reference);
+  TCB_t* thread = reference;
+#endif
+  uint32_t woken = 0;
+  while(*head != NULL && woken < count) {
+    TCB_t* tcb = *head;
+    *head = tcb->next;
+    tcb->status = 0;
+#if PRI
+    while(!wrapped && thread->priority <= tcb->priority) {
+      previous = thread;
+      thread = thread->next;
+      wrapped = (thread == ringHead);
+    }
+#endif
+    previous->next = tcb;
+    tcb->next = thread;
+    previous = tcb;
+    ActiveThreads++;
+    woken++;
+  }
+  if(preempt) {
+    ContextSwitchHelper();
+  }
+  return woken;
+}
+
+// ******** OS_InitCond ************
+// initialize condition variable, no waiters
+// input:  pointer to a condition variable
+// output: none
+void OS_InitCond(CondType *condPt){
+  condPt->head = NULL;
+};
+
+// ******** OS_CondWait ************
+// release the mutex and block on the condition in one atomic step,
+// the mutex is taken again before returning
+// input:  pointer to a condition variable, binary semaphore held by caller
+// output: none
+void OS_CondWait(CondType *condPt, Sema4Type *lockPt){
+  DisableInterrupts();
+  BlockOnList(&condPt->head);
+  // already on the wait list, so a signal after this cannot be lost
+  OS_bSignal(lockPt);
+  ContextSwitchHelper();
+  EnableInterrupts();
+  
+  OS_bWait(lockPt);
+};
+
+// ******** OS_CondSignal ************
+// wake the highest priority thread waiting on the condition
+// input:  pointer to a condition variable
+// output: none
+void OS_CondSignal(CondType *condPt){
+  long sr = StartCritical();
+  WakeList(&condPt->head, 1);
+  EndCritical(sr);
+};
+
+// ******** OS_CondBroadcast ************
+// wake every thread waiting on the condition, in priority order,
+// with at most one context switch
+// input:  pointer to a condition variable
+// output: none
+void OS_CondBroadcast(CondType *condPt){
+  long sr = StartCritical();
+  WakeList(&condPt->head, NUMTHREADS);
+  EndCritical(sr);
+};
+
+// ******** OS_InitBarrier ************
+// initialize barrier for a number of threads
+// input:  pointer to a barrier, number of parties (at least 1)
+// output: none
+void OS_InitBarrier(BarrierType *barrierPt, uint32_t parties){
+  barrierPt->parties = parties;
+  barrierPt->arrived = 0;
+  barrierPt->head = NULL;
+};
+
+// ******** OS_BarrierWait ************
+// block until all parties have called OS_BarrierWait, the last one
+// to arrive releases the others and resets the barrier for the next phase
+// input:  pointer to a barrier
+// output: 1 for the last thread to arrive, 0 for the others
+int OS_BarrierWait(BarrierType *barrierPt){
+  DisableInterrupts();
+  barrierPt->arrived++;
+  if(barrierPt->arrived >= barrierPt->parties) {
+    // reset first so released threads can already wait on the next phase
+    barrierPt->arrived = 0;
+    WakeList(&barrierPt->head, NUMTHREADS);
+    EnableInterrupts();
+    return 1;
+  }
+  
+  BlockOnList(&barrierPt->head);
+  ContextSwitchHelper();
+  EnableInterrupts();
+  return 0;
+};
+
+// ******** OS_InitLatch ************
+// initialize countdown latch
+// input:  pointer to a latch, number of count downs before release
+// output: none
+void OS_InitLatch(LatchType *latchPt, uint32_t count){
+  latchPt->count = count;
+  latchPt->head = NULL;
+};
+
+// ******** OS_LatchCountDown ************
+// decrement the latch, the count down to zero releases all waiters
+// can be called from an interrupt
+// input:  pointer to a latch
+// output: none
+void OS_LatchCountDown(LatchType *latchPt){
+  long sr = StartCritical();
+  if(latchPt->count > 0) {
+    latchPt->count--;
+    if(latchPt->count == 0) {
+      WakeList(&latchPt->head, NUMTHREADS);
+    }
+  }
+  EndCritical(sr);
+};
+
+// ******** OS_LatchWait ************
+// block until the latch has counted down to zero, returns at once after that
+// input:  pointer to a latch
+// output: none
+void OS_LatchWait(LatchType *latchPt){
+  DisableInterrupts();
+  if(latchPt->count > 0) {
+    BlockOnList(&latchPt->head);
+    ContextSwitchHelper();
+  }
+  EnableInterrupts();
+};
+
+// pools seen by OS_InitPool, newest first
+static PoolType* PoolList = NULL;
+
+// the link in PoolList that points to poolPt, NULL if it is not listed
+// called with interrupts disabled
+static PoolType** PoolLink(PoolType* poolPt) {
+  PoolType** link = &PoolList;
+  while(*link != NULL && *link != poolPt) {
+    link = &(*link)->nextPool;
+  }
+  return (*link != NULL) ? link : NULL;
+}
+
+// ******** OS_InitPool ************
+// initialize a pool of count blocks of blockSize bytes each
+// input:  pointer to a pool, label for the statistics,
+//         storage of count*blockSize bytes (word aligned), NULL to take it from the heap,
+//         block size in bytes (rounded up to a word), number of blocks
+// output: 1 if successful, 0 if the heap has no room for the storage
+int OS_InitPool(PoolType *poolPt, const char *name, void *memory, 
+  uint32_t blockSize, uint32_t count){
+  // every block must hold the free list link
+  blockSize = (blockSize < sizeof(void*)) ? sizeof(void*) : (blockSize + 3) & ~3;
+  // heap storage of an earlier OS_InitPool on this pool
+  long sr = StartCritical();
+  int listed = PoolLink(poolPt) != NULL;
+  void* old = listed ? poolPt->storage : NULL;
+  uint32_t oldBytes = listed ? poolPt->blockSize*poolPt->count : 0;
+  EndCritical(sr);
+  void* storage = NULL;
+  if(memory == NULL) {
+    if(old != NULL && blockSize*count <= oldBytes) {
+      storage = old; // big enough, use it again
+      old = NULL;
+    }
+    else {
+      storage = Heap_Malloc(blockSize*count);
+      if(storage == NULL) {
+        return 0;
+      }
+    }
+    memory = storage;
+  }
+  // link every block, the first one ends up at the head
+  void* head = NULL;
+  for(uint32_t i = count; i > 0; i--) {
+    void** block = (void**)((uint8_t*)memory + (i - 1)*blockSize);
+    *block = head;
+    head = block;
+  }
+  sr = StartCritical();
+  poolPt->free = head;
+  poolPt->blockSize = blockSize;
+  poolPt->count = count;
+  poolPt->used = 0;
+  poolPt->highWater = 0;
+  poolPt->failures = 0;
+  poolPt->name = name;
+  poolPt->storage = storage;
+  // list once, a pool may be initialized again
+  if(!listed) {
+    poolPt->nextPool = PoolList;
+    PoolList = poolPt;
+  }
+  EndCritical(sr);
+  Heap_Free(old);
+  return 1;
+};
+
+// ******** OS_DestroyPool ************
+// take a pool off the list OS_Pools reports and free its heap storage
+// not from an interrupt
+// input:  pointer to a pool
+// output: 1 if successful, 0 if the pool was not initialized
+int OS_DestroyPool(PoolType *poolPt){
+  long sr = StartCritical();
+  PoolType** link = PoolLink(poolPt);
+  if(link == NULL) {
+    EndCritical(sr);
+    return 0;
+  }
+  *link = poolPt->nextPool;
+  void* storage = poolPt->storage;
+  poolPt->storage = NULL;
+  poolPt->free = NULL;
+  poolPt->count = 0;
+  EndCritical(sr);
+  Heap_Free(storage);
+  return 1;
+};
+
+// ******** OS_PoolAlloc ************
+// take a block from the pool, never blocks
+// can be called from an interrupt
+// input:  pointer to a pool
+// output: pointer to the block, NULL if the pool is empty
+void* OS_PoolAlloc(PoolType *poolPt){
+  long sr = StartCritical();
+  void** block = poolPt->free;
+  if(block == NULL) {
+    poolPt->failures++;
+    EndCritical(sr);
+    return NULL;
+  }
+  poolPt->free = *block;
+  poolPt->used++;
+  if(poolPt->used > poolPt->highWater) {
+    poolPt->highWater = poolPt->used;
+  }
+  EndCritical(sr);
+  return block;
+};
+
+// ******** OS_PoolFree ************
+// give a block back to the pool it came from
+// can be called from an interrupt
+// input:  pointer to a pool, block from OS_PoolAlloc on that pool
+// output: none
+void OS_PoolFree(PoolType *poolPt, void *block){
+  if(block == NULL) {
+    return;
+  }
+  long sr = StartCritical();
+  *(void**)block = poolPt->free;
+  poolPt->free = block;
+  poolPt->used--;
+  EndCritical(sr);
+};
+
+// ******** OS_Pools ************
+// list the initialized pools, e.g., to print their statistics next to Heap_Stats
+// input:  array to fill, its size
+// output: number of pools stored in the array
+uint32_t OS_Pools(PoolType *list[], uint32_t max){
+  uint32_t n = 0;
+  long sr = StartCritical();
+  for(PoolType* pool = PoolList; pool != NULL && n < max; pool = pool->nextPool) {
+    list[n] = pool;
+    n++;
+  }
+  EndCritical(sr);
+  return n;
+};
+
 //**********OS_AddThread_Process*********
 int OS_AddThread_Process(void(*task)(void), 
   uint32_t stackSize, uint32_t priority, PCB_t* parent) {
   long sr = StartCritical();
-  TCB_t* TCB;
-	if(ThreadCount > NUMTHREADS-1) {
+  TCB_t* TCB = TCBAlloc();
+	if(TCB == NULL) {
     EndCritical(sr);
 		return 0;
 	}
   else{    
-    int thread_location;
-		// Find empty thread
-    for(thread_location = 0; thread_location < NUMTHREADS; thread_location++) {
-      if(CurrentThreads[thread_location] == 0) {
-        
-        // Claim this location
-        TCB = &TCBStack[thread_location];
-        break;
-      }
-    }
+    int thread_location = TCB - TCBStack;
     
     TCB->id = thread_location;
+#if SCHED_STATS
+    TCB->switchIns = 0;
+    TCB->runTime = 0;
+#endif
     if(parent == NULL) {
       TCB->priority = priority;
     }
@@ -615,6 +1432,13 @@ int OS_AddThread_Process(void(*task)(void),
     TCB->sleep_state = 0;
     TCB->sp = &stack[thread_location][STACKSIZE];
     TCB->elapsedTime = 0;
+    TCB->timeSlice = TimeSlice; // 0 before OS_Launch, filled in there
+    TCB->adaptive = ADAPTIVE_SLICE;
+    TCB->joinCode = NULL;
+    TCB->timedSema = NULL;
+    ExitCode[thread_location] = 0;
+    JoinSema[thread_location].Value = 0;
+    JoinSema[thread_location].head = NULL;
     
     // simulate "pushing" registers onto stack
     *(--(TCB->sp)) = 0x01000000;               // PSR (Thumb bit)
@@ -639,9 +1463,12 @@ int OS_AddThread_Process(void(*task)(void),
     *(--(TCB->sp)) = 0x05050505;               // R5
     *(--(TCB->sp)) = 0x04040404;               // R4
     
-    ThreadCount++;
     ActiveThreads++;
     CurrentThreads[thread_location] = 1;
+    if(parent != NULL) {
+      parent->threads++;
+    }
+    LastAddedId = thread_location;
 	} 
   
   // If running, trigger context switch
@@ -668,6 +1495,22 @@ int OS_AddThread(void(*task)(void),
   }
 };
 
+//******** OS_AddThreadId *************** 
+// add a foregound thread to the scheduler and return its handle,
+// the ID in the low 8 bits and the exits of that ID so far above them
+// Inputs: same as OS_AddThread
+// Outputs: thread handle, -1 if this thread can not be added
+int32_t OS_AddThreadId(void(*task)(void), 
+   uint32_t stackSize, uint32_t priority){
+  long sr = StartCritical();
+  int32_t id = -1;
+  if(OS_AddThread(task, stackSize, priority)) {
+    id = (int32_t)(((ThreadGeneration[LastAddedId] & OS_HANDLE_GENMASK) << 8) | LastAddedId);
+  }
+  EndCritical(sr);
+  return id;
+};
+
 //******** OS_AddProcess *************** 
 // add a process with foregound thread to the scheduler
 // Inputs: pointer to a void/void entry point
@@ -681,28 +1524,62 @@ int OS_AddThread(void(*task)(void),
 int OS_AddProcess(void(*entry)(void), void *text, void *data, 
   unsigned long stackSize, unsigned long priority){
   // put Lab 5 solution here
+  return OS_AddProcessArena(entry, text, data, stackSize, priority, ARENASIZE);
+}
+
+//******** OS_AddProcessArena *************** 
+// same as OS_AddProcess with the arena size chosen at load time
+// Inputs: as OS_AddProcess, plus arena size in bytes (0 for no arena,
+//         the process then allocates from the kernel heap)
+// Outputs: 1 if successful, 0 if this process can not be added
+int OS_AddProcessArena(void(*entry)(void), void *text, void *data, 
+  unsigned long stackSize, unsigned long priority, unsigned long arenaSize){
+  // arena comes from the kernel heap, which may block, so get it first
+  heap_t* arena = NULL;
+  if(arenaSize != 0) {
+    arena = Heap_CreateArena(arenaSize);
+    if(arena == NULL) {
+      return 0;
+    }
+  }
   long sr = StartCritical();
-  PCB_t* pcb;
-  // look for open process spot
-  if(ProcessCount == NUMPROCESSES) {
+  PCB_t* pcb = PCBAlloc();
+  if(pcb == NULL) {
     EndCritical(sr);
-    return 0;
-  }
-  for(int i = 0; i < NUMPROCESSES; i++){
-    if(CurrentProcesses[i] == 0) {
-      // claim this location
-      pcb = &PCBStack[i];
-      CurrentProcesses[i] = 1;
-      break;
+    if(arena != NULL) {
+      Heap_DestroyArena(arena);
     }
+    return 0;
   }
   pcb->text = text; //not sure what the point of text is
   pcb->data = data;
+  pcb->arena = arena;
+  pcb->threads = 0;
   int x = OS_AddThread_Process(entry, stackSize, priority, pcb);
+  if(x == 0) {
+    // no TCB for the first thread, the caller still owns text and data
+    PCBFree(pcb);
+    EndCritical(sr);
+    if(arena != NULL) {
+      Heap_DestroyArena(arena);
+    }
+    return 0;
+  }
   EndCritical(sr);
   return x; // replace this line with Lab 5 solution
 }
 
+//******** OS_CurrentProcess *************** 
+// returns the process of the running thread
+// Inputs: none
+// Outputs: PCB of the process, NULL for OS threads
+PCB_t* OS_CurrentProcess(void){
+  if(RunPt == NULL) {
+    return NULL;
+  }
+  return RunPt->parent;
+};
+
 
 //******** OS_Id *************** 
 // returns the thread ID for the currently running thread
@@ -710,9 +1587,145 @@ int OS_AddProcess(void(*entry)(void), void *text, void *data,
 // Outputs: Thread ID, number greater than zero 
 uint32_t OS_Id(void){
   // put Lab 2 (and beyond) solution here
+  if(RunPt == NULL) { // e.g., Heap_Malloc in main before the first thread
+    return NUMTHREADS;
+  }
   return RunPt->id;
 };
 
+//******** OS_SetPriority *************** 
+// change the priority of a thread, takes effect immediately
+// the thread is moved within the active list or within the
+// wait list of the semaphore it is blocked on, and the scheduler
+// switches if a higher priority thread became ready
+// Inputs: thread ID (as returned by OS_Id), new priority, 0 is highest
+// Outputs: 1 if successful, 0 if there is no such thread or the
+//          priority does not fit in 8 bits
+// Call from a foreground thread
+int OS_SetPriority(uint32_t id, uint32_t priority){
+  if(id >= NUMTHREADS || priority > 0xFF) {
+    return 0;
+  }
+  long sr = StartCritical();
+  if(CurrentThreads[id] == 0) {
+    EndCritical(sr);
+    return 0;
+  }
+  TCB_t* tcb = &TCBStack[id];
+  if(tcb->priority == priority) {
+    EndCritical(sr);
+    return 1;
+  }
+  
+  if(!OS_Active) {
+    // not launched yet, reinsert in order and start with the highest
+    RunPt = MoveInActive(tcb, priority);
+  }
+  else if(tcb->status == 1) {
+    // blocked, reorder the wait list so it is woken in priority order
+    RemoveFromWaitList(tcb->waitList, tcb);
+    tcb->priority = priority;
+    InsertIntoWaitList(tcb->waitList, tcb);
+  }
+  else if(tcb->sleep_state != 0 || tcb->next == NULL) {
+    // sleeping, order does not matter
+    tcb->priority = priority;
+  }
+  else if(tcb == NextRunPt && tcb != RunPt) {
+    // already picked to run next, a switch is pending: move it and pick
+    // again, FindNextRunReq no longer applies once RunPt left the ring
+    TCB_t* head = MoveInActive(tcb, priority);
+    if(RunPt->next != NULL && RunPt->status == 0 && RunPt->sleep_state == 0 &&
+       RunPt->priority <= head->priority) {
+      NextRunPt = RunPt; // RunPt stays ready and is now the highest
+    }
+    else {
+      NextRunPt = head;
+    }
+  }
+  else if(tcb == RunPt) {
+    tcb->priority = priority;
+    if(RunPt->next != RunPt) {
+      // take RunPt out of the active list and put it back in order
+      GetPrevious(RunPt)->next = RunPt->next;
+      TCB_t* head = FindRingHead(RunPt->next);
+      if(priority <= head->priority) {
+        // still the highest priority, keep running at the front
+        GetPrevious(head)->next = RunPt;
+        RunPt->next = head;
+      }
+      else {
+        NextRunPt = head;
+        InsertIntoActive(RunPt);
+        ContextSwitchHelper();
+      }
+    }
+  }
+  else {
+    // ready, move within the active list and preempt if needed
+    GetPrevious(tcb)->next = tcb->next;
+    tcb->priority = priority;
+    if(InsertIntoActive(tcb)) {
+      ContextSwitchHelper();
+    }
+  }
+  EndCritical(sr);
+  return 1;
+};
+
+//******** OS_GetPriority *************** 
+// returns the priority of a thread
+// Inputs: thread ID (as returned by OS_Id)
+// Outputs: priority, -1 if there is no such thread
+int32_t OS_GetPriority(uint32_t id){
+  if(id >= NUMTHREADS || CurrentThreads[id] == 0) {
+    return -1;
+  }
+  return TCBStack[id].priority;
+};
+
+//******** OS_SetTimeSlice *************** 
+// set the time slice of a thread, takes effect the next time it is switched in
+// Inputs: thread ID (as returned by OS_Id)
+//         slice in 12.5ns units, clamped to SLICE_MIN..0xFFFFFF
+//         1 to let the scheduler adapt the slice from there, 0 to keep it fixed
+// Outputs: 1 if successful, 0 if there is no such thread
+int OS_SetTimeSlice(uint32_t id, uint32_t slice, int adaptive){
+  if(id >= NUMTHREADS) {
+    return 0;
+  }
+  if(slice < SLICE_MIN) {
+    slice = SLICE_MIN;
+  }
+  if(slice > 0xFFFFFF) {
+    slice = 0xFFFFFF;
+  }
+  long sr = StartCritical();
+  if(CurrentThreads[id] == 0) {
+    EndCritical(sr);
+    return 0;
+  }
+  TCB_t* tcb = &TCBStack[id];
+  tcb->timeSlice = slice;
+  tcb->adaptive = (adaptive != 0);
+  if(tcb->elapsedTime >= slice) {
+    tcb->elapsedTime = 0;
+  }
+  EndCritical(sr);
+  return 1;
+};
+
+//******** OS_GetTimeSlice *************** 
+// returns the current time slice of a thread
+// Inputs: thread ID (as returned by OS_Id)
+// Outputs: slice in 12.5ns units, 0 if there is no such thread
+uint32_t OS_GetTimeSlice(uint32_t id){
+  if(id >= NUMTHREADS || CurrentThreads[id] == 0) {
+    return 0;
+  }
+  return TCBStack[id].timeSlice;
+};
+
 //******** OS_AddPeriodicThread *************** 
 // add a background periodic task
 // typically this function receives the highest priority
@@ -844,7 +1857,10 @@ void OS_Sleep(uint32_t sleepTime){
   // put Lab 2 (and beyond) solution here
   long sr = StartCritical();
   RunPt->sleep_state = sleepTime;
-  NextRunPt = FindNextRunReq();
+  // a yield stays in the ring, so only a peer at the same priority may
+  // take over; lower priority threads would keep the CPU until the next
+  // wakeup because SysTick never switches up
+  NextRunPt = sleepTime ? FindNextRunReq() : FindNextRunLax();
   
   // insert into sleep linked list (order does not matter here)
   if(sleepTime != 0){
@@ -858,8 +1874,9 @@ void OS_Sleep(uint32_t sleepTime){
       RunPt->next = SleepPt;
       SleepPt = RunPt;
     }
+    ActiveThreads--;
   }
-  ActiveThreads--;
+  // sleep of 0 just gives up the rest of the time slice
   ContextSwitchHelper();
   EndCritical(sr);
 };  
@@ -872,31 +1889,50 @@ void OS_Kill(void){
   // put Lab 2 (and beyond) solution here
   DisableInterrupts();
 
-  // free this location
+  // free this location, the TCB once PendSV is done with it
   CurrentThreads[RunPt->id] = 0;
+  ZombieFree();
+  Zombie = RunPt;
   
-  ThreadCount--;
   ActiveThreads--;
   
   NextRunPt = FindNextRunReq();
   GetPrevious(RunPt)->next = RunPt->next;
   RunPt->next = NULL;
+  
+  // wake threads in OS_Join, RunPt is already out of the active list
+  // so they are inserted relative to NextRunPt
+  ThreadGeneration[RunPt->id]++;
+  while(JoinSema[RunPt->id].head != NULL) {
+    TCB_t* joiner = JoinSema[RunPt->id].head;
+    if(joiner->joinCode != NULL) {
+      *(joiner->joinCode) = ExitCode[RunPt->id];
+      joiner->joinCode = NULL;
+    }
+    OS_Signal(&JoinSema[RunPt->id]);
+  }
+  
+#if HEAP_DEBUG
+  Heap_DebugExit(RunPt->id, NULL);
+#endif
   // free text and data from heap if last thread in process
   if(RunPt->parent != NULL) {
-    // see if other threads are using this process - need to look in active, slept, and blocked
-    uint16_t i = 0;
-    for(i = 0; i < NUMTHREADS; i++) {
-      if(CurrentThreads[i] == 1) {
-        if(TCBStack[i].parent == RunPt->parent) {
-          break; //still in use
-        }
-      }
-    }
-    
-    if(i == 10) {
+    RunPt->parent->threads--;
+    if(RunPt->parent->threads == 0) {
+#if HEAP_DEBUG
+      Heap_DebugExit(HEAP_ANYTHREAD, RunPt->parent);
+#endif
       //no other threads are part of this process, free heap
-      Heap_Free(RunPt->parent->data);
-      Heap_Free(RunPt->parent->text);
+      // without blocking, interrupts are disabled and RunPt is off the
+      // active list, a thread holding the heap lock frees them instead
+      Heap_Release(RunPt->parent->data);
+      Heap_Release(RunPt->parent->text);
+      // everything the process allocated goes back in one step
+      if(RunPt->parent->arena != NULL) {
+        Heap_ReleaseArena(RunPt->parent->arena);
+        RunPt->parent->arena = NULL;
+      }
+      PCBFree(RunPt->parent);
     }
   }
   ContextSwitchHelper();
@@ -904,6 +1940,56 @@ void OS_Kill(void){
   //while(1){};
 }; 
 
+// ******** OS_ThreadExit ************
+// kill the currently running thread with an exit code
+// threads waiting in OS_Join for this thread receive the code
+// input:  exit code
+// output: none
+void OS_ThreadExit(int32_t code){
+  ExitCode[RunPt->id] = code;
+  OS_Kill();
+};
+
+// ******** OS_Join ************
+// wait for a thread to finish and retrieve its exit code
+// input:  thread handle, pointer to store the exit code (may be NULL),
+//         timeout in ms, 0 waits forever
+// output: 1 if the thread finished, 0 on timeout, invalid or reused handle
+int OS_Join(uint32_t handle, int32_t *code, uint32_t timeout){
+  uint32_t id = OS_THREAD_ID(handle);
+  uint32_t generation = handle >> 8;
+  if(id >= NUMTHREADS || &TCBStack[id] == RunPt) {
+    return 0;
+  }
+  long sr = StartCritical();
+  uint32_t exits = ThreadGeneration[id] & OS_HANDLE_GENMASK;
+  if(exits != generation) {
+    // finished, unless the ID has been given to another thread since
+    int finished = (exits == ((generation + 1) & OS_HANDLE_GENMASK) && CurrentThreads[id] == 0);
+    if(finished && code != NULL) {
+      *code = ExitCode[id];
+    }
+    EndCritical(sr);
+    return finished;
+  }
+  if(CurrentThreads[id] == 0) {
+    // this run never started
+    EndCritical(sr);
+    return 0;
+  }
+  
+  // block until OS_Kill signals, it stores the code through joinCode
+  // (with timeout 0 this also works from the SVC handler, where the
+  // wait returns before the switch, the SVC rejects other timeouts)
+  RunPt->joinCode = code;
+  int finished = OS_WaitTimeout(&JoinSema[id], timeout);
+  if(!finished) {
+    RunPt->joinCode = NULL;
+  }
+  EndCritical(sr);
+  return finished;
+};
+
 // ******** OS_Suspend ************
 // suspend execution of currently running thread
 // scheduler will choose another thread to execute
@@ -930,6 +2016,7 @@ void OS_Fifo_Init(uint32_t size){
   // put Lab 2 (and beyond) solution here
   OSFifo_Init();
   OS_InitSemaphore(&OSFIFODataLeft, 0);
+  OS_NameSemaphore(&OSFIFODataLeft, "OSFIFODataLeft");
 };
 
 // ******** OS_Fifo_Put ************
@@ -982,7 +2069,9 @@ int32_t OS_Fifo_Size(void){
 void OS_MailBox_Init(void){
   // put Lab 2 (and beyond) solution here
   OS_InitSemaphore(&DataValid, 0);
+  OS_NameSemaphore(&DataValid, "DataValid");
   OS_InitSemaphore(&BoxFree, 1);
+  OS_NameSemaphore(&BoxFree, "BoxFree");
 };
 
 // ******** OS_MailBox_Send ************
@@ -1040,6 +2129,99 @@ uint32_t OS_TimeDifference(uint32_t start, uint32_t stop){
 };
 
 
+#if SCHED_STATS
+static uint32_t ContextSwitches; // since OS_Launch
+static uint64_t SwitchTime;      // OS_Time64 of the last switch
+#endif
+
+// ******** OS_SwitchHook ************
+// called by PendSV_Handler with interrupts disabled,
+// RunPt is the thread leaving and NextRunPt the one coming in
+// Inputs:  none
+// Outputs: none
+void OS_SwitchHook(void){
+#if SCHED_STATS
+  uint64_t now = OS_Time64();
+  RunPt->runTime += now - SwitchTime; // a killed thread's TCB is reset when reused
+  SwitchTime = now;
+  NextRunPt->switchIns++;
+  ContextSwitches++;
+#endif
+};
+
+// ******** OS_ThreadStats ************
+// scheduler statistics of a thread, needs SCHED_STATS
+// Inputs:  thread ID, call by reference switch count and CPU time (12.5ns units)
+// Outputs: 1 if successful, 0 if the ID is invalid or SCHED_STATS is 0
+int OS_ThreadStats(uint32_t id, uint32_t *switchIns, uint64_t *runTime){
+#if SCHED_STATS
+  if(id >= NUMTHREADS) {
+    return 0;
+  }
+  long sr = StartCritical();
+  *switchIns = TCBStack[id].switchIns;
+  *runTime = TCBStack[id].runTime;
+  if(&TCBStack[id] == RunPt) { // include the current slice
+    *runTime += OS_Time64() - SwitchTime;
+  }
+  EndCritical(sr);
+  return 1;
+#else
+  return 0;
+#endif
+};
+
+// ******** OS_ContextSwitches ************
+// total number of context switches since OS_Launch, needs SCHED_STATS
+// Inputs:  none
+// Outputs: switch count, 0 if SCHED_STATS is 0
+uint32_t OS_ContextSwitches(void){
+#if SCHED_STATS
+  return ContextSwitches;
+#else
+  return 0;
+#endif
+};
+
+// ******** OS_Time64 ************
+// return the 64-bit monotonic system time, never reset and never steps back
+// Inputs:  none
+// Outputs: time in 12.5ns units since OS_Init
+// safe to call from threads, interrupts, or with interrupts disabled
+uint64_t OS_Time64(void){
+  uint64_t ticks;
+  uint32_t count;
+  uint32_t pending;
+  // no lock, retry if Timer5A_Handler ran while we were reading
+  do {
+    ticks = TimerTicks;
+    count = TIMER5_TAR_R;
+    // timed out but the interrupt has not run yet (or is masked by the caller),
+    // count the tick here and read the count again since it may be from before the reload
+    pending = TIMER5_RIS_R & 0x01;
+    if(pending) {
+      count = TIMER5_TAR_R;
+    }
+  } while(ticks != TimerTicks);
+  return (ticks + pending)*80000 + (79999 - count);
+};
+
+// ******** OS_CyclesToUs ************
+// convert a time or difference from OS_Time64 to microseconds
+// Inputs:  time in 12.5ns units
+// Outputs: time in us units
+uint64_t OS_CyclesToUs(uint64_t cycles){
+  return cycles/80;
+};
+
+// ******** OS_CyclesToMs ************
+// convert a time or difference from OS_Time64 to milliseconds
+// Inputs:  time in 12.5ns units
+// Outputs: time in ms units
+uint64_t OS_CyclesToMs(uint64_t cycles){
+  return cycles/80000;
+};
+
 // ******** OS_ClearMsTime ************
 // sets the system time to zero (solve for Lab 1), and start a periodic interrupt
 // Inputs:  none
@@ -1055,6 +2237,7 @@ void OS_ClearMsTime(void){
 void Timer5A_Handler(void){
   long sr = StartCritical();
   TIMER5_ICR_R = 0x01;         // acknowledge timer0A timeout
+  TimerTicks++;
   if(msSystemTime == 9999){
 		msSystemTime = 0;
 		tensecSystemTime++;
@@ -1062,18 +2245,21 @@ void Timer5A_Handler(void){
 		msSystemTime++;                // execute user task
 	}
   
-  if(SleepPt == NULL) {
+  int result = ExpireTimeouts();
+  
+  // SleepPt == RunPt: hasn't been moved yet
+  if(SleepPt == NULL || SleepPt == RunPt) {
+#if PRI
+    if(result == 1){
+      ContextSwitchHelper();
+    }
+#endif
     EndCritical(sr);
     return;
   }
   
   TCB_t* previous = NULL;
   TCB_t* next = SleepPt;
-  int result = 0;
-  if(SleepPt == RunPt) { // hasn't been moved yet
-    EndCritical(sr);
-    return;
-  }
   do{
     // Decrement sleep_state if > 0
     next->sleep_state--;
@@ -1131,11 +2317,22 @@ uint32_t OS_MsTime(void){
 // In Lab 2, you can ignore the theTimeSlice field
 // In Lab 3, you should implement the user-defined TimeSlice field
 // It is ok to limit the range of theTimeSlice to match the 24-bit SysTick
+// theTimeSlice becomes the slice of every thread that has none set yet
 void OS_Launch(uint32_t theTimeSlice){
   // put Lab 2 (and beyond) solution here
-  SysTick_Init(theTimeSlice);
   TimeSlice = theTimeSlice;
+  TCB_t* tcb = RunPt; // threads added so far are all in the active list
+  do {
+    if(tcb->timeSlice == 0) {
+      tcb->timeSlice = TimeSlice;
+    }
+    tcb = tcb->next;
+  } while(tcb != RunPt);
+  SysTick_Init(RunPt->timeSlice);
   OS_Active = 1;
+#if SCHED_STATS
+  SwitchTime = OS_Time64();
+#endif
   NextRunPt = RunPt;
   StartOS(RunPt->sp);
 };
@@ -1146,6 +2343,7 @@ void OS_Launch(uint32_t theTimeSlice){
 int StreamToDevice=0;                // 0=UART, 1=stream to file (Lab 4)
 
 int fputc (int ch, FILE *f) { 
+#if CFG_EFILE
   if(StreamToDevice==1){  // Lab 4
     if(eFile_Write(ch)){          // close file on error
        OS_EndRedirectToFile(); // cannot write to file
@@ -1153,6 +2351,7 @@ int fputc (int ch, FILE *f) {
     }
     return 0; // success writing
   }
+#endif
   
   // default UART output
   UART_OutChar(ch);
@@ -1166,15 +2365,21 @@ int fgetc (FILE *f){
 }
 
 int OS_RedirectToFile(const char *name){  // Lab 4
+#if CFG_EFILE
   eFile_Create(name);              // ignore error if file already exists
   if(eFile_WOpen(name)) return 1;  // cannot open file
   StreamToDevice = 1;
   return 0;
+#else
+  return 1;                        // no file system in this image
+#endif
 }
 
 int OS_EndRedirectToFile(void){  // Lab 4
   StreamToDevice = 0;
+#if CFG_EFILE
   if(eFile_WClose()) return 1;    // cannot close file
+#endif
   return 0;
 }
 
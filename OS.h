@@ -17,6 +17,7 @@
 #ifndef __OS_H
 #define __OS_H  1
 #include <stdint.h>
+#include "../RTOS_Labs_common/OSConfig.h"
 
 /**
  * \brief Times assuming a 80 MHz
@@ -34,6 +35,9 @@
 struct PCB {
   void* text;
   void* data;
+  struct heap* arena; // Heap_Malloc for this process's threads, NULL uses the kernel heap
+  uint32_t threads;   // live threads, the process is torn down when this reaches 0
+  struct PCB* nextFree; // free list link while the PCB is unused
 };
 typedef struct PCB PCB_t;
 
@@ -45,25 +49,118 @@ typedef struct PCB PCB_t;
 struct TCB {
   uint32_t* sp;
   uint32_t elapsedTime;
+  uint32_t timeSlice; // SysTick reload while running, PendSV reads it at offset 8
   struct TCB* next; // next element in list, NOT next thread to be run
   uint16_t id;
   uint32_t sleep_state;
   uint8_t priority;
   uint8_t status; // 1 - blocked, 0 - not blocked
+  uint8_t adaptive; // 1 - timeSlice follows the adaptive policy
   PCB_t* parent;
+  struct TCB** waitList; // head of the wait list while blocked (status 1)
+  int32_t* joinCode;     // where to store the exit code while in OS_Join
+  struct Sema4* timedSema; // semaphore of an OS_WaitTimeout, NULL otherwise
+  struct TCB* nextTimed;   // next thread in OS_WaitTimeout
+  uint32_t timeout;        // ms left in OS_WaitTimeout
+  uint8_t timedOut;        // 1 if the last OS_WaitTimeout expired
+  struct TCB* nextFree;  // free list link while the TCB is unused
+#if SEMA_PROFILE
+  uint64_t blockStart; // OS_Time64 when this thread last blocked on a semaphore
+#endif
+#if SCHED_STATS
+  uint32_t switchIns;  // times this thread was switched to
+  uint64_t runTime;    // CPU time used, 12.5ns units
+#endif
 };
 typedef struct TCB TCB_t;
 
 /**
  * \brief Semaphore structure. Feel free to change the type of semaphore, there are lots of good solutions
  */  
+#if SEMA_PROFILE
+struct SemaWaiter {
+  uint32_t id;          // thread ID, 0 entries with time 0 are unused
+  uint32_t blockedTime; // total time this thread was blocked, 12.5ns units
+};
+typedef struct SemaWaiter SemaWaiter_t;
+#endif
+
 struct  Sema4{
   int32_t Value;   // >0 means free, otherwise means busy
   TCB_t* head;
 // add other components here, if necessary to implement blocking
+#if SEMA_PROFILE
+  const char* name;         // label set with OS_NameSemaphore
+  uint32_t acquisitions;    // number of wait calls
+  uint32_t contended;       // number of wait calls that blocked
+  uint64_t blockedTime;     // total time spent blocked, 12.5ns units
+  uint32_t maxBlockedTime;  // longest single block, 12.5ns units
+  SemaWaiter_t waiters[SEMA_TOPWAITERS]; // heaviest waiters, sorted
+#endif
 };
 typedef struct Sema4 Sema4Type;
 
+/**
+ * \brief Reader-writer lock, readers share the lock, writers are exclusive.
+ * Lock ownership is handed to the woken threads by the releasing thread.
+ */
+#define RWLOCK_WRITERPREF 0 // waiting writers always go first, readers may starve
+#define RWLOCK_FAIR       1 // batches of readers and single writers alternate
+struct RWLock {
+  int32_t readers;         // number of readers holding the lock
+  uint8_t writer;          // 1 if a writer holds the lock
+  uint8_t policy;          // RWLOCK_WRITERPREF or RWLOCK_FAIR
+  uint32_t waitingReaders; // readers blocked on readQueue
+  uint32_t waitingWriters; // writers blocked on writeQueue
+  Sema4Type readQueue;     // blocked readers
+  Sema4Type writeQueue;    // blocked writers
+};
+typedef struct RWLock RWLockType;
+
+/**
+ * \brief Condition variable, used together with a binary semaphore
+ * as the mutex. Woken threads recheck their condition (Mesa style).
+ */
+struct Cond {
+  struct TCB* head; // blocked threads, highest priority first
+};
+typedef struct Cond CondType;
+
+/**
+ * \brief Reusable barrier, threads block until all parties have arrived
+ */
+struct Barrier {
+  uint32_t parties; // threads per phase
+  uint32_t arrived; // threads waiting in the current phase
+  struct TCB* head; // blocked threads, highest priority first
+};
+typedef struct Barrier BarrierType;
+
+/**
+ * \brief One-shot countdown latch, waiters are released once it reaches zero
+ */
+struct Latch {
+  uint32_t count;   // count downs still needed
+  struct TCB* head; // blocked threads, highest priority first
+};
+typedef struct Latch LatchType;
+
+/**
+ * \brief Pool of equal fixed-size blocks, unused blocks are linked through their first word
+ */
+struct Pool {
+  void* free;          // first unused block, NULL if all are out
+  uint32_t blockSize;  // bytes, rounded up to a whole word
+  uint32_t count;      // blocks in the pool
+  uint32_t used;       // blocks handed out now
+  uint32_t highWater;  // most blocks out at the same time
+  uint32_t failures;   // OS_PoolAlloc calls that found the pool empty
+  const char* name;    // label for the statistics
+  struct Pool* nextPool; // next pool in the list OS_Pools reports
+  void* storage;       // heap block OS_InitPool took, NULL for caller memory
+};
+typedef struct Pool PoolType;
+
 /**
  *
  * @brief List of available HW
@@ -97,6 +194,23 @@ void OS_Init(void);
 // output: none
 void OS_InitSemaphore(Sema4Type *semaPt, int32_t value); 
 
+#if SEMA_PROFILE
+// ******** OS_NameSemaphore ************
+// attach a label to a semaphore for the contention profiler
+// call after OS_InitSemaphore
+// input:  pointer to a semaphore, constant string
+// output: none
+void OS_NameSemaphore(Sema4Type *semaPt, const char *name);
+
+// ******** OS_HottestSemaphores ************
+// list the profiled semaphores, most blocked time first
+// input:  array to fill, size of the array
+// output: number of entries filled in
+uint32_t OS_HottestSemaphores(Sema4Type *list[], uint32_t max);
+#else
+#define OS_NameSemaphore(semaPt, name)
+#endif
+
 // ******** OS_Wait ************
 // decrement semaphore 
 // Lab2 spinlock
@@ -113,6 +227,26 @@ void OS_Wait(Sema4Type *semaPt);
 // output: none
 void OS_Signal(Sema4Type *semaPt); 
 
+// ******** OS_TryWait ************
+// decrement semaphore only if that does not block
+// input:  pointer to a counting semaphore
+// output: 1 if decremented, 0 if the semaphore was not available
+int OS_TryWait(Sema4Type *semaPt); 
+
+// ******** OS_WaitTimeout ************
+// decrement semaphore, block for at most timeout ms if less than zero
+// a signal that arrives after the timeout counts for the next wait
+// input:  pointer to a counting semaphore, timeout in ms, 0 waits forever
+// output: 1 if decremented, 0 on timeout
+// Call from a foreground thread, not from a process (SVC)
+int OS_WaitTimeout(Sema4Type *semaPt, uint32_t timeout); 
+
+// ******** OS_bTryWait ************
+// take binary semaphore only if it is free
+// input:  pointer to a binary semaphore
+// output: 1 if taken, 0 if the semaphore was busy
+int OS_bTryWait(Sema4Type *semaPt); 
+
 // ******** OS_bWait ************
 // Lab2 spinlock, set to 0
 // Lab3 block if less than zero
@@ -127,6 +261,161 @@ void OS_bWait(Sema4Type *semaPt);
 // output: none
 void OS_bSignal(Sema4Type *semaPt); 
 
+// ******** OS_InitRWLock ************
+// initialize reader-writer lock, free
+// input:  pointer to a lock, RWLOCK_WRITERPREF or RWLOCK_FAIR
+// output: none
+void OS_InitRWLock(RWLockType *lockPt, uint8_t policy); 
+
+// ******** OS_ReadLock ************
+// take the lock shared, blocks while a writer holds it or waits for it
+// input:  pointer to a lock
+// output: none
+void OS_ReadLock(RWLockType *lockPt); 
+
+// ******** OS_ReadUnlock ************
+// release a shared hold, the last reader hands over to a waiting writer
+// input:  pointer to a lock
+// output: none
+void OS_ReadUnlock(RWLockType *lockPt); 
+
+// ******** OS_WriteLock ************
+// take the lock exclusive, blocks while readers or a writer hold it
+// input:  pointer to a lock
+// output: none
+void OS_WriteLock(RWLockType *lockPt); 
+
+// ******** OS_WriteUnlock ************
+// release an exclusive hold, wakes the next writer or all waiting
+// readers depending on the policy
+// input:  pointer to a lock
+// output: none
+void OS_WriteUnlock(RWLockType *lockPt); 
+
+// ******** OS_InitCond ************
+// initialize condition variable, no waiters
+// input:  pointer to a condition variable
+// output: none
+void OS_InitCond(CondType *condPt); 
+
+// ******** OS_CondWait ************
+// release the mutex and block on the condition in one atomic step,
+// the mutex is taken again before returning
+// input:  pointer to a condition variable, binary semaphore held by caller
+// output: none
+void OS_CondWait(CondType *condPt, Sema4Type *lockPt); 
+
+// ******** OS_CondSignal ************
+// wake the highest priority thread waiting on the condition
+// input:  pointer to a condition variable
+// output: none
+void OS_CondSignal(CondType *condPt); 
+
+// ******** OS_CondBroadcast ************
+// wake every thread waiting on the condition, in priority order,
+// with at most one context switch
+// input:  pointer to a condition variable
+// output: none
+void OS_CondBroadcast(CondType *condPt); 
+
+// ******** OS_InitBarrier ************
+// initialize barrier for a number of threads
+// input:  pointer to a barrier, number of parties (at least 1)
+// output: none
+void OS_InitBarrier(BarrierType *barrierPt, uint32_t parties); 
+
+// ******** OS_BarrierWait ************
+// block until all parties have called OS_BarrierWait, the last one
+// to arrive releases the others and resets the barrier for the next phase
+// input:  pointer to a barrier
+// output: 1 for the last thread to arrive, 0 for the others
+int OS_BarrierWait(BarrierType *barrierPt); 
+
+// ******** OS_InitLatch ************
+// initialize countdown latch
+// input:  pointer to a latch, number of count downs before release
+// output: none
+void OS_InitLatch(LatchType *latchPt, uint32_t count); 
+
+// ******** OS_LatchCountDown ************
+// decrement the latch, the count down to zero releases all waiters
+// can be called from an interrupt
+// input:  pointer to a latch
+// output: none
+void OS_LatchCountDown(LatchType *latchPt); 
+
+// ******** OS_LatchWait ************
+// block until the latch has counted down to zero, returns at once after that
+// input:  pointer to a latch
+// output: none
+void OS_LatchWait(LatchType *latchPt); 
+
+// ******** OS_InitPool ************
+// initialize a pool of count blocks of blockSize bytes each
+// input:  pointer to a pool, label for the statistics,
+//         storage of count*blockSize bytes (word aligned), NULL to take it from the heap,
+//         block size in bytes (rounded up to a word), number of blocks
+// output: 1 if successful, 0 if the heap has no room for the storage
+// initializing a pool again reuses or frees the heap storage it took before;
+// the pool stays on the list OS_Pools reports until OS_DestroyPool, so a
+// pool that is not static must be destroyed before it goes out of scope
+int OS_InitPool(PoolType *poolPt, const char *name, void *memory, 
+  uint32_t blockSize, uint32_t count); 
+
+// ******** OS_DestroyPool ************
+// take a pool off the list OS_Pools reports and give the storage OS_InitPool
+// took from the heap back, blocks still out of the pool become invalid
+// not from an interrupt
+// input:  pointer to a pool
+// output: 1 if successful, 0 if the pool was not initialized
+int OS_DestroyPool(PoolType *poolPt); 
+
+// ******** OS_PoolAlloc ************
+// take a block from the pool, never blocks
+// can be called from an interrupt
+// input:  pointer to a pool
+// output: pointer to the block, NULL if the pool is empty
+void* OS_PoolAlloc(PoolType *poolPt); 
+
+// ******** OS_PoolFree ************
+// give a block back to the pool it came from
+// can be called from an interrupt
+// input:  pointer to a pool, block from OS_PoolAlloc on that pool
+// output: none
+void OS_PoolFree(PoolType *poolPt, void *block); 
+
+// ******** OS_Pools ************
+// list the initialized pools, e.g., to print their statistics next to Heap_Stats
+// input:  array to fill, its size
+// output: number of pools stored in the array
+uint32_t OS_Pools(PoolType *list[], uint32_t max); 
+
+//******** OS_AddProcess *************** 
+// add a process with foregound thread to the scheduler,
+// the process gets an arena of ARENASIZE bytes for its allocations
+// Inputs: pointer to a void/void entry point
+//         pointer to process text (code) segment
+//         pointer to process data segment
+//         number of bytes allocated for its stack
+//         priority (0 is highest)
+// Outputs: 1 if successful, 0 if this process can not be added
+int OS_AddProcess(void(*entry)(void), void *text, void *data, 
+  unsigned long stackSize, unsigned long priority);
+
+//******** OS_AddProcessArena *************** 
+// same as OS_AddProcess with the arena size chosen at load time
+// Inputs: as OS_AddProcess, plus arena size in bytes (0 for no arena,
+//         the process then allocates from the kernel heap)
+// Outputs: 1 if successful, 0 if this process can not be added
+int OS_AddProcessArena(void(*entry)(void), void *text, void *data, 
+  unsigned long stackSize, unsigned long priority, unsigned long arenaSize);
+
+//******** OS_CurrentProcess *************** 
+// returns the process of the running thread
+// Inputs: none
+// Outputs: PCB of the process, NULL for OS threads
+PCB_t* OS_CurrentProcess(void);
+
 //******** OS_AddThread *************** 
 // add a foregound thread to the scheduler
 // Inputs: pointer to a void/void foreground task
@@ -139,10 +428,23 @@ void OS_bSignal(Sema4Type *semaPt);
 int OS_AddThread(void(*task)(void), 
    uint32_t stackSize, uint32_t priority);
 
+//******** OS_AddThreadId *************** 
+// add a foregound thread to the scheduler and return its handle,
+// e.g., to wait for it with OS_Join. The handle names this run of the
+// thread, OS_THREAD_ID gives the thread ID used by the other calls.
+// Inputs: same as OS_AddThread
+// Outputs: thread handle, -1 if this thread can not be added
+int32_t OS_AddThreadId(void(*task)(void), 
+   uint32_t stackSize, uint32_t priority);
+
+#define OS_HANDLE_GENMASK 0x7FFFFF   // exits counted in a thread handle
+#define OS_THREAD_ID(handle) ((uint32_t)(handle) & 0xFF)
+
 //******** OS_Id *************** 
 // returns the thread ID for the currently running thread
 // Inputs: none
 // Outputs: Thread ID, number greater than zero 
+//          NUMTHREADS if no thread has been added yet
 uint32_t OS_Id(void);
 
 //******** OS_AddPeriodicThread *************** 
@@ -195,6 +497,38 @@ int OS_AddSW1Task(void(*task)(void), uint32_t priority);
 //           determines the relative priority of these four threads
 int OS_AddSW2Task(void(*task)(void), uint32_t priority);
 
+//******** OS_SetPriority *************** 
+// change the priority of a thread, takes effect immediately
+// the thread is moved within the active list or within the
+// wait list of the semaphore it is blocked on, and the scheduler
+// switches if a higher priority thread became ready
+// Inputs: thread ID (as returned by OS_Id), new priority, 0 is highest
+// Outputs: 1 if successful, 0 if there is no such thread or the
+//          priority does not fit in 8 bits
+// Call from a foreground thread
+int OS_SetPriority(uint32_t id, uint32_t priority);
+
+//******** OS_GetPriority *************** 
+// returns the priority of a thread
+// Inputs: thread ID (as returned by OS_Id)
+// Outputs: priority, -1 if there is no such thread
+int32_t OS_GetPriority(uint32_t id);
+
+//******** OS_SetTimeSlice *************** 
+// set the time slice of a thread, takes effect the next time it is switched in
+// Inputs: thread ID (as returned by OS_Id)
+//         slice in 12.5ns units, clamped to SLICE_MIN..0xFFFFFF
+//         1 to let the scheduler adapt the slice from there, 0 to keep it fixed
+// Outputs: 1 if successful, 0 if there is no such thread
+// Threads start with the OS_Launch slice and ADAPTIVE_SLICE
+int OS_SetTimeSlice(uint32_t id, uint32_t slice, int adaptive);
+
+//******** OS_GetTimeSlice *************** 
+// returns the current time slice of a thread
+// Inputs: thread ID (as returned by OS_Id)
+// Outputs: slice in 12.5ns units, 0 if there is no such thread
+uint32_t OS_GetTimeSlice(uint32_t id);
+
 // ******** OS_Sleep ************
 // place this thread into a dormant state
 // input:  number of msec to sleep
@@ -209,6 +543,28 @@ void OS_Sleep(uint32_t sleepTime);
 // output: none
 void OS_Kill(void); 
 
+// ******** OS_ThreadExit ************
+// kill the currently running thread with an exit code
+// threads waiting in OS_Join for this thread receive the code
+// the TCB and stack are released right away, as in OS_Kill
+// input:  exit code
+// output: none
+void OS_ThreadExit(int32_t code); 
+
+// ******** OS_Join ************
+// wait for a thread to finish and retrieve its exit code
+// input:  thread handle (as returned by OS_AddThreadId)
+//         pointer to store the exit code, may be NULL
+//         timeout in ms, 0 waits forever
+// output: 1 if the thread finished, 0 on timeout, for a handle that was
+//         never given out or whose ID now belongs to a later thread
+// The caller blocks until the thread exits or the timeout runs out.
+// If the thread is already gone its exit code is returned, as long as
+// its ID has not been reused.
+// Processes (SVC) must use timeout 0, the SVC returns 0 at once for any
+// other timeout without waiting.
+int OS_Join(uint32_t handle, int32_t *code, uint32_t timeout); 
+
 // ******** OS_Suspend ************
 // suspend execution of currently running thread
 // scheduler will choose another thread to execute
@@ -300,6 +656,44 @@ uint32_t OS_Time(void);
 //   this function and OS_Time have the same resolution and precision 
 uint32_t OS_TimeDifference(uint32_t start, uint32_t stop);
 
+// ******** OS_SwitchHook ************
+// called by PendSV_Handler with interrupts disabled,
+// RunPt is the thread leaving and NextRunPt the one coming in
+// Inputs:  none
+// Outputs: none
+void OS_SwitchHook(void);
+
+// ******** OS_ThreadStats ************
+// scheduler statistics of a thread, needs SCHED_STATS
+// Inputs:  thread ID, call by reference switch count and CPU time (12.5ns units)
+// Outputs: 1 if successful, 0 if the ID is invalid or SCHED_STATS is 0
+int OS_ThreadStats(uint32_t id, uint32_t *switchIns, uint64_t *runTime);
+
+// ******** OS_ContextSwitches ************
+// total number of context switches since OS_Launch, needs SCHED_STATS
+// Inputs:  none
+// Outputs: switch count, 0 if SCHED_STATS is 0
+uint32_t OS_ContextSwitches(void);
+
+// ******** OS_Time64 ************
+// return the 64-bit monotonic system time, never reset and never steps back
+// Inputs:  none
+// Outputs: time in 12.5ns units since OS_Init
+// safe to call from threads, interrupts, or with interrupts disabled
+uint64_t OS_Time64(void);
+
+// ******** OS_CyclesToUs ************
+// convert a time or difference from OS_Time64 to microseconds
+// Inputs:  time in 12.5ns units
+// Outputs: time in us units
+uint64_t OS_CyclesToUs(uint64_t cycles);
+
+// ******** OS_CyclesToMs ************
+// convert a time or difference from OS_Time64 to milliseconds
+// Inputs:  time in 12.5ns units
+// Outputs: time in ms units
+uint64_t OS_CyclesToMs(uint64_t cycles);
+
 // ******** OS_ClearMsTime ************
 // sets the system time to zero (from Lab 1)
 // Inputs:  none
@@ -323,6 +717,7 @@ uint32_t OS_MsTime(void);
 // In Lab 2, you can ignore the theTimeSlice field
 // In Lab 3, you should implement the user-defined TimeSlice field
 // It is ok to limit the range of theTimeSlice to match the 24-bit SysTick
+// theTimeSlice becomes the slice of every thread that has none set yet
 void OS_Launch(uint32_t theTimeSlice);
 
 /**
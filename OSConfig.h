@@ -0,0 +1,174 @@
+/**
+ * @file      OSConfig.h
+ * @brief     Compile-time kernel configuration
+ * @details   Every table and pool size in the kernel and drivers comes from
+ * here, and optional subsystems can be left out of an image. Each setting
+ * can be overridden from the compiler command line (-DNUMTHREADS=6) to
+ * build per product variant. The checks at the bottom stop the build when
+ * a setting breaks a size or alignment requirement.
+ * @version   V1.0
+ * @date      Oct 19, 2026
+ ******************************************************************************/
+
+#ifndef OSCONFIG_H
+#define OSCONFIG_H
+
+/**
+ * \brief Threads and processes
+ */
+#ifndef NUMTHREADS
+#define NUMTHREADS 10      // TCBs and stacks
+#endif
+#ifndef NUMPROCESSES
+#define NUMPROCESSES 10    // PCBs for loaded programs
+#endif
+#ifndef STACKSIZE
+#define STACKSIZE 128      // words per thread stack, even so stacks stay 8-byte aligned
+#endif
+#ifndef PRI
+#define PRI 1              // 1 priority scheduler, 0 round robin
+#endif
+
+/**
+ * \brief Time slices in 12.5ns units, SysTick is 24 bits. Adaptive threads
+ * double their slice after using a full one and halve it after blocking
+ * early, within SLICE_MIN and SLICE_MAX
+ */
+#ifndef ADAPTIVE_SLICE
+#define ADAPTIVE_SLICE 0   // 1 new threads start adaptive, 0 fixed at the OS_Launch slice
+#endif
+#ifndef SLICE_MIN
+#define SLICE_MIN 40000    // 0.5 ms
+#endif
+#ifndef SLICE_MAX
+#define SLICE_MAX 1600000  // 20 ms
+#endif
+
+/**
+ * \brief Buffers, sizes of index FIFOs must be a power of 2
+ */
+#ifndef OSFIFOSIZE
+#define OSFIFOSIZE 64      // OS_Fifo entries
+#endif
+#ifndef UART_FIFOSIZE
+#define UART_FIFOSIZE 1024 // UART0 receive and transmit FIFOs, bytes
+#endif
+#ifndef ESP8266_FIFOSIZE
+#define ESP8266_FIFOSIZE 1024 // ESP8266 receive and transmit FIFOs, bytes
+#endif
+
+/**
+ * \brief Memory
+ */
+#ifndef HEAP_SIZE
+#define HEAP_SIZE 2048     // kernel heap, 32-bit words
+#endif
+#ifndef ARENASIZE
+#define ARENASIZE 1024     // bytes of kernel heap OS_AddProcess gives each process
+#endif
+#ifndef HEAP_POLICY
+#define HEAP_POLICY 0      // 0 good fit (segregated lists), 1 first fit, 2 next fit, 3 best fit
+#endif
+#ifndef HEAP_REGIONS
+#define HEAP_REGIONS 2     // extra regions Heap_AddRegion can register
+#endif
+#ifndef HEAP_ARENAS
+#define HEAP_ARENAS NUMPROCESSES // live arenas Heap_CreateArena can hand out
+#endif
+#ifndef HEAP_DEBUG
+#define HEAP_DEBUG 0       // 1 guard words, owner and call site on every block, leak reports
+#endif
+#define HEAP_LEAKLOG 8     // exits with outstanding blocks kept for Heap_DebugReport
+#ifndef HEAP_SWEEP_MS
+#define HEAP_SWEEP_MS 1000 // period of the HEAP_DEBUG sweep thread, 0 for none
+#endif
+#ifndef HEAP_SWEEP_PRIORITY
+#define HEAP_SWEEP_PRIORITY 6 // priority of the sweep thread, below the application
+#endif
+#ifndef HHEAP_HANDLES
+#define HHEAP_HANDLES 32   // handles of the compacting heap (hheap.c)
+#endif
+#ifndef HHEAP_STEP
+#define HHEAP_STEP 64      // words HHeap_Compactor and HHeap_Alloc copy per lock hold
+#endif
+
+/**
+ * \brief Heap_ISRMalloc size classes, bytes per block and number of blocks,
+ * carved out of the kernel heap by Heap_Init, a count of 0 drops the class.
+ * Every count is 0 by default, an application that allocates from interrupts
+ * opts in, e.g., with counts of 8, 4 and 1 (1.1 KB of the heap)
+ */
+#ifndef HEAP_ISR_SIZE0
+#define HEAP_ISR_SIZE0 16
+#define HEAP_ISR_SIZE1 64
+#define HEAP_ISR_SIZE2 512  // one SD card sector
+#endif
+#ifndef HEAP_ISR_COUNT0
+#define HEAP_ISR_COUNT0 0
+#define HEAP_ISR_COUNT1 0
+#define HEAP_ISR_COUNT2 0
+#endif
+
+/**
+ * \brief File system
+ */
+#ifndef MAXFILES
+#define MAXFILES 10        // directory entries, at most 16 (16-bit allocation mask)
+#endif
+
+/**
+ * \brief Semaphore contention profiling, 1 collects per-semaphore statistics
+ * in OS_Wait/OS_bWait/OS_Signal/OS_bSignal, 0 compiles it out (release builds)
+ */
+#ifndef SEMA_PROFILE
+#define SEMA_PROFILE 0
+#endif
+#define SEMA_REGISTRYSIZE 16  // number of semaphores the profiler can track
+#define SEMA_TOPWAITERS 3     // number of heaviest waiters kept per semaphore
+
+/**
+ * \brief Scheduler statistics, 1 counts context switches and CPU time per
+ * thread in OS_SwitchHook (used by the workload harness), 0 leaves the hook empty.
+ * PendSV_Handler in osasm.s calls the hook on every switch either way
+ */
+#ifndef SCHED_STATS
+#define SCHED_STATS 0
+#endif
+
+/**
+ * \brief Optional subsystems, 0 leaves the driver and the commands using it out
+ */
+#ifndef CFG_LCD
+#define CFG_LCD 1          // ST7735 display
+#endif
+#ifndef CFG_EFILE
+#define CFG_EFILE 1        // SD card driver and eFile file system
+#endif
+#ifndef CFG_ESP8266
+#define CFG_ESP8266 1      // ESP8266 wifi and the web shell
+#endif
+#ifndef CFG_CAN
+#define CFG_CAN 1          // CAN0 driver
+#endif
+
+// compile-time check, a false condition makes a negative array size
+#define STATIC_ASSERT(cond, name) typedef char static_assert_##name[(cond) ? 1 : -1]
+
+STATIC_ASSERT(NUMTHREADS > 0 && NUMTHREADS <= 255, numthreads_range);
+STATIC_ASSERT(NUMPROCESSES > 0, numprocesses_range);
+STATIC_ASSERT(STACKSIZE >= 32, stacksize_min);   // initial frame plus some room
+STATIC_ASSERT(STACKSIZE % 2 == 0, stacksize_align); // with the 8-byte aligned array in OS.c
+STATIC_ASSERT(SLICE_MIN > 0 && SLICE_MIN <= SLICE_MAX && SLICE_MAX <= 0xFFFFFF, slice_range);
+STATIC_ASSERT(OSFIFOSIZE > 1 && (OSFIFOSIZE & (OSFIFOSIZE - 1)) == 0, osfifosize_pow2);
+STATIC_ASSERT(UART_FIFOSIZE > 1 && (UART_FIFOSIZE & (UART_FIFOSIZE - 1)) == 0, uart_fifosize_pow2);
+STATIC_ASSERT(ESP8266_FIFOSIZE > 1 && (ESP8266_FIFOSIZE & (ESP8266_FIFOSIZE - 1)) == 0, esp8266_fifosize_pow2);
+STATIC_ASSERT(HEAP_SIZE >= 16, heap_size_min);
+STATIC_ASSERT(ARENASIZE % 4 == 0 && ARENASIZE/4 + 64 < HEAP_SIZE, arenasize_fits);
+STATIC_ASSERT(HEAP_POLICY >= 0 && HEAP_POLICY <= 3, heap_policy_range);
+STATIC_ASSERT(HEAP_ISR_SIZE0 < HEAP_ISR_SIZE1 && HEAP_ISR_SIZE1 < HEAP_ISR_SIZE2, heap_isr_order);
+STATIC_ASSERT((HEAP_ISR_SIZE0*HEAP_ISR_COUNT0 + HEAP_ISR_SIZE1*HEAP_ISR_COUNT1 + 
+  HEAP_ISR_SIZE2*HEAP_ISR_COUNT2)/4 < HEAP_SIZE/2, heap_isr_fits);
+STATIC_ASSERT(HHEAP_HANDLES > 0 && HHEAP_HANDLES < 0xFFFF && HHEAP_STEP > 0, hheap_range);
+STATIC_ASSERT(MAXFILES > 0 && MAXFILES <= 16, maxfiles_range);
+
+#endif //#ifndef OSCONFIG_H
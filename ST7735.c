@@ -117,6 +117,7 @@
 #include "../RTOS_Labs_common/ST7735.h"
 #include "../RTOS_Labs_common/OS.h"
 #include "../RTOS_Labs_common/eDisk.h"
+#if CFG_LCD
 // these defines are in two places, here and in eDisk.c
 #define SDC_CS_PB0 1
 #define SDC_CS_PD7 0
@@ -829,6 +830,7 @@ void ST7735_InitB(void) {
   StTextColor = ST7735_YELLOW;
   ST7735_FillScreen(0);                 // set screen to black
   OS_InitSemaphore(&LCDFree,1);  // means LCD free
+  OS_NameSemaphore(&LCDFree, "LCDFree");
 }
 
 
@@ -858,6 +860,7 @@ void ST7735_InitR(enum initRFlags option) {
   StTextColor = ST7735_YELLOW;
   ST7735_FillScreen(0);                 // set screen to black
   OS_InitSemaphore(&LCDFree,1);  // means LCD free
+  OS_NameSemaphore(&LCDFree, "LCDFree");
 }
 
 
@@ -1864,5 +1867,4 @@ void ST7735_SetTextColor(uint16_t color){
 //// Abstraction of general output device
 //// Volume 2 section 3.4.5
 
-
-
+#endif //#if CFG_LCD
@@ -62,12 +62,12 @@
 #define UART_ICR_RXIC           0x00000010  // Receive Interrupt Clear
 
 
-#define FIFOSIZE   1024       // size of the FIFOs (must be power of 2)
+#define FIFOSIZE   UART_FIFOSIZE // size of the FIFOs (power of 2, OSConfig.h)
 #define FIFOSUCCESS 1         // return value on success
 #define FIFOFAIL    0         // return value on failure
                               // create index implementation FIFO (see FIFO.h)
 AddIndexFifo(Rx, FIFOSIZE, char, FIFOSUCCESS, FIFOFAIL)
-AddIndexFifo(Tx, 1024, char, FIFOSUCCESS, FIFOFAIL)
+AddIndexFifo(Tx, FIFOSIZE, char, FIFOSUCCESS, FIFOFAIL)
 
 Sema4Type RxDataAvailable;
 Sema4Type TxRoomLeft;
@@ -101,7 +101,9 @@ void UART_Init(void){
   NVIC_EN0_R |= NVIC_EN0_INT5;           // enable interrupt 5 in NVIC
   
   OS_InitSemaphore(&RxDataAvailable, 0);
+  OS_NameSemaphore(&RxDataAvailable, "RxDataAvailable");
   OS_InitSemaphore(&TxRoomLeft, FIFOSIZE);
+  OS_NameSemaphore(&TxRoomLeft, "TxRoomLeft");
 }
 // copy from hardware RX FIFO to software RX FIFO
 // stop when hardware RX FIFO is empty or software RX FIFO is full
@@ -0,0 +1,238 @@
+// filename *************************bench.c ************************
+// Kernel primitive micro-benchmarks
+// Every test fills Samples[] with the time of one iteration,
+// Bench_RunOne turns that into min/mean/p99/max
+#include <stdint.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/heap.h"
+#include "../RTOS_Labs_common/eFile.h"
+#include "../RTOS_Labs_common/UART0int.h"
+#include "../RTOS_Labs_common/bench.h"
+
+#define CMD_NEXT_LINE() \
+          UART_OutChar('\n'); \
+          UART_OutChar(CR);
+
+static uint32_t Samples[BENCH_SAMPLES];
+static uint32_t Overhead; // cost of an empty OS_Time pair
+
+// ping-pong with the partner thread
+static Sema4Type Ping;
+static Sema4Type Pong;
+
+//---------- partner threads -----------------
+// run BENCH_SAMPLES round trips with the test, then exit
+static void PartnerSema(void) {
+  for(int i = 0; i < BENCH_SAMPLES; i++) {
+    OS_Wait(&Ping);
+    OS_Signal(&Pong);
+  }
+  OS_Kill();
+}
+
+static void PartnerMailBox(void) {
+  for(int i = 0; i < BENCH_SAMPLES; i++) {
+    OS_MailBox_Recv();
+    OS_Signal(&Pong);
+  }
+  OS_Kill();
+}
+
+// add a partner at the caller's priority so every hand-off is a switch
+static int StartPartner(void(*task)(void)) {
+  OS_InitSemaphore(&Ping, 0);
+  OS_InitSemaphore(&Pong, 0);
+  return OS_AddThread(task, 128, OS_GetPriority(OS_Id()));
+}
+
+//---------- tests -----------------
+// each returns the number of samples taken, 0 to skip
+static uint32_t BenchEmpty(void) {
+  for(int i = 0; i < BENCH_SAMPLES; i++) {
+    uint32_t start = OS_Time();
+    Samples[i] = OS_TimeDifference(start, OS_Time());
+  }
+  return BENCH_SAMPLES;
+}
+
+static uint32_t BenchSignal(void) {
+  // no waiter, just the count
+  OS_InitSemaphore(&Ping, 0);
+  for(int i = 0; i < BENCH_SAMPLES; i++) {
+    uint32_t start = OS_Time();
+    OS_Signal(&Ping);
+    Samples[i] = OS_TimeDifference(start, OS_Time());
+  }
+  return BENCH_SAMPLES;
+}
+
+static uint32_t BenchWaitSwitch(void) {
+  // signal partner, block until it answers: two context switches
+  if(!StartPartner(&PartnerSema)) {
+    return 0;
+  }
+  for(int i = 0; i < BENCH_SAMPLES; i++) {
+    uint32_t start = OS_Time();
+    OS_Signal(&Ping);
+    OS_Wait(&Pong);
+    Samples[i] = OS_TimeDifference(start, OS_Time());
+  }
+  return BENCH_SAMPLES;
+}
+
+static uint32_t BenchSleep0(void) {
+  for(int i = 0; i < BENCH_SAMPLES; i++) {
+    uint32_t start = OS_Time();
+    OS_Sleep(0);
+    Samples[i] = OS_TimeDifference(start, OS_Time());
+  }
+  return BENCH_SAMPLES;
+}
+
+static uint32_t BenchFifo(void) {
+  // put then get, never blocks
+  OS_Fifo_Init(OSFIFOSIZE);
+  for(int i = 0; i < BENCH_SAMPLES; i++) {
+    uint32_t start = OS_Time();
+    OS_Fifo_Put(i);
+    OS_Fifo_Get();
+    Samples[i] = OS_TimeDifference(start, OS_Time());
+  }
+  return BENCH_SAMPLES;
+}
+
+static uint32_t BenchMailBox(void) {
+  // send to partner, wait for it to acknowledge
+  OS_MailBox_Init();
+  if(!StartPartner(&PartnerMailBox)) {
+    return 0;
+  }
+  for(int i = 0; i < BENCH_SAMPLES; i++) {
+    uint32_t start = OS_Time();
+    OS_MailBox_Send(i);
+    OS_Wait(&Pong);
+    Samples[i] = OS_TimeDifference(start, OS_Time());
+  }
+  return BENCH_SAMPLES;
+}
+
+static uint32_t BenchHeap(void) {
+  for(int i = 0; i < BENCH_SAMPLES; i++) {
+    uint32_t start = OS_Time();
+    void* block = Heap_Malloc(32);
+    Heap_Free(block);
+    Samples[i] = OS_TimeDifference(start, OS_Time());
+  }
+  return BENCH_SAMPLES;
+}
+
+#if CFG_EFILE
+static uint32_t BenchFileWrite(void) {
+  // needs a mounted file system, the file is removed again
+  if(eFile_Create("bench") || eFile_WOpen("bench")) {
+    return 0;
+  }
+  for(int i = 0; i < BENCH_SAMPLES; i++) {
+    uint32_t start = OS_Time();
+    eFile_Write('b');
+    Samples[i] = OS_TimeDifference(start, OS_Time());
+  }
+  eFile_WClose();
+  eFile_Delete("bench");
+  return BENCH_SAMPLES;
+}
+#endif
+
+static const struct {
+  const char *name;
+  uint32_t (*run)(void);
+} BenchTable[] = {
+  {"empty", BenchEmpty},
+  {"signal", BenchSignal},
+  {"wait_switch", BenchWaitSwitch},
+  {"sleep0", BenchSleep0},
+  {"fifo", BenchFifo},
+  {"mailbox", BenchMailBox},
+  {"heap", BenchHeap},
+#if CFG_EFILE
+  {"file_write", BenchFileWrite},
+#endif
+};
+#define BENCH_TESTS (sizeof(BenchTable)/sizeof(BenchTable[0]))
+
+//---------- Bench_Count-----------------
+// Number of tests Bench_RunOne knows about
+// Input: none
+// Output: number of tests
+uint32_t Bench_Count(void){
+  return BENCH_TESTS;
+}
+
+//---------- Bench_RunOne-----------------
+// Run one test, called from a foreground thread
+// Input: index of the test, place to return the statistics
+// Output: 0 if the test ran, 1 if invalid or skipped
+int Bench_RunOne(uint32_t test, bench_result_t *result){
+  if(test >= BENCH_TESTS) {
+    return 1;
+  }
+  result->name = BenchTable[test].name;
+  result->count = BenchTable[test].run();
+  if(result->count == 0) {
+    return 1;
+  }
+  
+  // sort, then take the timing overhead off every sample
+  uint32_t n = result->count;
+  uint64_t sum = 0;
+  for(uint32_t i = 1; i < n; i++) {
+    uint32_t value = Samples[i];
+    uint32_t j = i;
+    while(j > 0 && Samples[j-1] > value) {
+      Samples[j] = Samples[j-1];
+      j--;
+    }
+    Samples[j] = value;
+  }
+  for(uint32_t i = 0; i < n; i++) {
+    Samples[i] = (Samples[i] > Overhead) ? Samples[i] - Overhead : 0;
+    sum += Samples[i];
+  }
+  result->min = Samples[0];
+  result->mean = sum/n;
+  result->p99 = Samples[(99*n + 99)/100 - 1]; // nearest rank, ceil(0.99n)
+  result->max = Samples[n-1];
+  return 0;
+}
+
+//---------- Bench_Run-----------------
+// Run every test and print a table on the UART
+// Input: none
+// Output: none
+void Bench_Run(void){
+  bench_result_t result;
+  // test 0 measures the timing overhead itself
+  Overhead = 0;
+  Bench_RunOne(0, &result);
+  Overhead = result.min;
+  
+  UART_OutString("test min mean p99 max (cycles)");
+  CMD_NEXT_LINE();
+  for(uint32_t i = 1; i < BENCH_TESTS; i++) {
+    UART_OutString((char*) BenchTable[i].name);
+    if(Bench_RunOne(i, &result)) {
+      UART_OutString(" skipped");
+    }
+    else {
+      UART_OutChar(' ');
+      UART_OutUDec(result.min);
+      UART_OutChar(' ');
+      UART_OutUDec(result.mean);
+      UART_OutChar(' ');
+      UART_OutUDec(result.p99);
+      UART_OutChar(' ');
+      UART_OutUDec(result.max);
+    }
+    CMD_NEXT_LINE();
+  }
+}
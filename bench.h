@@ -0,0 +1,62 @@
+/**
+ * @file      bench.h
+ * @brief     Kernel primitive micro-benchmarks
+ * @details   Runs each OS primitive in a tight loop, timing every iteration
+ * with OS_Time, and reports min/mean/p99/max in 12.5ns bus cycles with the
+ * cost of the timing itself taken out.<br>
+ * Run it on an otherwise idle system. The OS FIFO and the mailbox are
+ * reinitialized by their tests, and the ping-pong tests add a partner
+ * thread at the caller's priority.
+ * @version   V1.0
+ * @date      Oct 19, 2026
+ ******************************************************************************/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+#ifndef BENCH_SAMPLES
+#define BENCH_SAMPLES 1000 // iterations timed per test, p99 needs >= 1000
+#endif
+
+// struct for holding the result of one test, times in 12.5ns units
+typedef struct bench_result {
+  const char *name; // test name
+  uint32_t count;   // samples taken, 0 if the test was skipped
+  uint32_t min;
+  uint32_t mean;
+  uint32_t p99;
+  uint32_t max;
+} bench_result_t;
+
+
+/**
+ * @details Number of tests Bench_RunOne knows about
+ * @param  none
+ * @return number of tests
+ * @brief  Number of benchmarks
+ */
+uint32_t Bench_Count(void);
+
+
+/**
+ * @details Run one test, called from a foreground thread
+ * @param  test: index of the test, 0 to Bench_Count()-1
+ * @param  result: reference to a bench_result_t that returns the statistics
+ * @return 0 if the test ran, 1 if the index is invalid or the test was skipped
+ *         (e.g., file system not mounted)
+ * @brief  Run one benchmark
+ */
+int Bench_RunOne(uint32_t test, bench_result_t *result);
+
+
+/**
+ * @details Run every test and print a table on the UART
+ * @param  none
+ * @return none
+ * @brief  Run all benchmarks
+ */
+void Bench_Run(void);
+
+#endif //#ifndef BENCH_H
@@ -44,6 +44,8 @@
 #include "../inc/debug.h"
 #include "../inc/interrupt.h"
 #include "../RTOS_Labs_common/can0.h"
+#include "../RTOS_Labs_common/OSConfig.h"
+#if CFG_CAN
 
 // reverse these IDs on the other microcontroller
 
@@ -162,3 +164,4 @@ void CAN0_GetMail(uint8_t data[4]){
   MailFlag = false;
 }
 
+#endif //#if CFG_CAN
@@ -53,6 +53,8 @@
 #include <stdint.h>
 #include "../inc/tm4c123gh6pm.h"
 #include "../RTOS_Labs_common/eDisk.h"
+#include "../RTOS_Labs_common/OSConfig.h"
+#if CFG_EFILE
 
 // these defines are in two places, here and in ST7735.c
 #define SDC_CS_PB0 1
@@ -719,3 +721,4 @@ void disk_timerproc(void){
   Stat = s;
 }
 
+#endif //#if CFG_EFILE
@@ -9,6 +9,7 @@
 #include "../RTOS_Labs_common/eFile.h"
 #include <stdio.h>
 #include <string.h>
+#if CFG_EFILE
 
 // FAT file system - need 2048 blocks to support 1 mebibyte (2048*512 = 1048576)
 /*
@@ -24,14 +25,16 @@ uint8_t openFileblock[512]; // just file data (most likely will be just last blo
 uint16_t byte_position; // current byte position (for reading/writing) - 0 to 511
 uint16_t file_position; // current position in directory
 uint16_t file_block; // block location open
+uint16_t write_position; // bytes in the last block of the file open for writing,
+                         // copied to the directory when the block fills or on close
 
-// directory size is file (file name size + 2 + 2) x 10 + 1 + 1 + 2 = ((7 + 2 + 2) x 10) + 1 + 1 + 2 = 114
+// directory size is file (file name size + 2 + 2) x MAXFILES + 1 + 1 + 2 = ((7 + 2 + 2) x 10) + 1 + 1 + 2 = 114 for 10 files
 /*
   directory byte order will be:
     bitmask for files (2 byte)
     first empty block (2 bytes) (9 at start)
     file_name (7 bytes)       *
-    start_block (2 bytes)     * Repeated 10 times
+    start_block (2 bytes)     * Repeated MAXFILES times
     byte_count (2 bytes)      *
 */
 /*
@@ -42,8 +45,10 @@ struct DIR {
 typedef struct DIR DIR_t;
 */
 uint8_t openDIRblock[512]; // holds directory (pre-assign block 8)
-int8_t dir_position;
-uint8_t dir_state; // 0 - closed, 1 - open
+// directory listing cursor of each thread (OS_Id, NUMTHREADS before the
+// first thread), so listings run side by side under the shared lock
+int8_t dir_position[NUMTHREADS + 1];
+uint8_t dir_state[NUMTHREADS + 1]; // 0 - closed, 1 - open
 
 // index table size is 512 bytes/2 (need 16 bits) x 8 = 256 (num of locations) x 8 = 2048 (need to represent 2048 blocks so need 8 blocks to support index table)
 uint8_t openFATblock[512]; // pre-assign blocks 0-7 for index table
@@ -51,6 +56,9 @@ uint8_t partition;
 
 uint8_t mount_state; // 0 - not yet mounted, 1 - mounted
 Sema4Type sdc;
+// guards openDIRblock and mount_state, lock order is dirLock then sdc
+// writers hold both, so holding sdc alone also sees a stable directory
+RWLockType dirLock;
 
 //---------- open_partition-------------
 //Open corresponding partition if not opened yet
@@ -81,6 +89,20 @@ uint8_t compare(char buf1[], const char buf2[]) {
   return 1;
 }
 
+// find a file in the directory, caller holds dirLock or sdc
+// returns directory index, MAXFILES if not found
+int find_file(const char name[]) {
+  uint16_t bitmask = (openDIRblock[0] << 8) + openDIRblock[1];
+  int i;
+  for(i = 0; i < MAXFILES; i++) {
+    if((bitmask & 0x0001) && compare((char *)&openDIRblock[4 + i*11], name)) {
+      break;
+    }
+    bitmask = bitmask >> 1;
+  }
+  return i;
+}
+
 //---------- eFile_Init-----------------
 // Activate the file system, without formating
 // Input: none
@@ -90,6 +112,8 @@ int eFile_Init(void){ // initialize file system
   DSTATUS result = eDisk_Init(0);
   if(result == RES_OK) {
     OS_InitSemaphore(&sdc, 1);
+    OS_NameSemaphore(&sdc, "sdc");
+    OS_InitRWLock(&dirLock, RWLOCK_WRITERPREF);
     return 0;
   }
   return 1;   // replace
@@ -100,6 +124,7 @@ int eFile_Init(void){ // initialize file system
 // Input: none
 // Output: 0 if successful and 1 on failure (e.g., trouble writing to flash)
 int eFile_Format(void){ // erase disk, add format
+  OS_WriteLock(&dirLock);
   long sr = OS_LockScheduler();
   OS_Wait(&sdc);
   // create new directory in RAM
@@ -108,6 +133,7 @@ int eFile_Format(void){ // erase disk, add format
   if(eDisk_WriteBlock(openDIRblock, 8) != RES_OK) {
     OS_Signal(&sdc);
     OS_UnLockScheduler(sr);
+    OS_WriteUnlock(&dirLock);
     return 1;
   }
   
@@ -152,6 +178,7 @@ int eFile_Format(void){ // erase disk, add format
   if(eDisk_WriteBlock(openFATblock, 0) != RES_OK) {
     OS_Signal(&sdc);
     OS_UnLockScheduler(sr);
+    OS_WriteUnlock(&dirLock);
     return 1;
   }
   
@@ -167,6 +194,7 @@ int eFile_Format(void){ // erase disk, add format
     if(eDisk_WriteBlock(openFATblock, i) != RES_OK) {
       OS_Signal(&sdc);
       OS_UnLockScheduler(sr);
+      OS_WriteUnlock(&dirLock);
       return 1;
     }
     
@@ -174,11 +202,12 @@ int eFile_Format(void){ // erase disk, add format
   }
   
   mount_state = 1;
-  dir_position = -1;
+  memset(dir_state, 0, sizeof(dir_state));
   file_position = 0;
   file_state = 0;
   OS_Signal(&sdc);
   OS_UnLockScheduler(sr);
+  OS_WriteUnlock(&dirLock);
   return 0;   // replace
 }
 
@@ -187,17 +216,19 @@ int eFile_Format(void){ // erase disk, add format
 // Input: none
 // Output: 0 if successful and 1 on failure
 int eFile_Mount(void){ // initialize file system
+  OS_WriteLock(&dirLock);
   OS_Wait(&sdc);
   // bring in a directory from disk
   
   eDisk_ReadBlock(openDIRblock, 8);
   eDisk_ReadBlock(openFATblock, 0);
   partition = 0;
-  dir_position = -1;
+  memset(dir_state, 0, sizeof(dir_state));
   file_position = 0;
   mount_state = 1;
   file_state = 0;
   OS_Signal(&sdc);
+  OS_WriteUnlock(&dirLock);
   return 0;   // replace
 }
 
@@ -207,15 +238,17 @@ int eFile_Mount(void){ // initialize file system
 // Input: file name is an ASCII string up to seven characters 
 // Output: 0 if successful and 1 on failure (e.g., trouble writing to flash)
 int eFile_Create( const char name[]){  // create new file, make it empty 
+  OS_WriteLock(&dirLock);
   OS_Wait(&sdc);
   if(mount_state == 0) {
     OS_Signal(&sdc);
+    OS_WriteUnlock(&dirLock);
     return 1;
   }
   // find if available space
   uint16_t bitmask = (openDIRblock[0] << 8) + openDIRblock[1];
   uint16_t i;
-  for(i = 0; i < 10; i++) {
+  for(i = 0; i < MAXFILES; i++) {
     if((bitmask & 0x0001) == 0) {
       // claim this location
       break;
@@ -223,8 +256,9 @@ int eFile_Create( const char name[]){  // create new file, make it empty
     bitmask = bitmask >> 1;
   }
   
-  if(i == 10) { //all spaces full
+  if(i == MAXFILES) { //all spaces full
     OS_Signal(&sdc);
+    OS_WriteUnlock(&dirLock);
     return 1;
   }
   
@@ -234,6 +268,7 @@ int eFile_Create( const char name[]){  // create new file, make it empty
   uint16_t temp = location;
   if(open_partition(&location) != RES_OK) {
     OS_Signal(&sdc);
+    OS_WriteUnlock(&dirLock);
     return 1;
   }
   openDIRblock[2] = openFATblock[2*location];
@@ -263,6 +298,7 @@ int eFile_Create( const char name[]){  // create new file, make it empty
   openDIRblock[0] = bitmask >> 8;
   openDIRblock[1] = bitmask & 0x00FF;
   OS_Signal(&sdc);
+  OS_WriteUnlock(&dirLock);
   return 0;
 }
 
@@ -280,7 +316,7 @@ int eFile_WOpen( const char name[]){      // open a file for writing
   // find this file in directory
   uint16_t bitmask = (openDIRblock[0] << 8) + openDIRblock[1];
   int i;
-  for(i = 0; i < 10; i++) {
+  for(i = 0; i < MAXFILES; i++) {
     if(bitmask & 0x0001) {
       char buffer[7];
       buffer[0] = openDIRblock[4 + i*11];
@@ -312,12 +348,13 @@ int eFile_WOpen( const char name[]){      // open a file for writing
         }
         file_block = partition*256 + location;
         file_position = i;
+        write_position = (openDIRblock[13 + i*11] << 8) + openDIRblock[14 + i*11];
         break;
       }
     }
     bitmask = bitmask >> 1;
   }
-  if(i == 10) {
+  if(i == MAXFILES) {
     OS_Signal(&sdc);
     return 1;
   }
@@ -331,26 +368,39 @@ int eFile_WOpen( const char name[]){      // open a file for writing
 // Input: data to be saved
 // Output: 0 if successful and 1 on failure (e.g., trouble writing to flash)
 int eFile_Write( const char data){
-  OS_Wait(&sdc);
-  if(file_state != 1 || mount_state == 0) {
+  // only the byte that fills a block changes the directory and FAT,
+  // the others just need sdc for the file block
+  int locked = 0;
+  while(1) {
+    OS_Wait(&sdc);
+    if(file_state != 1 || mount_state == 0) {
+      OS_Signal(&sdc);
+      if(locked) {
+        OS_WriteUnlock(&dirLock);
+      }
+      return 1;
+    }
+    if(write_position < 511 || locked) {
+      break;
+    }
+    // lock order is dirLock then sdc
     OS_Signal(&sdc);
-    return 1;
+    OS_WriteLock(&dirLock);
+    locked = 1;
   }
   
-  uint16_t write_position = (openDIRblock[13 + 11*file_position] << 8) + openDIRblock[14 + 11*file_position];
   openFileblock[write_position] = data;
   write_position++;
-  if(write_position == 512) {
-    write_position = 0;
-    openDIRblock[13 + 11*file_position] = write_position >> 8;
-    openDIRblock[14 + 11*file_position] = write_position & 0x00FF;
-  }
-  else {
-    openDIRblock[13 + 11*file_position] = write_position >> 8;
-    openDIRblock[14 + 11*file_position] = write_position & 0x00FF;
+  if(write_position < 512) {
     OS_Signal(&sdc);
+    if(locked) {
+      OS_WriteUnlock(&dirLock);
+    }
     return 0;
   }
+  write_position = 0;
+  openDIRblock[13 + 11*file_position] = 0;
+  openDIRblock[14 + 11*file_position] = 0;
   
   // update index table new block added, wrap end_byte_position 
   // store back file into location
@@ -364,6 +414,7 @@ int eFile_Write( const char data){
   openFATblock[2*file_block + 1] = openDIRblock[3];
   if(open_partition(&new_block_location)) {
     OS_Signal(&sdc);
+    OS_WriteUnlock(&dirLock);
     return 1;
   }
   //update free space manager
@@ -376,29 +427,40 @@ int eFile_Write( const char data){
   // read in new block
   if(eDisk_ReadBlock(openFileblock, 256*partition + new_block_location) != RES_OK) {
     OS_Signal(&sdc);
+    OS_WriteUnlock(&dirLock);
     return 1;
   }
   file_block = 256*partition + new_block_location;
   OS_Signal(&sdc);
+  OS_WriteUnlock(&dirLock);
   return 0;   // replace
 }
 
+// store the last block and its byte count, caller holds dirLock for
+// writing and sdc, and checked that a file is open for writing
+static void close_write(void) {
+  eDisk_WriteBlock(openFileblock, file_block);
+  openDIRblock[13 + 11*file_position] = write_position >> 8;
+  openDIRblock[14 + 11*file_position] = write_position & 0x00FF;
+  file_block = 0;
+  file_state = 0;
+}
+
 //---------- eFile_WClose-----------------
 // close the file, left disk in a state power can be removed
 // Input: none
 // Output: 0 if successful and 1 on failure (e.g., trouble writing to flash)
 int eFile_WClose(void){ // close the file for writing
+  OS_WriteLock(&dirLock);
   OS_Wait(&sdc);
   if(file_state != 1 || mount_state == 0) {
     OS_Signal(&sdc);
+    OS_WriteUnlock(&dirLock);
     return 1;
   }
-  
-  eDisk_WriteBlock(openFileblock, file_block);
-  file_block = 0;
-  file_state = 0;
-  // make sure position is at end
+  close_write();
   OS_Signal(&sdc);
+  OS_WriteUnlock(&dirLock);
   return 0;   // replace
 }
 
@@ -408,48 +470,39 @@ int eFile_WClose(void){ // close the file for writing
 // Input: file name is an ASCII string up to seven characters
 // Output: 0 if successful and 1 on failure (e.g., trouble read to flash)
 int eFile_ROpen( const char name[]){      // open a file for reading 
+  // directory lookup only needs the shared lock
+  OS_ReadLock(&dirLock);
+  if(mount_state == 0) {
+    OS_ReadUnlock(&dirLock);
+    return 1;
+  }
+  // find this file in directory
+  int i = find_file(name);
+  if(i == MAXFILES) {
+    OS_ReadUnlock(&dirLock);
+    return 1;
+  }
+  // find last block location
+  uint16_t location = (openDIRblock[11 + i*11] << 8) + openDIRblock[12 + i*11];
+  
   OS_Wait(&sdc);
-  if(file_state != 0 || mount_state == 0) {
+  if(file_state != 0) {
     OS_Signal(&sdc);
+    OS_ReadUnlock(&dirLock);
     return 1;
   }
-  // find this file in directory
-  uint16_t bitmask = (openDIRblock[0] << 8) + openDIRblock[1];
-  int i;
-  for(i = 0; i < 10; i++) {
-    if(bitmask & 0x0001) {
-      char buffer[7];
-      buffer[0] = openDIRblock[4 + i*11];
-      buffer[1] = openDIRblock[5 + i*11];
-      buffer[2] = openDIRblock[6 + i*11];
-      buffer[3] = openDIRblock[7 + i*11];
-      buffer[4] = openDIRblock[8 + i*11];
-      buffer[5] = openDIRblock[9 + i*11];
-      buffer[6] = openDIRblock[10 + i*11];
-      
-      if(compare(buffer, name)) { // found file
-        // find last block location
-        uint16_t location = (openDIRblock[11 + i*11] << 8) + openDIRblock[12 + i*11];
-        
-        // read into RAM
-        if(eDisk_ReadBlock(openFileblock, partition*256 + location) != RES_OK) {
-          OS_Signal(&sdc);
-          return 1;
-        }
-        file_block = partition*256 + location;
-        file_position = i;
-        byte_position = 0;
-        break;
-      }
-    }
-    bitmask = bitmask >> 1;
-  }  
-  if(i == 10) {
+  // read into RAM, start block is stored as an absolute block number
+  if(eDisk_ReadBlock(openFileblock, location) != RES_OK) {
     OS_Signal(&sdc);
+    OS_ReadUnlock(&dirLock);
     return 1;
   }
+  file_block = location;
+  file_position = i;
+  byte_position = 0;
   file_state = 2;
   OS_Signal(&sdc);
+  OS_ReadUnlock(&dirLock);
   return 0;   // replace   
 }
  
@@ -466,11 +519,12 @@ int eFile_ReadNext( char *pt){       // get next byte
   }
   // check if EOF
   uint16_t num_bytes = (openDIRblock[13 + 11*file_position] << 8) + openDIRblock[14 + 11*file_position];
-  if(open_partition(&file_block)) {
+  uint16_t index = file_block; // keep file_block absolute
+  if(open_partition(&index)) {
     OS_Signal(&sdc);
     return 1;
   }
-  uint16_t next_block = (openFATblock[2*file_block] << 8) + openFATblock[2*file_block + 1];
+  uint16_t next_block = (openFATblock[2*index] << 8) + openFATblock[2*index + 1];
   if(byte_position == num_bytes && next_block == 0) {
     OS_Signal(&sdc);
     return 1;
@@ -498,6 +552,100 @@ int eFile_ReadNext( char *pt){       // get next byte
   return 0;   // replace
 }
     
+//---------- eFile_Read-----------------
+// retreive many bytes from open file, a block at a time
+// Input: buffer, number of bytes wanted
+// Output: return by reference number of bytes read, less than count at end of file
+//         0 if successful and 1 on failure (e.g., trouble reading from flash)
+int eFile_Read(char buffer[], uint32_t count, uint32_t *actual){
+  *actual = 0;
+  OS_Wait(&sdc);
+  if(file_state != 2 || mount_state == 0) {
+    OS_Signal(&sdc);
+    return 1;
+  }
+  uint16_t num_bytes = (openDIRblock[13 + 11*file_position] << 8) + openDIRblock[14 + 11*file_position];
+  while(count > 0) {
+    uint16_t index = file_block;
+    if(open_partition(&index)) {
+      OS_Signal(&sdc);
+      return 1;
+    }
+    uint16_t next_block = (openFATblock[2*index] << 8) + openFATblock[2*index + 1];
+    // only the last block of the chain is partly filled
+    uint16_t end = (next_block == 0) ? num_bytes : 512;
+    if(byte_position >= end) {
+      break; // EOF
+    }
+    uint32_t chunk = end - byte_position;
+    if(chunk > count) {
+      chunk = count;
+    }
+    memcpy(&buffer[*actual], &openFileblock[byte_position], chunk);
+    *actual += chunk;
+    count -= chunk;
+    byte_position += chunk;
+    
+    if(byte_position == 512) {
+      // open next block
+      if(eDisk_ReadBlock(openFileblock, next_block) != RES_OK) {
+        OS_Signal(&sdc);
+        return 1;
+      }
+      file_block = next_block;
+      byte_position = 0;
+    }
+  }
+  OS_Signal(&sdc);
+  return 0;
+}
+
+//---------- eFile_Seek-----------------
+// move the read position of the open file
+// Input: byte offset from the start of the file
+// Output: 0 if successful and 1 on failure (e.g., past end of file)
+int eFile_Seek(uint32_t position){
+  OS_Wait(&sdc);
+  if(file_state != 2 || mount_state == 0) {
+    OS_Signal(&sdc);
+    return 1;
+  }
+  uint16_t num_bytes = (openDIRblock[13 + 11*file_position] << 8) + openDIRblock[14 + 11*file_position];
+  uint16_t block = (openDIRblock[11 + 11*file_position] << 8) + openDIRblock[12 + 11*file_position];
+  // follow the chain one link per full block
+  while(1) {
+    uint16_t index = block;
+    if(open_partition(&index)) {
+      OS_Signal(&sdc);
+      return 1;
+    }
+    uint16_t next_block = (openFATblock[2*index] << 8) + openFATblock[2*index + 1];
+    if(next_block == 0) {
+      if(position > num_bytes) { // past end of file
+        OS_Signal(&sdc);
+        return 1;
+      }
+      break;
+    }
+    if(position < 512) {
+      break;
+    }
+    position -= 512;
+    block = next_block;
+  }
+  
+  if(block != file_block) {
+    if(eDisk_ReadBlock(openFileblock, block) != RES_OK) {
+      OS_Signal(&sdc);
+      return 1;
+    }
+    file_block = block;
+  }
+  byte_position = position;
+  OS_Signal(&sdc);
+  return 0;
+}
+    
 //---------- eFile_RClose-----------------
 // close the reading file
 // Input: none
@@ -522,11 +670,10 @@ int eFile_RClose(void){ // close the file for writing
 // Input: file name is seven ASCII letters
 // Output: 0 if successful and 1 on failure (e.g., trouble writing to flash)
 int eFile_Delete( const char name[]){  // remove this file 
+  OS_WriteLock(&dirLock);
   OS_Wait(&sdc);
   if(file_state == 1) {
-    OS_Signal(&sdc);
-    eFile_WClose();
-    OS_Wait(&sdc);
+    close_write();
   }
   else if(file_state == 2) {
     OS_Signal(&sdc);
@@ -535,13 +682,14 @@ int eFile_Delete( const char name[]){  // remove this file
   }
   else if (mount_state == 0) {
     OS_Signal(&sdc);
+    OS_WriteUnlock(&dirLock);
     return 1;
   }
   
   // find this file in directory
   uint16_t bitmask = (openDIRblock[0] << 8) + openDIRblock[1];
   int i;
-  for(i = 0; i < 10; i++) {
+  for(i = 0; i < MAXFILES; i++) {
     if(bitmask & 0x0001) {
       char buffer[7];
       buffer[0] = openDIRblock[4 + i*11];
@@ -559,6 +707,7 @@ int eFile_Delete( const char name[]){  // remove this file
           location = next_location;
           if(open_partition(&location) != RES_OK) {
             OS_Signal(&sdc);
+            OS_WriteUnlock(&dirLock);
             return 1;
           }
           // get next block
@@ -580,11 +729,13 @@ int eFile_Delete( const char name[]){  // remove this file
     }
     bitmask = bitmask >> 1;
   }  
-  if(i == 10) {
+  if(i == MAXFILES) {
     OS_Signal(&sdc);
+    OS_WriteUnlock(&dirLock);
     return 1;
   }
   OS_Signal(&sdc);
+  OS_WriteUnlock(&dirLock);
   return 0;   // replace
 }                             
 
@@ -595,13 +746,14 @@ int eFile_Delete( const char name[]){  // remove this file
 //        (empty/NULL for root directory)
 // Output: 0 if successful and 1 on failure (e.g., trouble reading from flash)
 int eFile_DOpen( const char name[]){ // open directory
+  uint32_t id = OS_Id();
   OS_Wait(&sdc);
   if(mount_state == 0) {
     OS_Signal(&sdc);
     return 1;
   }
-  dir_state = 1;
-  dir_position = -1;
+  dir_state[id] = 1;
+  dir_position[id] = -1;
   OS_Signal(&sdc);
   return 0;   // replace
 }
@@ -609,57 +761,60 @@ int eFile_DOpen( const char name[]){ // open directory
 //---------- eFile_DirNext-----------------
 // Retreive directory entry from open directory
 // Input: none
-// Output: return file name and size by reference
+// Output: return file name (8 bytes with the terminator) and size by reference
 //         0 if successful and 1 on failure (e.g., end of directory)
 int eFile_DirNext( char name[], unsigned long *size){  // get next entry 
-  OS_Wait(&sdc);
+  // directory is only read, share it with other lookups,
+  // the cursor belongs to the calling thread
+  uint32_t id = OS_Id();
+  OS_ReadLock(&dirLock);
   // get name
-  if(mount_state == 0 || dir_state == 0) {
-    OS_Signal(&sdc);
+  if(mount_state == 0 || dir_state[id] == 0) {
+    OS_ReadUnlock(&dirLock);
     return 1;
   }
   
   //get next position
-  dir_position++;
-  if(dir_position == 10) {
-    dir_position = -1;
-    OS_Signal(&sdc);
-    return 1;
-  }
+  int8_t position = dir_position[id] + 1;
   uint16_t bitmask = (openDIRblock[0] << 8) + openDIRblock[1];
-  while((bitmask & (1 << dir_position)) == 0) {
-    dir_position++;
-    if(dir_position == 10) {
-      dir_position = -1;
-      OS_Signal(&sdc);
-      return 1;
-    }
+  while(position < MAXFILES && (bitmask & (1 << position)) == 0) {
+    position++;
   }
-  name[0] = openDIRblock[4 + 11*dir_position];
-  name[1] = openDIRblock[5 + 11*dir_position];
-  name[2] = openDIRblock[6 + 11*dir_position];
-  name[3] = openDIRblock[7 + 11*dir_position];
-  name[4] = openDIRblock[8 + 11*dir_position];
-  name[5] = openDIRblock[9 + 11*dir_position];
-  name[6] = openDIRblock[10 + 11*dir_position];
+  if(position == MAXFILES) {
+    dir_position[id] = -1;
+    OS_ReadUnlock(&dirLock);
+    return 1;
+  }
+  dir_position[id] = position;
+  name[0] = openDIRblock[4 + 11*position];
+  name[1] = openDIRblock[5 + 11*position];
+  name[2] = openDIRblock[6 + 11*position];
+  name[3] = openDIRblock[7 + 11*position];
+  name[4] = openDIRblock[8 + 11*position];
+  name[5] = openDIRblock[9 + 11*position];
+  name[6] = openDIRblock[10 + 11*position];
+  name[7] = 0;
   
-  // get size
+  // get size, walking the chain swaps the FAT cache so it needs sdc
   uint16_t i = 0;
   uint16_t location = 0;
-  uint16_t next_location = (openDIRblock[11 + dir_position*11] << 8) + openDIRblock[12 + dir_position*11];
+  uint16_t next_location = (openDIRblock[11 + position*11] << 8) + openDIRblock[12 + position*11];
+  OS_Wait(&sdc);
   do {
     i++;
     location = next_location;
     if(open_partition(&location) != RES_OK) {
       OS_Signal(&sdc);
+      OS_ReadUnlock(&dirLock);
       return 1;
     }
     // get next block
     next_location = (openFATblock[2*location] << 8) + openFATblock[2*location + 1];
   } while(next_location != 0);
-  
-  *size = (i-1)*512 + (openDIRblock[13 + dir_position*11] << 8) + openDIRblock[14 + dir_position*11];
   OS_Signal(&sdc);
+  
+  *size = (i-1)*512 + (openDIRblock[13 + position*11] << 8) + openDIRblock[14 + position*11];
+  OS_ReadUnlock(&dirLock);
   return 0;   // replace
 }
 
@@ -668,13 +823,14 @@ int eFile_DirNext( char name[], unsigned long *size){  // get next entry
 // Input: none
 // Output: 0 if successful and 1 on failure (e.g., wasn't open)
 int eFile_DClose(void){ // close the directory
+  uint32_t id = OS_Id();
   OS_Wait(&sdc);
   if(eDisk_WriteBlock(openDIRblock, 8) != RES_OK || mount_state == 0) {
     OS_Signal(&sdc);
     return 1;
   }
-  dir_position = -1;
-  dir_state = 0;
+  dir_position[id] = -1;
+  dir_state[id] = 0;
   OS_Signal(&sdc);
   return 0;   // replace
 }
@@ -685,11 +841,16 @@ int eFile_DClose(void){ // close the directory
 // Input: none
 // Output: 0 if successful and 1 on failure (not currently mounted)
 int eFile_Unmount(void){ 
+  OS_WriteLock(&dirLock);
   OS_Wait(&sdc);
   if(mount_state == 0) {
     OS_Signal(&sdc);
+    OS_WriteUnlock(&dirLock);
     return 1;
   }
+  if(file_state == 1) {
+    close_write();
+  }
   eDisk_WriteBlock(openDIRblock, 8);
   eDisk_WriteBlock(openFATblock, partition);
   if(file_block != 0){
@@ -697,5 +858,8 @@ int eFile_Unmount(void){
   }  
   mount_state = 0;
   OS_Signal(&sdc);
+  OS_WriteUnlock(&dirLock);
   return 0;   // replace
 }
+
+#endif //#if CFG_EFILE
@@ -83,6 +83,26 @@ int eFile_ROpen(const char name[]);      // open a file for reading
  * @brief  Retreive data from open file
  */
 int eFile_ReadNext(char *pt);       // get next byte 
+
+/**
+ * @details Read up to count bytes from the open file, copying a block at a time.
+ *          Fewer bytes than requested are returned at end of file
+ * @param  buffer place to save the data
+ * @param  count number of bytes wanted
+ * @param  actual call by reference number of bytes actually read, 0 at end of file
+ * @return 0 if successful and 1 on failure (e.g., trouble reading from flash)
+ * @brief  Retreive many bytes from open file
+ */
+int eFile_Read(char buffer[], uint32_t count, uint32_t *actual);
+
+/**
+ * @details Move the read position of the open file, the next eFile_Read
+ *          or eFile_ReadNext starts at this byte
+ * @param  position byte offset from the start of the file
+ * @return 0 if successful and 1 on failure (e.g., past end of file)
+ * @brief  Set read position
+ */
+int eFile_Seek(uint32_t position);
                               
 /**
  * @details Close the file, leave disk in a state power can be removed.
@@ -110,10 +130,11 @@ int eFile_DOpen(const char name[]);
 	
 /**
  * @details Retreive directory entry from open directory
- * @param pointers to return file name and size by reference
+ * @param name buffer of at least 8 characters for the file name
+ * @param size returns the file size by reference
  * @return 0 if successful and 1 on failure (e.g., end of directory)
  */
-int eFile_DirNext(char* name[], unsigned long *size);
+int eFile_DirNext(char name[], unsigned long *size);
 
 /**
  * @details Close the directory
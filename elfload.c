@@ -0,0 +1,459 @@
+// filename ************** elfload.c *************************
+// Streaming ELF loader, see elfload.h
+// Reads go through elf_read, which only seeks when the next read does
+// not continue where the last one ended, so the sections the loader
+// walks in file order cost one eFile_Read each, a block per disk access.
+#include <stdint.h>
+#include <string.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/eFile.h"
+#include "../RTOS_Labs_common/heap.h"
+#include "../RTOS_Labs_common/elfload.h"
+
+#if CFG_EFILE
+
+// ELF32 file structures, all little endian
+typedef struct {
+  uint8_t ident[16];
+  uint16_t type;
+  uint16_t machine;
+  uint32_t version;
+  uint32_t entry;
+  uint32_t phoff;
+  uint32_t shoff;
+  uint32_t flags;
+  uint16_t ehsize;
+  uint16_t phentsize;
+  uint16_t phnum;
+  uint16_t shentsize;
+  uint16_t shnum;
+  uint16_t shstrndx;
+} elf_header_t;
+
+typedef struct {
+  uint32_t name;
+  uint32_t type;
+  uint32_t flags;
+  uint32_t addr;
+  uint32_t offset;
+  uint32_t size;
+  uint32_t link;
+  uint32_t info;
+  uint32_t addralign;
+  uint32_t entsize;
+} elf_section_t;
+
+typedef struct {
+  uint32_t name;
+  uint32_t value;
+  uint32_t size;
+  uint8_t info;
+  uint8_t other;
+  uint16_t shndx;
+} elf_symbol_t;
+
+typedef struct {
+  uint32_t offset;
+  uint32_t info;
+} elf_rel_t;
+
+#define ET_REL          1
+#define EM_ARM          40
+#define SHT_PROGBITS    1
+#define SHT_SYMTAB      2
+#define SHT_RELA        4
+#define SHT_NOBITS      8
+#define SHT_REL         9
+#define SHF_WRITE       0x1
+#define SHF_ALLOC       0x2
+#define SHF_EXECINSTR   0x4
+#define SHN_UNDEF       0
+#define SHN_LORESERVE   0xFF00
+#define SHN_ABS         0xFFF1
+
+#define R_ARM_NONE             0
+#define R_ARM_ABS32            2
+#define R_ARM_REL32            3
+#define R_ARM_THM_CALL         10
+#define R_ARM_THM_JUMP24       30
+#define R_ARM_TARGET1          38
+#define R_ARM_V4BX             40
+#define R_ARM_THM_MOVW_ABS_NC  47
+#define R_ARM_THM_MOVT_ABS     48
+
+#define ELF_CHUNK 512   // symbols and relocations are read a block at a time
+#define ELF_ALIGN 8     // largest section alignment the heap blocks give
+
+static uint32_t Position;  // file offset the next eFile_Read starts at
+
+// read bytes at offset, seek only when not continuing the last read
+static int elf_read(uint32_t offset, void *buffer, uint32_t bytes) {
+  uint32_t actual;
+  if(offset != Position && eFile_Seek(offset)) {
+    return 1;
+  }
+  Position = offset;
+  if(eFile_Read((char*) buffer, bytes, &actual) || actual != bytes) {
+    Position = 0xFFFFFFFF;
+    return 1;
+  }
+  Position += bytes;
+  return 0;
+}
+
+//---------- instruction fields -----------------
+// sections have no more than byte alignment guaranteed for relocations
+static uint32_t get16(uint8_t *p) {
+  return p[0] | (p[1] << 8);
+}
+static void put16(uint8_t *p, uint32_t value) {
+  p[0] = value;
+  p[1] = value >> 8;
+}
+static uint32_t get32(uint8_t *p) {
+  return get16(p) | (get16(p + 2) << 16);
+}
+static void put32(uint8_t *p, uint32_t value) {
+  put16(p, value);
+  put16(p + 2, value >> 16);
+}
+
+// Thumb-2 BL and B.W: S:I1:I2:imm10:imm11:0, I = NOT(J XOR S)
+static int elf_branch(uint8_t *p, uint32_t target, uint32_t place) {
+  uint32_t upper = get16(p);
+  uint32_t lower = get16(p + 2);
+  uint32_t s = (upper >> 10) & 1;
+  uint32_t i1 = !(((lower >> 13) & 1) ^ s);
+  uint32_t i2 = !(((lower >> 11) & 1) ^ s);
+  int32_t offset = (s << 24) | (i1 << 23) | (i2 << 22) |
+                   ((upper & 0x3FF) << 12) | ((lower & 0x7FF) << 1);
+  if(s) {
+    offset -= 1 << 25;
+  }
+  offset += target - place;
+  if(offset < -(1 << 24) || offset >= (1 << 24)) {
+    return 1;
+  }
+  s = (offset >> 24) & 1;
+  upper = (upper & 0xF800) | (s << 10) | ((offset >> 12) & 0x3FF);
+  lower = (lower & 0xD000) | ((!((offset >> 23) & 1) ^ s) << 13) |
+          ((!((offset >> 22) & 1) ^ s) << 11) | ((offset >> 1) & 0x7FF);
+  put16(p, upper);
+  put16(p + 2, lower);
+  return 0;
+}
+
+// MOVW/MOVT: imm4:i:imm3:imm8
+static void elf_movw(uint8_t *p, uint32_t target, int top) {
+  uint32_t upper = get16(p);
+  uint32_t lower = get16(p + 2);
+  int32_t addend = (int16_t)(((upper & 0xF) << 12) | ((upper & 0x400) << 1) |
+                             ((lower & 0x7000) >> 4) | (lower & 0xFF));
+  uint32_t imm = target + addend;
+  if(top) {
+    imm >>= 16;
+  }
+  upper = (upper & 0xFBF0) | ((imm >> 12) & 0xF) | ((imm >> 1) & 0x400);
+  lower = (lower & 0x8F00) | ((imm << 4) & 0x7000) | (imm & 0xFF);
+  put16(p, upper);
+  put16(p + 2, lower);
+}
+
+static int elf_relocate(uint32_t type, uint32_t place, uint32_t target) {
+  uint8_t *p = (uint8_t*)(uintptr_t) place;
+  switch(type) {
+    case R_ARM_NONE:
+    case R_ARM_V4BX:
+      return 0;
+    case R_ARM_ABS32:
+    case R_ARM_TARGET1:
+      put32(p, get32(p) + target);
+      return 0;
+    case R_ARM_REL32:
+      put32(p, get32(p) + target - place);
+      return 0;
+    case R_ARM_THM_CALL:
+    case R_ARM_THM_JUMP24:
+      return elf_branch(p, target, place);
+    case R_ARM_THM_MOVW_ABS_NC:
+      elf_movw(p, target, 0);
+      return 0;
+    case R_ARM_THM_MOVT_ABS:
+      elf_movw(p, target, 1);
+      return 0;
+  }
+  return 1;
+}
+
+//---------- loader -----------------
+typedef struct {
+  elf_section_t *section;  // section headers
+  uint32_t *address;       // load address of each section, 0 if not loaded
+  uint32_t *value;         // resolved value of each symbol
+  char *names;             // string table of the symbols
+  uint8_t *chunk;          // ELF_CHUNK bytes of symbols or relocations
+  uint32_t sections;
+  uint32_t symtab;         // section index of the symbol table
+  uint32_t symbols;
+} loader_t;
+
+static int elf_text(elf_section_t *s) {
+  return (s->flags & SHF_EXECINSTR) || !(s->flags & SHF_WRITE);
+}
+
+// place the allocated sections, text and read-only data in one block,
+// data and bss in the other, then read them in
+static int elf_sections(loader_t *l, ELF_Image_t *image) {
+  uint32_t size[2] = {0, 0};
+  for(uint32_t i = 0; i < l->sections; i++) {
+    elf_section_t *s = &l->section[i];
+    if(!(s->flags & SHF_ALLOC) || s->size == 0) {
+      continue;
+    }
+    uint32_t align = s->addralign ? s->addralign : 1;
+    if(align > ELF_ALIGN || (align & (align - 1))) {
+      return ELF_ERR_FORMAT;
+    }
+    uint32_t *end = &size[!elf_text(s)];
+    *end = (*end + align - 1) & ~(align - 1);
+    l->address[i] = *end;
+    *end += s->size;
+  }
+  if(size[0] == 0) {
+    return ELF_ERR_FORMAT;
+  }
+  image->text = Heap_MallocAligned(size[0], ELF_ALIGN);
+  image->data = size[1] ? Heap_MallocAligned(size[1], ELF_ALIGN) : 0;
+  image->textBytes = size[0];
+  image->dataBytes = size[1];
+  if(image->text == 0 || (size[1] && image->data == 0)) {
+    return ELF_ERR_MEMORY;
+  }
+  for(uint32_t i = 0; i < l->sections; i++) {
+    elf_section_t *s = &l->section[i];
+    if(!(s->flags & SHF_ALLOC) || s->size == 0) {
+      continue;
+    }
+    uint8_t *base = elf_text(s) ? image->text : image->data;
+    l->address[i] += (uint32_t)(uintptr_t) base;
+    uint8_t *to = (uint8_t*)(uintptr_t) l->address[i];
+    if(s->type == SHT_NOBITS) {
+      memset(to, 0, s->size);
+    }
+    else if(s->type == SHT_PROGBITS) {
+      if(elf_read(s->offset, to, s->size)) {
+        return ELF_ERR_FILE;
+      }
+      image->fileBytes += s->size;
+    }
+  }
+  return ELF_OK;
+}
+
+static void *elf_lookup(const char *name, const ELF_Symbol_t symbols[], uint32_t count) {
+  for(uint32_t i = 0; i < count; i++) {
+    if(strcmp(symbols[i].name, name) == 0) {
+      return symbols[i].address;
+    }
+  }
+  return 0;
+}
+
+// resolve every symbol to an address, find the entry point
+static int elf_symbols(loader_t *l, const ELF_Symbol_t symbols[], uint32_t count, ELF_Image_t *image) {
+  elf_section_t *symtab = &l->section[l->symtab];
+  if(symtab->link >= l->sections) {
+    return ELF_ERR_FORMAT;
+  }
+  elf_section_t *strtab = &l->section[symtab->link];
+  l->symbols = symtab->size/sizeof(elf_symbol_t);
+  l->value = Heap_Malloc(4*l->symbols + 4);
+  l->names = Heap_Malloc(strtab->size + 1);
+  if(l->value == 0 || l->names == 0) {
+    return ELF_ERR_MEMORY;
+  }
+  if(elf_read(strtab->offset, l->names, strtab->size)) {
+    return ELF_ERR_FILE;
+  }
+  l->names[strtab->size] = 0;
+  image->fileBytes += strtab->size;
+
+  uint32_t perChunk = ELF_CHUNK/sizeof(elf_symbol_t);
+  for(uint32_t first = 0; first < l->symbols; first += perChunk) {
+    uint32_t n = l->symbols - first < perChunk ? l->symbols - first : perChunk;
+    if(elf_read(symtab->offset + first*sizeof(elf_symbol_t), l->chunk, n*sizeof(elf_symbol_t))) {
+      return ELF_ERR_FILE;
+    }
+    image->fileBytes += n*sizeof(elf_symbol_t);
+    elf_symbol_t *sym = (elf_symbol_t*) l->chunk;
+    for(uint32_t i = 0; i < n; i++, sym++) {
+      const char *name = sym->name < strtab->size ? &l->names[sym->name] : "";
+      uint32_t value;
+      if(sym->shndx == SHN_UNDEF) {
+        value = 0;
+        if(name[0] != 0) {
+          void *address = elf_lookup(name, symbols, count);
+          if(address == 0) {
+            return ELF_ERR_SYMBOL;
+          }
+          value = (uint32_t)(uintptr_t) address;
+        }
+      }
+      else if(sym->shndx == SHN_ABS) {
+        value = sym->value;
+      }
+      else if(sym->shndx < l->sections && sym->shndx < SHN_LORESERVE) {
+        value = l->address[sym->shndx] + sym->value;
+      }
+      else {
+        return ELF_ERR_FORMAT;   // e.g., common symbols
+      }
+      l->value[first + i] = value;
+      if(sym->shndx != SHN_UNDEF && strcmp(name, "main") == 0) {
+        image->entry = (void(*)(void))(uintptr_t) value;
+      }
+    }
+  }
+  return ELF_OK;
+}
+
+// one pass over every relocation section of a loaded section
+static int elf_relocations(loader_t *l, ELF_Image_t *image) {
+  for(uint32_t i = 0; i < l->sections; i++) {
+    elf_section_t *s = &l->section[i];
+    if(s->type == SHT_RELA) {
+      return ELF_ERR_RELOC;
+    }
+    if(s->type != SHT_REL || s->info >= l->sections || l->address[s->info] == 0) {
+      continue;
+    }
+    if(s->link != l->symtab) {
+      return ELF_ERR_FORMAT;
+    }
+    elf_section_t *target = &l->section[s->info];
+    uint32_t count = s->size/sizeof(elf_rel_t);
+    uint32_t perChunk = ELF_CHUNK/sizeof(elf_rel_t);
+    for(uint32_t first = 0; first < count; first += perChunk) {
+      uint32_t n = count - first < perChunk ? count - first : perChunk;
+      if(elf_read(s->offset + first*sizeof(elf_rel_t), l->chunk, n*sizeof(elf_rel_t))) {
+        return ELF_ERR_FILE;
+      }
+      image->fileBytes += n*sizeof(elf_rel_t);
+      elf_rel_t *rel = (elf_rel_t*) l->chunk;
+      for(uint32_t j = 0; j < n; j++, rel++) {
+        uint32_t symbol = rel->info >> 8;
+        if(symbol >= l->symbols || rel->offset + 4 > target->size) {
+          return ELF_ERR_FORMAT;
+        }
+        if(elf_relocate(rel->info & 0xFF, l->address[s->info] + rel->offset, l->value[symbol])) {
+          return ELF_ERR_RELOC;
+        }
+        image->relocations++;
+      }
+    }
+  }
+  return ELF_OK;
+}
+
+static int elf_load(const ELF_Symbol_t symbols[], uint32_t count, ELF_Image_t *image, loader_t *l) {
+  elf_header_t header;
+  Position = 0;
+  if(elf_read(0, &header, sizeof(header))) {
+    return ELF_ERR_FILE;
+  }
+  image->fileBytes = sizeof(header);
+  if(memcmp(header.ident, "\177ELF\1\1", 6) || header.type != ET_REL ||
+     header.machine != EM_ARM || header.shentsize != sizeof(elf_section_t) || header.shnum == 0) {
+    return ELF_ERR_FORMAT;
+  }
+  l->sections = header.shnum;
+  l->section = Heap_Malloc(l->sections*sizeof(elf_section_t));
+  l->address = Heap_Calloc(l->sections*sizeof(uint32_t));
+  l->chunk = Heap_Malloc(ELF_CHUNK);
+  if(l->section == 0 || l->address == 0 || l->chunk == 0) {
+    return ELF_ERR_MEMORY;
+  }
+  if(elf_read(header.shoff, l->section, l->sections*sizeof(elf_section_t))) {
+    return ELF_ERR_FILE;
+  }
+  image->fileBytes += l->sections*sizeof(elf_section_t);
+  l->symtab = l->sections;
+  for(uint32_t i = 0; i < l->sections; i++) {
+    if(l->section[i].type == SHT_SYMTAB) {
+      l->symtab = i;
+    }
+  }
+  if(l->symtab == l->sections) {
+    return ELF_ERR_FORMAT;
+  }
+
+  int error = elf_sections(l, image);
+  if(error == ELF_OK) {
+    error = elf_symbols(l, symbols, count, image);
+  }
+  if(error == ELF_OK) {
+    error = elf_relocations(l, image);
+  }
+  if(error == ELF_OK && image->entry == 0) {
+    // no main, e_entry is an offset into the first code section (Thumb)
+    for(uint32_t i = 0; i < l->sections; i++) {
+      if((l->section[i].flags & SHF_EXECINSTR) && l->address[i] != 0) {
+        image->entry = (void(*)(void))(uintptr_t)((l->address[i] + header.entry) | 1);
+        break;
+      }
+    }
+    if(image->entry == 0) {
+      error = ELF_ERR_ENTRY;
+    }
+  }
+  return error;
+}
+
+//---------- ELF_Load -----------------
+// Load a relocatable ELF object from eFile into the heap
+// Input: file name, exported symbols, image to fill in
+// Output: ELF_OK (0) or an ELF_ERR_ code
+int ELF_Load(const char *name, const ELF_Symbol_t symbols[], uint32_t count, ELF_Image_t *image){
+  loader_t l;
+  memset(&l, 0, sizeof(l));
+  memset(image, 0, sizeof(*image));
+  if(eFile_ROpen(name)) {
+    return ELF_ERR_FILE;
+  }
+  int error = elf_load(symbols, count, image, &l);
+  eFile_RClose();
+  Heap_Free(l.section);
+  Heap_Free(l.address);
+  Heap_Free(l.value);
+  Heap_Free(l.names);
+  Heap_Free(l.chunk);
+  if(error != ELF_OK) {
+    Heap_Free(image->text);
+    Heap_Free(image->data);
+    image->text = 0;
+    image->data = 0;
+  }
+  return error;
+}
+
+//---------- ELF_Exec -----------------
+// Load a relocatable ELF object and run it as a process
+// Input: file name, exported symbols, stack size and priority of the first thread,
+//        arena size in bytes (0 for none)
+// Output: ELF_OK (0) or an ELF_ERR_ code
+int ELF_Exec(const char *name, const ELF_Symbol_t symbols[], uint32_t count,
+             uint32_t stackSize, uint32_t priority, uint32_t arenaSize){
+  ELF_Image_t image;
+  int error = ELF_Load(name, symbols, count, &image);
+  if(error != ELF_OK) {
+    return error;
+  }
+  if(!OS_AddProcessArena(image.entry, image.text, image.data, stackSize, priority, arenaSize)) {
+    Heap_Free(image.text);
+    Heap_Free(image.data);
+    return ELF_ERR_MEMORY;
+  }
+  return ELF_OK;
+}
+
+#endif
@@ -0,0 +1,82 @@
+/**
+ * @file      elfload.h
+ * @brief     Streaming ELF loader for user programs on eFile
+ * @details   Loads a relocatable ARM ELF object (what exec_elf took) with
+ * block-sized eFile_Read calls. The allocated sections are read straight
+ * into one heap block for text and read-only data and one for data and
+ * bss, then every relocation section is applied in a single pass.
+ * Symbols the program leaves undefined are looked up in a table the
+ * caller exports. Only the section headers, the resolved symbol values,
+ * the symbol string table and one 512 byte buffer for streaming the
+ * symbols and relocations are kept while loading, in temporary heap
+ * blocks.<br>
+ * Supported relocations: R_ARM_ABS32, R_ARM_REL32, R_ARM_TARGET1,
+ * R_ARM_THM_CALL, R_ARM_THM_JUMP24, R_ARM_THM_MOVW_ABS_NC and
+ * R_ARM_THM_MOVT_ABS; R_ARM_NONE and R_ARM_V4BX are ignored.<br>
+ * The entry point is the symbol main if the object defines it, else
+ * e_entry bytes into the first executable section.
+ * @version   V1.0
+ * @date      Oct 19, 2026
+ ******************************************************************************/
+
+#ifndef ELFLOAD_H
+#define ELFLOAD_H
+
+#include <stdint.h>
+
+// symbol the kernel exports to loaded programs
+typedef struct {
+  const char *name;
+  void *address;
+} ELF_Symbol_t;
+
+// a loaded program, text and data are Heap_Malloc blocks
+typedef struct {
+  void (*entry)(void);
+  void *text;
+  void *data;
+  uint32_t textBytes;
+  uint32_t dataBytes;
+  uint32_t fileBytes;    // bytes read from the file
+  uint32_t relocations;  // relocations applied
+} ELF_Image_t;
+
+// ELF_Load errors
+#define ELF_OK         0
+#define ELF_ERR_FILE   1  // cannot open or read the file
+#define ELF_ERR_FORMAT 2  // not a 32 bit little endian ARM relocatable object
+#define ELF_ERR_MEMORY 3  // heap has no room
+#define ELF_ERR_SYMBOL 4  // undefined symbol not in the exported table
+#define ELF_ERR_RELOC  5  // relocation type not supported
+#define ELF_ERR_ENTRY  6  // no entry point
+
+/**
+ * @details Load a program from a file. The file is open for reading while
+ *          this runs, so no other file can be read at the same time
+ * @param  name file name
+ * @param  symbols table of exported symbols
+ * @param  count number of entries in symbols
+ * @param  image returns the loaded program, the caller owns text and data
+ * @return ELF_OK (0) or one of the ELF_ERR_ codes
+ * @brief  Load relocatable ELF file
+ */
+int ELF_Load(const char *name, const ELF_Symbol_t symbols[], uint32_t count, ELF_Image_t *image);
+
+/**
+ * @details Load a program and start it as a process with OS_AddProcessArena,
+ *          the process frees text, data and its arena when its last thread exits
+ * @param  name file name
+ * @param  symbols table of exported symbols
+ * @param  count number of entries in symbols
+ * @param  stackSize stack of the first thread in bytes
+ * @param  priority priority of the first thread
+ * @param  arenaSize bytes of kernel heap for the program's allocations,
+ *         0 for none (it then allocates from the kernel heap)
+ * @return ELF_OK (0), one of the ELF_ERR_ codes, or ELF_ERR_MEMORY if
+ *         the process could not be added
+ * @brief  Load and run relocatable ELF file
+ */
+int ELF_Exec(const char *name, const ELF_Symbol_t symbols[], uint32_t count,
+             uint32_t stackSize, uint32_t priority, uint32_t arenaSize);
+
+#endif
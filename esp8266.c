@@ -57,6 +57,7 @@
 #include "../RTOS_Labs_common/esp8266.h"
 #include "../RTOS_Labs_common/WifiSettings.h"  // access point parameters
 #include "../RTOS_Labs_common/OS.h"
+#if CFG_ESP8266
 
 /*
 ===========================================================
@@ -72,7 +73,7 @@
 
 // #define USE_UART_DRV  // Use external UART driver (only works with UART1)
 
-#define FIFOSIZE    1024      // size of the FIFOs (must be power of 2)
+#define FIFOSIZE    ESP8266_FIFOSIZE // size of the FIFOs (power of 2, OSConfig.h)
 #define FIFOSUCCESS 1         // return value on success
 #define FIFOFAIL    0         // return value on failure
 
@@ -347,7 +348,9 @@ void ESP8266_InitUART(int rx_echo, int tx_echo){ volatile int delay;
   UART_ESP8266(_CTL_R) |= (UART_CTL_UARTEN|UART_CTL_RXE|UART_CTL_TXE); // Set UART enable bit 
     
   OS_InitSemaphore(&ESPRxDataAvailable, 0);
+  OS_NameSemaphore(&ESPRxDataAvailable, "ESPRxDataAvailable");
   OS_InitSemaphore(&ESPTxRoomLeft, FIFOSIZE);
+  OS_NameSemaphore(&ESPTxRoomLeft, "ESPTxRoomLeft");
 }
 
 //--------ESP8266_EnableInterrupt--------
@@ -981,3 +984,5 @@ int ESP8266_DisableServer(void){ int try=MAXTRY;
   }
   return FAILURE;
 }
+
+#endif //#if CFG_ESP8266
@@ -29,23 +29,710 @@
 #include <stdint.h>
 #include "../RTOS_Labs_common/heap.h"
 #include "../RTOS_Labs_common/OS.h"
+#include "../inc/CortexM.h"
+#if HEAP_DEBUG
+#include "../RTOS_Labs_common/UART0int.h"
+// heap.h points these at the Heap_*At versions, define the plain ones too
+#undef Heap_Malloc
+#undef Heap_Calloc
+#endif
 
-#define HEAP_SIZE 2048 //# of 32-bits
+// HEAP_SIZE (# of 32-bits) is in OSConfig.h
 
 static int32_t HEAP[HEAP_SIZE];
-Sema4Type heap;
+static heap_t KernelHeap = {HEAP, HEAP_SIZE};
+Sema4Type heap; // one lock for the kernel heap and every process arena
+// blocks Heap_Release could not free because the lock was taken,
+// chained through their first word, freed by heap_unlock
+static int32_t* Released;
+#if HEAP_DEBUG
+// exits Heap_DebugExit could not walk because the lock was taken, walked
+// by heap_unlock before it frees Released, which may hold the arena
+#define DEBUG_EXITS (2*NUMTHREADS)
+static struct {
+  uint16_t id;
+  PCB_t* process;
+} DebugExits[DEBUG_EXITS];
+static uint32_t DebugExitCount;
+static uint32_t DebugExitsLost; // exits not walked, the queue was full
+static void heap_debug_exit(uint32_t id, PCB_t* process);
+#endif
+
+// interrupt pools, one kernel heap block split by size class
+#define ISR_CLASSES 3
+static const struct {
+  uint32_t size;   // bytes per block
+  uint32_t count;  // blocks
+  const char* name;
+} IsrClass[ISR_CLASSES] = {
+  {HEAP_ISR_SIZE0, HEAP_ISR_COUNT0, "isr0"},
+  {HEAP_ISR_SIZE1, HEAP_ISR_COUNT1, "isr1"},
+  {HEAP_ISR_SIZE2, HEAP_ISR_COUNT2, "isr2"},
+};
+static PoolType IsrPool[ISR_CLASSES];
+static int32_t* IsrStart[ISR_CLASSES + 1]; // first word of each class, end of the last
+
+// regions added with Heap_AddRegion, outside the kernel heap
+static heap_t* Regions[HEAP_REGIONS];
+static uint32_t RegionCount;
+// arenas from Heap_CreateArena not yet destroyed or released, changed
+// and searched with interrupts disabled since Heap_ReleaseArena does
+// not wait for the lock
+static heap_t* Arenas[HEAP_ARENAS];
+static uint32_t ArenaCount;
 /*
 Heap allocation scheme
 (+ int) ... (+ int) - indicates how much space is in between these two locations
 (- int) ... (- int) - indicates space taken up by these two locations
 example. 
-1
+2
+next
+prev
+2
+ means two locations available, the first two words of a free block
+ link it into the free list of its size class
 
-1
- means one location available
+Free blocks are kept on segregated lists (two-level segregated fit):
+the first level is the power of two of the size, the second splits that
+range into HEAP_SL equal parts. Two bitmaps say which lists are non-empty,
+so malloc and free take the same few steps whatever the fragmentation.
 
+Process arenas are blocks of the kernel heap that use the same scheme inside,
+the heap_t descriptor sits in the first words of the block
 */
 
+// free list links are 16-bit word indices
+STATIC_ASSERT(HEAP_SIZE < HEAP_NIL && HEAP_SIZE < (1 << (HEAP_FL + 2)), heap_size_tlsf);
+
+// words used by the descriptor at the start of an arena block
+#define ARENA_HEADER ((sizeof(heap_t) + sizeof(int32_t) - 1)/sizeof(int32_t))
+
+// a free block holds its two list links, so that is the smallest block
+#define MIN_BLOCK 2
+
+#if HEAP_DEBUG
+// in front of the data of every block, a guard word follows the data
+typedef struct heap_debug {
+  uint32_t guard;
+  uint16_t id;         // allocating thread
+  uint16_t words;      // requested size
+  PCB_t* process;      // allocating process, NULL for OS threads
+  const char* site;    // file:line of the call
+} heap_debug_t;
+#define HEAP_GUARD 0xFEEDC0DE
+#define DEBUG_HEAD ((int32_t)((sizeof(heap_debug_t) + sizeof(int32_t) - 1)/sizeof(int32_t)))
+#define DEBUG_WORDS (DEBUG_HEAD + 1)
+#else
+#define DEBUG_HEAD 0
+#define DEBUG_WORDS 0
+#endif
+
+// index of the highest set bit, x > 0
+static uint32_t heap_fls(uint32_t x) {
+  uint32_t n = 0;
+  if(x & 0xFFFF0000) { n += 16; x >>= 16; }
+  if(x & 0xFF00) { n += 8; x >>= 8; }
+  if(x & 0xF0) { n += 4; x >>= 4; }
+  if(x & 0xC) { n += 2; x >>= 2; }
+  if(x & 0x2) { n += 1; }
+  return n;
+}
+
+// index of the lowest set bit, x > 0
+static uint32_t heap_ffs(uint32_t x) {
+  return heap_fls(x & (~x + 1));
+}
+
+// size class of a block of size words
+static void heap_mapping(uint32_t size, uint32_t* fl, uint32_t* sl) {
+  if(size < 2*HEAP_SL) {
+    *fl = 0;
+    *sl = size/2;
+  }
+  else {
+    uint32_t f = heap_fls(size);
+    *fl = f - 2;
+    *sl = (size >> (f - 2)) & (HEAP_SL - 1);
+  }
+}
+
+// link the free block whose first tag is at i into its list
+static void heap_insert(heap_t* h, uint32_t i) {
+  int32_t* mem = h->base;
+  uint32_t fl, sl;
+  heap_mapping(mem[i], &fl, &sl);
+  mem[i + 1] = h->head[fl][sl];
+  mem[i + 2] = HEAP_NIL;
+  if(h->head[fl][sl] != HEAP_NIL) {
+    mem[h->head[fl][sl] + 2] = i;
+  }
+  h->head[fl][sl] = i;
+  h->flBitmap |= 1 << fl;
+  h->slBitmap[fl] |= 1 << sl;
+}
+
+// unlink the free block whose first tag is at i
+static void heap_remove(heap_t* h, uint32_t i) {
+  int32_t* mem = h->base;
+  uint32_t fl, sl;
+  heap_mapping(mem[i], &fl, &sl);
+  uint32_t next = mem[i + 1];
+  uint32_t prev = mem[i + 2];
+  if(next != HEAP_NIL) {
+    mem[next + 2] = prev;
+  }
+  if(prev != HEAP_NIL) {
+    mem[prev + 1] = next;
+  }
+  else {
+    h->head[fl][sl] = next;
+    if(next == HEAP_NIL) {
+      h->slBitmap[fl] &= ~(1 << sl);
+      if(h->slBitmap[fl] == 0) {
+        h->flBitmap &= ~(1 << fl);
+      }
+    }
+  }
+}
+
+// only when nothing in the larger classes is free: look at the first
+// HEAP_EXACT_STEPS blocks of the request's own class for one that is big
+// enough, so a request close to the largest free block usually succeeds as
+// it did with first fit. The bound keeps good fit O(1); a block further down
+// the list is not found and the request fails as in plain TLSF
+#define HEAP_EXACT_STEPS 4
+static uint32_t heap_find_exact(heap_t* h, uint32_t size) {
+  uint32_t fl, sl;
+  heap_mapping(size, &fl, &sl);
+  uint32_t i = (fl < HEAP_FL) ? h->head[fl][sl] : HEAP_NIL;
+  for(uint32_t steps = 0; i != HEAP_NIL; steps++) {
+    if(h->base[i] >= (int32_t)size) {
+      return i;
+    }
+    if(steps + 1 == HEAP_EXACT_STEPS) {
+      break;
+    }
+    i = h->base[i + 1];
+  }
+  return HEAP_NIL;
+}
+
+// good fit: first tag of a free block of at least size words, HEAP_NIL if none
+// the size is rounded up to the next class so any block in it fits
+static uint32_t heap_find_good(heap_t* h, uint32_t size) {
+  uint32_t fl, sl;
+  uint32_t request = size;
+  if(size < 2*HEAP_SL) {
+    size = size + 1;
+  }
+  else {
+    size = size + (1 << (heap_fls(size) - 2)) - 1;
+  }
+  heap_mapping(size, &fl, &sl);
+  if(fl >= HEAP_FL) {
+    return heap_find_exact(h, request);
+  }
+  uint32_t slMap = h->slBitmap[fl] & (~0U << sl);
+  if(slMap == 0) {
+    uint32_t flMap = h->flBitmap & (~0U << (fl + 1));
+    if(flMap == 0) {
+      return heap_find_exact(h, request);
+    }
+    fl = heap_ffs(flMap);
+    slMap = h->slBitmap[fl];
+  }
+  return h->head[fl][heap_ffs(slMap)];
+}
+
+// first and next fit: walk the blocks in address order from start,
+// wrapping around, for the first free one of at least size words
+static uint32_t heap_find_walk(heap_t* h, uint32_t size, uint32_t start) {
+  int32_t* mem = h->base;
+  uint32_t i = start;
+  do {
+    if(mem[i] >= (int32_t)size) {
+      return i;
+    }
+    i = i + ((mem[i] < 0) ? -mem[i] : mem[i]) + 2;
+    if(i >= h->words) {
+      i = 0;
+    }
+  } while(i != start);
+  return HEAP_NIL;
+}
+
+// best fit: the lists are the size ordered index, blocks in a larger
+// class are all larger, so only the smallest in one or two lists is needed
+static uint32_t heap_find_best(heap_t* h, uint32_t size) {
+  int32_t* mem = h->base;
+  uint32_t fl, sl;
+  heap_mapping(size, &fl, &sl);
+  if(fl >= HEAP_FL) {
+    return HEAP_NIL;
+  }
+  uint32_t best = HEAP_NIL;
+  uint32_t slMap = h->slBitmap[fl] & (~0U << sl);
+  while(best == HEAP_NIL) {
+    if(slMap == 0) {
+      uint32_t flMap = h->flBitmap & (~0U << (fl + 1));
+      if(fl + 1 >= HEAP_FL || flMap == 0) {
+        return HEAP_NIL;
+      }
+      fl = heap_ffs(flMap);
+      slMap = h->slBitmap[fl];
+    }
+    sl = heap_ffs(slMap);
+    slMap &= ~(1U << sl);
+    for(uint32_t i = h->head[fl][sl]; i != HEAP_NIL; i = mem[i + 1]) {
+      if(mem[i] >= (int32_t)size && (best == HEAP_NIL || mem[i] < mem[best])) {
+        best = i;
+        if(mem[i] == (int32_t)size) {
+          break;
+        }
+      }
+    }
+  }
+  return best;
+}
+
+// first tag of a free block of at least size words by the policy
+// of the heap, HEAP_NIL if none
+static uint32_t heap_find(heap_t* h, uint32_t size) {
+  switch(h->policy) {
+    case HEAP_FIRSTFIT: return heap_find_walk(h, size, 0);
+    case HEAP_NEXTFIT:  return heap_find_walk(h, size, h->rover);
+    case HEAP_BESTFIT:  return heap_find_best(h, size);
+    default:            return heap_find_good(h, size);
+  }
+}
+
+// blocks from top to bottom became one, keep the rover on a block boundary
+static void heap_cover(heap_t* h, uint32_t top, uint32_t bottom) {
+  if(h->rover > top && h->rover <= bottom) {
+    h->rover = top;
+  }
+}
+
+// account for words changing hands, keeps the peak
+static void heap_count(heap_t* h, int32_t words) {
+  h->usedWords += words;
+  if(h->usedWords > h->peakWords) {
+    h->peakWords = h->usedWords;
+  }
+}
+
+// make the whole region one free block
+static void heap_format(heap_t* h) {
+  h->usedWords = 0;
+  h->peakWords = 0;
+  h->mallocs = 0;
+  h->frees = 0;
+  h->reallocs = 0;
+  h->failures = 0;
+  h->rover = 0;
+  h->policy = HEAP_POLICY;
+  h->flBitmap = 0;
+  for(int f = 0; f < HEAP_FL; f++) {
+    h->slBitmap[f] = 0;
+    for(int s = 0; s < HEAP_SL; s++) {
+      h->head[f][s] = HEAP_NIL;
+    }
+  }
+  h->base[0] = h->words - 2;
+  h->base[h->words - 1] = h->words - 2;
+  heap_insert(h, 0);
+}
+
+// good fit from the segregated lists, caller holds the heap lock
+// returns pointer to the data, NULL if no block is large enough
+static int32_t* heap_alloc(heap_t* h, int32_t neededBlocks) {
+  int32_t* mem = h->base;
+  if(neededBlocks < MIN_BLOCK) { // the block must hold its links once freed
+    neededBlocks = MIN_BLOCK;
+  }
+  uint32_t i = heap_find(h, neededBlocks);
+  if(i == HEAP_NIL) {
+    h->failures++;
+    return 0;   // no space
+  }
+  heap_remove(h, i);
+  int32_t available = mem[i];
+  if(available - neededBlocks < MIN_BLOCK + 2) {
+    // leftover can't hold its own two tags and links, hand out the whole block
+    neededBlocks = available;
+  }
+  else {
+    // split, the leftover is a free block of its own
+    int32_t leftover = available - (neededBlocks + 2);
+    mem[i + neededBlocks + 2] = leftover;
+    mem[i + available + 1] = leftover;
+    heap_insert(h, i + neededBlocks + 2);
+  }
+  mem[i] = -neededBlocks;
+  mem[i + neededBlocks + 1] = -neededBlocks;
+  heap_count(h, neededBlocks);
+  // next fit goes on after this block
+  h->rover = (i + neededBlocks + 2 < h->words) ? i + neededBlocks + 2 : 0;
+  return (mem + i + 1);
+}
+
+// set boundaries to positive, merge with free neighbours above and below
+// caller holds the heap lock
+static void heap_free(heap_t* h, int32_t* blockptr) {
+  int32_t* mem = h->base;
+  uint32_t top = blockptr - 1 - mem;        // first tag
+  uint32_t bottom = top - mem[top] + 1;     // last tag, size is negative
+  heap_count(h, mem[top]);
+  // merge above
+  if(top != 0 && mem[top - 1] > 0) {
+    top = top - 1 - mem[top - 1] - 1;
+    heap_remove(h, top);
+  }
+  // merge below
+  if(bottom != h->words - 1 && mem[bottom + 1] > 0) {
+    heap_remove(h, bottom + 1);
+    bottom = bottom + 1 + mem[bottom + 1] + 1;
+  }
+  mem[top] = bottom - top - 1;
+  mem[bottom] = bottom - top - 1;
+  heap_cover(h, top, bottom);
+  heap_insert(h, top);
+}
+
+// give back the end of a used block so it keeps size words,
+// if the end is large enough to be a block of its own
+// caller holds the heap lock
+static void heap_trim(heap_t* h, uint32_t top, int32_t size) {
+  int32_t* mem = h->base;
+  int32_t total = -mem[top];
+  if(total - size < MIN_BLOCK + 2) {
+    return;
+  }
+  int32_t rest = total - size - 2;
+  uint32_t tail = top + size + 2;
+  mem[top] = -size;
+  mem[top + size + 1] = -size;
+  mem[tail] = -rest;
+  mem[tail + rest + 1] = -rest;
+  heap_count(h, -2);            // the new tags
+  heap_free(h, mem + tail + 1); // merges with a free block below it
+}
+
+// heap new allocations come from, the arena of the running
+// thread's process if it has one, the kernel heap otherwise
+static heap_t* heap_current(void) {
+  PCB_t* process = OS_CurrentProcess();
+  if(process != 0 && process->arena != 0) {
+    return process->arena;
+  }
+  return &KernelHeap;
+}
+
+// take an arena off the live list
+static void heap_drop_arena(heap_t* arena) {
+  long sr = StartCritical();
+  for(uint32_t a = 0; a < ArenaCount; a++) {
+    if(Arenas[a] == arena) {
+      ArenaCount--;
+      Arenas[a] = Arenas[ArenaCount];
+      break;
+    }
+  }
+  EndCritical(sr);
+}
+
+// heap a block belongs to, found by address
+// arenas live inside the kernel heap, so check the arenas first
+static heap_t* heap_owner(void* pointer) {
+  heap_t* h;
+  long sr = StartCritical();
+  for(uint32_t a = 0; a < ArenaCount; a++) {
+    h = Arenas[a];
+    if((int32_t*)pointer > h->base && (int32_t*)pointer < h->base + h->words) {
+      EndCritical(sr);
+      return h;
+    }
+  }
+  EndCritical(sr);
+  for(uint32_t r = 0; r < RegionCount; r++) {
+    h = Regions[r];
+    if((int32_t*)pointer > h->base && (int32_t*)pointer < h->base + h->words) {
+      return h;
+    }
+  }
+  return &KernelHeap;
+}
+
+// let go of the heap lock, first walking the exits Heap_DebugExit queued
+// and freeing the blocks Heap_Release queued while it was held, one at a
+// time so interrupts stay enabled in between
+static void heap_unlock(void) {
+  while(1) {
+    long sr = StartCritical();
+#if HEAP_DEBUG
+    if(DebugExitCount != 0) {
+      DebugExitCount--;
+      uint32_t id = DebugExits[DebugExitCount].id;
+      PCB_t* process = DebugExits[DebugExitCount].process;
+      EndCritical(sr);
+      heap_debug_exit(id, process);
+      continue;
+    }
+#endif
+    int32_t* block = Released;
+    if(block == 0) {
+      OS_bSignal(&heap);
+      EndCritical(sr);
+      return;
+    }
+    Released = *(int32_t**) block;
+    EndCritical(sr);
+    heap_free(heap_owner(block), block);
+  }
+}
+
+// free a block, or queue it for the lock holder if the lock is taken
+// never blocks, works with interrupts disabled
+static void heap_release(int32_t* block) {
+  long sr = StartCritical();
+  if(OS_bTryWait(&heap)) {
+    heap_free(heap_owner(block), block);
+    heap_unlock();
+  }
+  else {
+    *(int32_t**) block = Released;
+    Released = block;
+  }
+  EndCritical(sr);
+}
+
+// like heap_alloc with the data (after any debug header) on an
+// alignWords boundary, the gap in front becomes a free block
+// caller holds the heap lock
+static int32_t* heap_alloc_aligned(heap_t* h, int32_t neededBlocks, uint32_t alignWords) {
+  if(alignWords <= 1) {
+    return heap_alloc(h, neededBlocks);
+  }
+  if(neededBlocks < MIN_BLOCK) {
+    neededBlocks = MIN_BLOCK;
+  }
+  // room to reach the boundary, and one more step if the gap
+  // would be too small to be a free block
+  int32_t* block = heap_alloc(h, neededBlocks + 2*alignWords + MIN_BLOCK + 2);
+  if(block == 0) {
+    return 0;
+  }
+  int32_t* mem = h->base;
+  uint32_t top = block - 1 - mem;
+  int32_t size = -mem[top];
+  uint32_t misalign = ((uintptr_t)(block + DEBUG_HEAD)/sizeof(int32_t)) & (alignWords - 1);
+  uint32_t gap = (alignWords - misalign) & (alignWords - 1);
+  while(gap != 0 && gap < MIN_BLOCK + 2) {
+    gap += alignWords;
+  }
+  if(gap != 0) {
+    // the block above is in use, free blocks never touch, so no merge
+    mem[top] = gap - 2;
+    mem[top + gap - 1] = gap - 2;
+    heap_insert(h, top);
+    heap_count(h, -(int32_t)gap);
+    top = top + gap;
+    size = size - gap;
+    mem[top] = -size;
+    mem[top + size + 1] = -size;
+  }
+  heap_trim(h, top, neededBlocks);
+  return mem + top + 1;
+}
+
+// an allocated block is a process arena if it starts with a
+// descriptor pointing just past itself
+static int heap_is_arena(int32_t* blockptr) {
+  return ((heap_t*) blockptr)->base == blockptr + ARENA_HEADER;
+}
+
+#if HEAP_DEBUG
+// 1 if the block at blockptr is not a valid allocated block
+// of the debug heap (double free, bad pointer, overwritten guards)
+static int heap_debug_bad(int32_t* blockptr) {
+  heap_debug_t* debug = (heap_debug_t*) blockptr;
+  int32_t size = -*(blockptr - 1);
+  if(size < (int32_t)DEBUG_WORDS || *(blockptr + size) != -size) {
+    return 1;
+  }
+  if(debug->guard != HEAP_GUARD || debug->words + DEBUG_WORDS > size) {
+    return 1;
+  }
+  return (uint32_t) blockptr[DEBUG_HEAD + debug->words] != HEAP_GUARD;
+}
+
+static int32_t* DebugBad;   // last corrupted block found
+#endif
+
+// fill in the debug header and trailer, returns the pointer the caller sees
+static int32_t* heap_user(int32_t* blockptr, int32_t words, const char* site) {
+#if HEAP_DEBUG
+  heap_debug_t* debug = (heap_debug_t*) blockptr;
+  debug->guard = HEAP_GUARD;
+  debug->id = OS_Id();
+  debug->words = words;
+  debug->process = OS_CurrentProcess();
+  debug->site = site;
+  blockptr[DEBUG_HEAD + words] = HEAP_GUARD;
+#endif
+  return blockptr + DEBUG_HEAD;
+}
+
+// allocate and tag, site is only kept by the debug heap
+// h NULL allocates from the heap of the running thread
+static void* heap_malloc_in(heap_t* h, int32_t desiredBytes, uint32_t alignWords, const char* site) {
+  // good fit from the size class lists
+  // can only allocate by 32 bits
+  OS_bWait(&heap);
+  int32_t neededBlocks = (desiredBytes)/4; // words needed for bytes
+  if(desiredBytes%4 != 0) {//extra block
+    neededBlocks++;
+  }
+  if(h == 0) {
+    h = heap_current();
+  }
+  int32_t* block = heap_alloc_aligned(h, neededBlocks + DEBUG_WORDS, alignWords);
+  if(block != 0) {
+    h->mallocs++;
+    block = heap_user(block, neededBlocks, site);
+  }
+  heap_unlock();
+  return block;
+}
+
+static void* heap_malloc(int32_t desiredBytes, const char* site) {
+  return heap_malloc_in(0, desiredBytes, 1, site);
+}
+
+// allocate and zero the requested words
+static void* heap_calloc(int32_t desiredBytes, const char* site) {
+  // malloc then init to 0
+  int32_t* block = heap_malloc(desiredBytes, site);
+  if(block == 0) {
+    return 0;
+  }
+  for(int i = 0; i < (desiredBytes + 3)/4; i++) {
+    block[i] = 0;
+  }
+  return block;
+}
+
+// resize the block at blockptr to neededBlocks words, caller holds the heap lock
+// returns the block, possibly moved, NULL if there is no room
+static int32_t* heap_realloc(heap_t* h, int32_t* blockptr, int32_t neededBlocks) {
+  int32_t* mem = h->base;
+  uint32_t top = blockptr - 1 - mem;  // first tag
+  int32_t size = -mem[top];
+  uint32_t bottom = top + size + 1;   // last tag
+  
+  if(neededBlocks <= size) {
+    // shrink in place
+    heap_trim(h, top, neededBlocks);
+    return blockptr;
+  }
+  
+  // free space directly below and above
+  int32_t below = 0;
+  int32_t above = 0;
+  if(bottom != h->words - 1 && mem[bottom + 1] > 0) {
+    below = mem[bottom + 1] + 2;
+  }
+  if(top != 0 && mem[top - 1] > 0) {
+    above = mem[top - 1] + 2;
+  }
+  
+  if(size + below >= neededBlocks) {
+    // grow into the block below, the data stays where it is
+    heap_remove(h, bottom + 1);
+    heap_count(h, below);
+    size = size + below;
+    mem[top] = -size;
+    mem[top + size + 1] = -size;
+    heap_cover(h, top, top + size + 1);
+    heap_trim(h, top, neededBlocks);
+    return blockptr;
+  }
+  
+  if(size + below + above >= neededBlocks) {
+    // grow into the block above (and below), move the data up
+    uint32_t newTop = top - above;
+    int32_t* to = mem + newTop + 1;
+    int32_t words = size;
+    heap_remove(h, newTop);
+    if(below) {
+      heap_remove(h, bottom + 1);
+    }
+    heap_count(h, below + above);
+    size = size + below + above;
+    for(int i = 0; i < words; i++) { // destination is lower, copy forward
+      to[i] = blockptr[i];
+    }
+    mem[newTop] = -size;
+    mem[newTop + size + 1] = -size;
+    heap_cover(h, newTop, newTop + size + 1);
+    heap_trim(h, newTop, neededBlocks);
+    return to;
+  }
+  
+  // move to a new block
+  int32_t* newblock = heap_alloc(h, neededBlocks);
+  if(newblock == 0) {
+    return 0;
+  }
+  for(int i = 0; i < size; i++) {
+    newblock[i] = blockptr[i];
+  }
+  heap_free(h, blockptr);
+  return newblock;
+}
+
+
+// set aside the interrupt pools, before any thread runs so no lock
+static void heap_isr_init(void) {
+  int32_t words = 0;
+  for(int c = 0; c < ISR_CLASSES; c++) {
+    words += ((IsrClass[c].size + 3)/4)*IsrClass[c].count;
+  }
+  int32_t* block = 0;
+  if(words != 0) {
+    block = heap_alloc(&KernelHeap, words + DEBUG_WORDS);
+  }
+  if(block == 0) {
+    for(int c = 0; c <= ISR_CLASSES; c++) {
+      IsrStart[c] = 0;
+    }
+    return;
+  }
+  block = heap_user(block, words, "isr pools");
+  for(int c = 0; c < ISR_CLASSES; c++) {
+    IsrStart[c] = block;
+    if(IsrClass[c].count != 0) {
+      OS_InitPool(&IsrPool[c], IsrClass[c].name, block, IsrClass[c].size, IsrClass[c].count);
+    }
+    block += ((IsrClass[c].size + 3)/4)*IsrClass[c].count;
+  }
+  IsrStart[ISR_CLASSES] = block;
+}
+
+// interrupt pool class of a block, -1 if it is not from the pools
+static int32_t heap_isr_class(void* pointer) {
+  int32_t* block = (int32_t*) pointer;
+  if(block < IsrStart[0] || block >= IsrStart[ISR_CLASSES]) {
+    return -1;
+  }
+  for(int c = 0; c < ISR_CLASSES; c++) {
+    if(block < IsrStart[c + 1]) {
+      return c;
+    }
+  }
+  return -1;
+}
+
 //******** Heap_Init *************** 
 // Initialize the Heap
 // input: none
@@ -53,9 +740,11 @@ example.
 // notes: Initializes/resets the heap to a clean state where no memory
 //  is allocated.
 int32_t Heap_Init(void){
-  HEAP[0] = HEAP_SIZE - 2;
-  HEAP[HEAP_SIZE - 1] = HEAP_SIZE - 2;
+  heap_format(&KernelHeap);
+  ArenaCount = 0;
   OS_InitSemaphore(&heap, 1);
+  OS_NameSemaphore(&heap, "heap");
+  heap_isr_init();
   return 0;
 }
 
@@ -66,44 +755,9 @@ int32_t Heap_Init(void){
 //   desiredBytes: desired number of bytes to allocate
 // output: void* pointing to the allocated memory or will return NULL
 //   if there isn't sufficient space to satisfy allocation request
+// notes: threads of a process with an arena allocate from the arena
 void* Heap_Malloc(int32_t desiredBytes){
-  // first fit
-  // can only allocate by 32 bits
-  OS_bWait(&heap);
-  int32_t neededBlocks = (desiredBytes)/4; // words needed for bytes
-  if(desiredBytes%4 != 0) {//extra block
-    neededBlocks++;
-  }
-  uint32_t i = 0;
-  while(i < HEAP_SIZE) {
-    if(HEAP[i] >= neededBlocks) {
-      //allocate here
-      //some issues - what if 2 blocks available, but neededBlocks = 1? leftover block of 0
-      if(i + HEAP[i] + 1 <= HEAP_SIZE - 1) {
-        HEAP[i + HEAP[i] + 1] = HEAP[i] - (neededBlocks + 2);
-      }
-      if(i + neededBlocks + 2 <= HEAP_SIZE - 1) {
-        HEAP[i + neededBlocks + 2] = HEAP[i] - (neededBlocks + 2);
-      }
-      HEAP[i] = -neededBlocks;
-      HEAP[i + neededBlocks + 1] = -neededBlocks;
-      OS_bSignal(&heap);
-      return (HEAP + i + 1);
-    }
-    
-    // might also be 0 (wasted space), but can't allocate
-    if(HEAP[i] > 0) {
-      i = i + HEAP[i] + 2; //go to next section
-    }
-    else if(HEAP[i] < 0) {
-      i = i - HEAP[i] + 2; 
-    }
-    else{
-      i++;
-    }
-  }
-  OS_bSignal(&heap);
-  return 0;   // no space
+  return heap_malloc(desiredBytes, 0);
 }
 
 
@@ -115,18 +769,7 @@ void* Heap_Malloc(int32_t desiredBytes){
 //   if there isn't sufficient space to satisfy allocation request
 //notes: the allocated memory block will be zeroed out
 void* Heap_Calloc(int32_t desiredBytes){  
-  // malloc then init to 0
-  int32_t* block = Heap_Malloc(desiredBytes);
-  OS_bWait(&heap);
-  if(block == 0) {
-    OS_bSignal(&heap);
-    return 0;
-  }
-  for(int i = 0; i < -*(block - 1); i++) { //num bytes
-    block[i] = 0;
-  }
-  OS_bSignal(&heap);
-  return block;   // NULL
+  return heap_calloc(desiredBytes, 0);
 }
 
 
@@ -137,35 +780,55 @@ void* Heap_Calloc(int32_t desiredBytes){
 //  desiredBytes: a desired number of bytes for a new block
 // output: void* pointing to the new block or will return NULL
 //   if there is any reason the reallocation can't be completed
-// notes: the given block may be unallocated and its contents
-//   are copied to a new block if growing/shrinking not possible
+// notes: shrinking splits off the tail, growing absorbs free neighbours
+//   when they are large enough; only otherwise are the contents
+//   copied to a new block and the given block unallocated
+//   a block from Heap_ISRMalloc is always copied to a heap block
 void* Heap_Realloc(void* oldBlock, int32_t desiredBytes){
-  int32_t* newblock = Heap_Malloc(desiredBytes);
-  OS_bWait(&heap);
-  if(newblock == 0) {
-    OS_bSignal(&heap);
-    return 0;
+  if(oldBlock == 0) {
+    return Heap_Malloc(desiredBytes);
   }
-  // get smaller size
-  int32_t* blockptr = (int32_t*) oldBlock;
-  
-  int tmp1 = -*((int32_t*) oldBlock - 1);
-  int tmp2 = -*((int32_t*) newblock - 1);
-  if(tmp1 <= tmp2){
-    for(int i = 0; i < -*((int32_t*) oldBlock - 1); i++) {
-      newblock[i] = blockptr[i];
+  int32_t c = heap_isr_class(oldBlock);
+  if(c >= 0) {
+    int32_t* newBlock = Heap_Malloc(desiredBytes);
+    if(newBlock == 0) {
+      return 0;
     }
-  }
-  else {
-    for(int i = 0; i < -*((int32_t*) newblock - 1); i++) {
-      newblock[i] = blockptr[i];
+    int32_t words = (desiredBytes < (int32_t)IsrClass[c].size) ? desiredBytes : (int32_t)IsrClass[c].size;
+    words = (words + 3)/4;
+    for(int i = 0; i < words; i++) {
+      newBlock[i] = ((int32_t*) oldBlock)[i];
     }
+    OS_PoolFree(&IsrPool[c], oldBlock);
+    return newBlock;
+  }
+  int32_t neededBlocks = (desiredBytes + 3)/4;
+  int32_t* block = (int32_t*) oldBlock - DEBUG_HEAD;
+  OS_bWait(&heap);
+  heap_t* h = heap_owner(block);
+#if HEAP_DEBUG
+  if(heap_debug_bad(block)) {
+    DebugBad = block;
+    heap_unlock();
+    return 0;
+  }
+#endif
+  if(neededBlocks + DEBUG_WORDS < MIN_BLOCK) {
+    neededBlocks = MIN_BLOCK - DEBUG_WORDS;
   }
-  OS_bSignal(&heap);
-  if(Heap_Free(oldBlock)) {
+  block = heap_realloc(h, block, neededBlocks + DEBUG_WORDS);
+  if(block == 0) {
+    heap_unlock();
     return 0;
   }
-  return newblock;   // NULL
+  h->reallocs++;
+#if HEAP_DEBUG
+  // the header moved with the data, only the size and trailer change
+  ((heap_debug_t*) block)->words = neededBlocks;
+  block[DEBUG_HEAD + neededBlocks] = HEAP_GUARD;
+#endif
+  heap_unlock();
+  return block + DEBUG_HEAD;
 }
 
 
@@ -174,32 +837,132 @@ void* Heap_Realloc(void* oldBlock, int32_t desiredBytes){
 // input: pointer to memory to unallocate
 // output: 0 if everything is ok, non-zero in case of error (e.g. invalid pointer
 //     or trying to unallocate memory that has already been unallocated
+// notes: a block from a process arena must be freed by a thread of that process
+//     errors are only detected by the debug heap
 int32_t Heap_Free(void* pointer){
-  // set boundaries to positive, test if above and below are positive, if yes merge
+  if(pointer == 0 || Heap_ISRFree(pointer) == 0) {
+    return 0;
+  }
+  int32_t* block = (int32_t*) pointer - DEBUG_HEAD;
   OS_bWait(&heap);
-  int32_t* blockptr = (int32_t*) pointer;
-  *(blockptr - 1) = - *(blockptr - 1);
-  *(blockptr + *(blockptr -1)) = *(blockptr - 1);
-  // merge above
-  int32_t* top = blockptr - 1;
-  if(blockptr - 1 != HEAP){
-    if(*(blockptr - 2) >= 0) {
-      uint32_t total = *(blockptr - 1) + *(blockptr - 2) + 2;
-      *(blockptr - 2 - *(blockptr - 2) - 1) = total;
-      top = blockptr - 2 - *(blockptr - 2) - 1;
-      *(blockptr + *(blockptr -1)) = total;
-    }
+  heap_t* h = heap_owner(block);
+#if HEAP_DEBUG
+  if(heap_debug_bad(block)) {
+    DebugBad = block;
+    heap_unlock();
+    return 1;
   }
-  //merge below
-  if(blockptr + *(blockptr -1) != &HEAP[HEAP_SIZE - 1]) {
-    if(*(blockptr + *(blockptr -1) + 1) >= 0) {
-      uint32_t total =  *(blockptr + *(blockptr -1)) + *(blockptr + *(blockptr -1) + 1) + 2;
-      *(blockptr + *(blockptr - 1) + 2 + *(blockptr + *(blockptr - 1) + 1)) = total;
-      *(top) = total;
+#endif
+  heap_free(h, block);
+  h->frees++;
+  heap_unlock();
+  return 0;
+}
+
+
+//******** Heap_ISRMalloc *************** 
+// allocate from the interrupt pools, never blocks
+// input: desired number of bytes
+// output: void* pointing to the block, NULL if the fitting classes are empty
+// notes: a full class spills into the next larger one, no further,
+//   so small requests can't use up the large blocks
+void* Heap_ISRMalloc(int32_t desiredBytes){
+  int tries = 0;
+  for(int c = 0; c < ISR_CLASSES && tries < 2; c++) {
+    if(desiredBytes <= (int32_t)IsrClass[c].size) {
+      tries++;
+      if(IsrClass[c].count != 0) {
+        void* block = OS_PoolAlloc(&IsrPool[c]);
+        if(block != 0) {
+          return block;
+        }
+      }
     }
   }
-  OS_bSignal(&heap);
-  return 0;   // replace
+  return 0;
+}
+
+
+//******** Heap_ISRFree *************** 
+// return a block from Heap_ISRMalloc, never blocks
+// input: pointer to the block
+// output: 0 if everything is ok, non-zero if the block is not from the pools
+int32_t Heap_ISRFree(void* pointer){
+  int32_t c = heap_isr_class(pointer);
+  if(c < 0) {
+    return 1;
+  }
+  OS_PoolFree(&IsrPool[c], pointer);
+  return 0;
+}
+
+
+//******** Heap_MallocAligned *************** 
+// allocate memory whose address is a multiple of align
+// input: desired number of bytes, alignment in bytes (power of 2)
+// output: void* pointing to the allocated memory or NULL
+// notes: Heap_Realloc may move the block to a word aligned address
+void* Heap_MallocAligned(int32_t desiredBytes, uint32_t align){
+  return Heap_MallocIn(0, desiredBytes, align);
+}
+
+
+//******** Heap_MallocIn *************** 
+// allocate from a given region with a given alignment
+// input: region from Heap_AddRegion, NULL for the heap of the running thread
+//        desired number of bytes, alignment in bytes (power of 2, 4 or less for words)
+// output: void* pointing to the allocated memory or NULL
+void* Heap_MallocIn(heap_t *region, int32_t desiredBytes, uint32_t align){
+  if(align & (align - 1)) {
+    return 0;   // not a power of 2
+  }
+  uint32_t alignWords = (align < sizeof(int32_t)) ? 1 : align/sizeof(int32_t);
+  return heap_malloc_in(region, desiredBytes, alignWords, 0);
+}
+
+
+//******** Heap_AddRegion *************** 
+// manage another block of memory as a separate heap
+// input: word aligned memory and its size in bytes
+// output: region descriptor, NULL if it is too small or too large
+//         or HEAP_REGIONS regions exist already
+heap_t* Heap_AddRegion(void *memory, uint32_t bytes){
+  uint32_t words = bytes/sizeof(int32_t);
+  if(words < ARENA_HEADER + MIN_BLOCK + 2 || words - ARENA_HEADER >= HEAP_NIL) {
+    return 0;
+  }
+  heap_t* region = (heap_t*) memory;
+  OS_bWait(&heap);
+  if(RegionCount == HEAP_REGIONS) {
+    heap_unlock();
+    return 0;
+  }
+  region->base = (int32_t*) memory + ARENA_HEADER;
+  region->words = words - ARENA_HEADER;
+  heap_format(region);
+  Regions[RegionCount] = region;
+  RegionCount++;
+  heap_unlock();
+  return region;
+}
+
+
+//******** Heap_SetPolicy *************** 
+// choose how a heap picks the free block for an allocation
+// input: heap, NULL for the kernel heap, HEAP_GOODFIT, HEAP_FIRSTFIT,
+//        HEAP_NEXTFIT or HEAP_BESTFIT
+// output: 0 in case of success, 1 for an unknown policy
+int32_t Heap_SetPolicy(heap_t *h, uint32_t policy){
+  if(policy > HEAP_BESTFIT) {
+    return 1;
+  }
+  if(h == 0) {
+    h = &KernelHeap;
+  }
+  OS_bWait(&heap);
+  h->policy = policy;
+  heap_unlock();
+  return 0;
 }
 
 
@@ -208,7 +971,7 @@ int32_t Heap_Free(void* pointer){
 // input: reference to a heap_stats_t that returns the current usage of the heap
 // output: 0 in case of success, non-zeror in case of error (e.g. corrupted heap)
 int32_t Heap_Stats(heap_stats_t *stats){
-  // just go through heap
+  // just go through heap, arenas count as used
   uint32_t i = 0;
   stats->free = 0;
   stats->used = 0;
@@ -228,3 +991,478 @@ int32_t Heap_Stats(heap_stats_t *stats){
   stats->size = HEAP_SIZE*sizeof(int32_t);
   return 0;   // replace
 }
+
+
+//******** Heap_StatsEx *************** 
+// extended statistics: largest free block, free block histogram,
+// fragmentation index, peak usage and operation counters
+// input: heap to examine (NULL for the kernel heap), reference to a heap_stats_ex_t
+// output: 0 in case of success, non-zero if the tags don't add up (corrupted heap)
+int32_t Heap_StatsEx(heap_t *h, heap_stats_ex_t *stats){
+  if(h == 0) {
+    h = &KernelHeap;
+  }
+  int32_t* mem = h->base;
+  uint32_t i = 0;
+  stats->used = 0;
+  stats->free = 0;
+  stats->largestFree = 0;
+  stats->freeBlocks = 0;
+  for(int b = 0; b < HEAP_BUCKETS; b++) {
+    stats->histogram[b] = 0;
+  }
+  OS_bWait(&heap);
+  while(i < h->words) {
+    int32_t size = mem[i];
+    if(size > 0) {
+      uint32_t bytes = size*sizeof(int32_t);
+      // bucket 0 is below 16 bytes, each next one doubles
+      uint32_t b = (bytes < 16) ? 0 : heap_fls(bytes) - 3;
+      stats->histogram[(b < HEAP_BUCKETS) ? b : HEAP_BUCKETS - 1]++;
+      stats->free += bytes;
+      stats->freeBlocks++;
+      if(bytes > stats->largestFree) {
+        stats->largestFree = bytes;
+      }
+    }
+    else if(size < 0) {
+      stats->used -= size*sizeof(int32_t);
+      size = -size;
+    }
+    else {
+      break;  // every block has at least MIN_BLOCK words
+    }
+    i = i + size + 2;
+  }
+  stats->size = h->words*sizeof(int32_t);
+  stats->peakUsed = h->peakWords*sizeof(int32_t);
+  stats->mallocs = h->mallocs;
+  stats->frees = h->frees;
+  stats->reallocs = h->reallocs;
+  stats->failures = h->failures;
+  heap_unlock();
+  stats->fragmentation = (stats->free == 0) ? 0 : 
+    1000 - (uint32_t)(((uint64_t)stats->largestFree*1000)/stats->free);
+  return (i == h->words) ? 0 : 1;
+}
+
+
+//******** Heap_Map *************** 
+// draw the kernel heap, one character per slice of the heap
+// '.' all free, '#' all allocated, ':' both, 'a' process arena
+// input: buffer of columns+1 characters, number of slices
+// output: 0 in case of success
+int32_t Heap_Map(char map[], uint32_t columns){
+  uint32_t i = 0;
+  for(uint32_t c = 0; c < columns; c++) {
+    map[c] = 0;
+  }
+  OS_bWait(&heap);
+  while(i < HEAP_SIZE) {
+    int32_t size = (HEAP[i] < 0) ? -HEAP[i] : HEAP[i];
+    char mark = '.';
+    if(HEAP[i] < 0) {
+      mark = heap_is_arena(&HEAP[i + 1]) ? 'a' : '#';
+    }
+    if(size == 0) {
+      break;
+    }
+    uint32_t first = (i*columns)/HEAP_SIZE;
+    uint32_t last = ((i + size + 1)*columns)/HEAP_SIZE;
+    for(uint32_t c = first; c <= last && c < columns; c++) {
+      if(map[c] == 0 || map[c] == mark) {
+        map[c] = mark;
+      }
+      else if(map[c] != 'a') {
+        map[c] = (mark == 'a') ? 'a' : ':';
+      }
+    }
+    i = i + size + 2;
+  }
+  heap_unlock();
+  map[columns] = 0;
+  return 0;
+}
+
+
+// consistency of one heap and of the arenas inside it
+// caller holds the heap lock
+static int32_t heap_check(heap_t* h) {
+  int32_t* mem = h->base;
+  uint32_t i = 0;
+  uint32_t freeBlocks = 0;
+  uint32_t usedWords = 0;
+  int lastFree = 0;
+  int roverSeen = 0;
+  uint32_t fl, sl;
+  while(i < h->words) {
+    roverSeen |= (i == h->rover);
+    int32_t size = (mem[i] < 0) ? -mem[i] : mem[i];
+    if(size < MIN_BLOCK || i + size + 1 >= h->words) {
+      return HEAP_CHECK_SIZE;
+    }
+    if(mem[i + size + 1] != mem[i]) {
+      return HEAP_CHECK_TAGS;
+    }
+    if(mem[i] > 0) {
+      if(lastFree) {
+        return HEAP_CHECK_MERGE;  // free neighbours are always merged
+      }
+      // the block must be on the list of its class
+      heap_mapping(size, &fl, &sl);
+      uint32_t j = h->head[fl][sl];
+      for(uint32_t n = 0; j != HEAP_NIL && j != i && n < h->words; n++) {
+        j = mem[j + 1];
+      }
+      if(j != i) {
+        return HEAP_CHECK_LIST;
+      }
+      freeBlocks++;
+    }
+    else {
+      usedWords += size;
+      if(heap_is_arena(mem + i + 1)) {
+        int32_t error = heap_check((heap_t*)(mem + i + 1));
+        if(error) {
+          return error;
+        }
+      }
+    }
+    lastFree = (mem[i] > 0);
+    i = i + size + 2;
+  }
+  // every list holds free blocks of its own class, linked both ways,
+  // and the bitmaps say which lists are not empty
+  uint32_t listed = 0;
+  for(uint32_t f = 0; f < HEAP_FL; f++) {
+    for(uint32_t s = 0; s < HEAP_SL; s++) {
+      uint32_t j = h->head[f][s];
+      uint32_t prev = HEAP_NIL;
+      if((j != HEAP_NIL) != ((h->slBitmap[f] >> s) & 1)) {
+        return HEAP_CHECK_BITMAP;
+      }
+      while(j != HEAP_NIL) {
+        if(j >= h->words || mem[j] <= 0 || (uint32_t) mem[j + 2] != prev || listed == freeBlocks) {
+          return HEAP_CHECK_LIST;
+        }
+        heap_mapping(mem[j], &fl, &sl);
+        if(fl != f || sl != s) {
+          return HEAP_CHECK_LIST;
+        }
+        listed++;
+        prev = j;
+        j = mem[j + 1];
+      }
+    }
+    if((h->slBitmap[f] != 0) != ((h->flBitmap >> f) & 1)) {
+      return HEAP_CHECK_BITMAP;
+    }
+  }
+  if(listed != freeBlocks) {
+    return HEAP_CHECK_LIST;
+  }
+  if(usedWords != h->usedWords) {
+    return HEAP_CHECK_COUNT;
+  }
+  if(!roverSeen) {
+    return HEAP_CHECK_ROVER;
+  }
+  return HEAP_CHECK_OK;
+}
+
+
+//******** Heap_Check *************** 
+// walk a heap and verify its invariants
+// input: heap to check, NULL for the kernel heap, its arenas and every region
+// output: HEAP_CHECK_OK (0) if consistent, else the first check that failed
+int32_t Heap_Check(heap_t *h){
+  int32_t error;
+  OS_bWait(&heap);
+  if(h != 0) {
+    error = heap_check(h);
+  }
+  else {
+    error = heap_check(&KernelHeap);
+    for(uint32_t r = 0; r < RegionCount && error == HEAP_CHECK_OK; r++) {
+      error = heap_check(Regions[r]);
+    }
+  }
+  heap_unlock();
+  return error;
+}
+
+
+//******** Heap_CreateArena *************** 
+// carve a process arena out of the kernel heap
+// input: usable size of the arena in bytes
+// output: arena descriptor, NULL if the kernel heap has no room
+//         or HEAP_ARENAS arenas are live already
+heap_t* Heap_CreateArena(uint32_t bytes){
+  uint32_t words = (bytes + 3)/4 + 2; // room for the arena's own tags
+  OS_bWait(&heap);
+  heap_t* arena = 0;
+  if(ArenaCount < HEAP_ARENAS) {
+    arena = (heap_t*) heap_alloc(&KernelHeap, ARENA_HEADER + words);
+  }
+  if(arena != 0) {
+    arena->base = (int32_t*) arena + ARENA_HEADER;
+    arena->words = words;
+    heap_format(arena);
+    long sr = StartCritical();
+    Arenas[ArenaCount] = arena;
+    ArenaCount++;
+    EndCritical(sr);
+  }
+  heap_unlock();
+  return arena;
+}
+
+
+//******** Heap_DestroyArena *************** 
+// give a process arena back to the kernel heap,
+// everything still allocated in it is released at once
+// input: arena descriptor from Heap_CreateArena
+// output: 0 if everything is ok
+int32_t Heap_DestroyArena(heap_t *arena){
+  heap_drop_arena(arena);
+  OS_bWait(&heap);
+  heap_free(&KernelHeap, (int32_t*) arena);
+  heap_unlock();
+  return 0;
+}
+
+
+//******** Heap_Release *************** 
+// Heap_Free that never blocks, e.g., for OS_Kill with interrupts disabled
+// if another thread holds the heap lock, the block is freed when it lets go
+// input: pointer to a block from Heap_Malloc, NULL is ignored
+// output: none
+void Heap_Release(void* pointer){
+  if(pointer == 0 || Heap_ISRFree(pointer) == 0) {
+    return;
+  }
+  heap_release((int32_t*) pointer - DEBUG_HEAD);
+}
+
+
+//******** Heap_ReleaseArena *************** 
+// Heap_DestroyArena that never blocks, see Heap_Release
+// input: arena descriptor from Heap_CreateArena
+// output: none
+void Heap_ReleaseArena(heap_t *arena){
+  heap_drop_arena(arena); // now, a queued arena loses its first word
+  heap_release((int32_t*) arena);
+}
+
+
+#if HEAP_DEBUG
+//******** Heap_MallocAt *************** 
+// Heap_Malloc that records a call site, Heap_Malloc maps here
+// input: desired number of bytes, file:line of the caller
+// output: void* pointing to the allocated memory or NULL
+void* Heap_MallocAt(int32_t desiredBytes, const char *site){
+  return heap_malloc(desiredBytes, site);
+}
+
+
+//******** Heap_CallocAt *************** 
+// Heap_Calloc that records a call site, Heap_Calloc maps here
+// input: desired number of bytes, file:line of the caller
+// output: void* pointing to the zeroed memory or NULL
+void* Heap_CallocAt(int32_t desiredBytes, const char *site){
+  return heap_calloc(desiredBytes, site);
+}
+
+#define CMD_NEXT_LINE() \
+          UART_OutChar('\n'); \
+          UART_OutChar(CR);
+
+// what the walk visitors look for and what they found
+static uint32_t DebugId;
+static PCB_t* DebugProcess;
+static uint32_t DebugBlocks;
+static uint32_t DebugBytes;
+static int32_t DebugCorrupt;
+
+// exits that left blocks behind, oldest overwritten first
+static struct {
+  uint16_t id;
+  PCB_t* process;
+  uint32_t blocks;
+  uint32_t bytes;
+} LeakLog[HEAP_LEAKLOG];
+static uint32_t LeakCount;
+
+// call visit for every allocated block, in the kernel heap
+// and inside every arena, stops at a tag that makes no sense
+static void heap_debug_walk(heap_t* h, void (*visit)(int32_t* blockptr)) {
+  int32_t* mem = h->base;
+  uint32_t i = 0;
+  while(i < h->words) {
+    int32_t size = (mem[i] < 0) ? -mem[i] : mem[i];
+    if(size < MIN_BLOCK || i + size + 2 > h->words) {
+      DebugCorrupt++;
+      DebugBad = &mem[i + 1];
+      return;
+    }
+    if(mem[i] < 0) {
+      if(h == &KernelHeap && heap_is_arena(&mem[i + 1])) {
+        heap_debug_walk((heap_t*) &mem[i + 1], visit);
+      }
+      else {
+        visit(&mem[i + 1]);
+      }
+    }
+    i = i + size + 2;
+  }
+}
+
+static void heap_debug_check(int32_t* blockptr) {
+  if(heap_debug_bad(blockptr)) {
+    DebugCorrupt++;
+    DebugBad = blockptr;
+  }
+}
+
+static void heap_debug_count(int32_t* blockptr) {
+  heap_debug_t* debug = (heap_debug_t*) blockptr;
+  if((DebugId == HEAP_ANYTHREAD || debug->id == DebugId) &&
+     (DebugProcess == 0 || debug->process == DebugProcess)) {
+    DebugBlocks++;
+    DebugBytes += debug->words*sizeof(int32_t);
+  }
+}
+
+// walk the kernel heap, its arenas and every region
+static void heap_debug_walk_all(void (*visit)(int32_t* blockptr)) {
+  heap_debug_walk(&KernelHeap, visit);
+  for(uint32_t r = 0; r < RegionCount; r++) {
+    heap_debug_walk(Regions[r], visit);
+  }
+}
+
+static void heap_debug_print(int32_t* blockptr) {
+  heap_debug_t* debug = (heap_debug_t*) blockptr;
+  UART_OutString(debug->site != 0 ? (char*) debug->site : "?");
+  UART_OutChar(' ');
+  UART_OutUDec(debug->id);
+  UART_OutChar(' ');
+  UART_OutUHex((uint32_t) debug->process);
+  UART_OutChar(' ');
+  UART_OutUDec(debug->words*sizeof(int32_t));
+  CMD_NEXT_LINE();
+}
+
+
+//******** Heap_DebugSweep *************** 
+// check the tags and guard words of every allocated block
+// input: none
+// output: number of corrupted blocks
+int32_t Heap_DebugSweep(void){
+  OS_bWait(&heap);
+  DebugCorrupt = 0;
+  heap_debug_walk_all(heap_debug_check);
+  int32_t corrupt = DebugCorrupt;
+  heap_unlock();
+  return corrupt;
+}
+
+
+//******** Heap_DebugSweeper *************** 
+// thread OS_Init adds, sweeps every HEAP_SWEEP_MS and prints the
+// report the first time a sweep finds a corrupted block
+// input: none
+// output: none
+void Heap_DebugSweeper(void){
+  int reported = 0;
+  while(1) {
+    if(Heap_DebugSweep() != 0 && !reported) {
+      Heap_DebugReport();
+      reported = 1;
+    }
+    OS_Sleep(HEAP_SWEEP_MS);
+  }
+}
+
+
+// log the blocks a thread or process holds, called with the heap lock
+static void heap_debug_exit(uint32_t id, PCB_t* process) {
+  DebugId = id;
+  DebugProcess = process;
+  DebugBlocks = 0;
+  DebugBytes = 0;
+  heap_debug_walk_all(heap_debug_count);
+  if(DebugBlocks != 0) {
+    uint32_t entry = LeakCount%HEAP_LEAKLOG;
+    LeakLog[entry].id = id;
+    LeakLog[entry].process = process;
+    LeakLog[entry].blocks = DebugBlocks;
+    LeakLog[entry].bytes = DebugBytes;
+    LeakCount++;
+  }
+}
+
+
+//******** Heap_DebugExit *************** 
+// log the blocks a thread or process still holds when it exits
+// called by OS_Kill with interrupts disabled, so it never blocks: with
+// the heap lock taken the walk is queued for the holder's heap_unlock
+// input: thread ID or HEAP_ANYTHREAD, process PCB or NULL
+// output: none
+void Heap_DebugExit(uint32_t id, void *process){
+  long sr = StartCritical();
+  if(OS_bTryWait(&heap)) {
+    heap_debug_exit(id, process);
+    heap_unlock();
+  }
+  else if(DebugExitCount < DEBUG_EXITS) {
+    DebugExits[DebugExitCount].id = id;
+    DebugExits[DebugExitCount].process = process;
+    DebugExitCount++;
+  }
+  else {
+    DebugExitsLost++;
+  }
+  EndCritical(sr);
+}
+
+
+//******** Heap_DebugReport *************** 
+// sweep, then print the outstanding blocks and the exits that left blocks
+// input: none
+// output: none
+void Heap_DebugReport(void){
+  int32_t corrupt = Heap_DebugSweep();
+  UART_OutString("corrupt ");
+  UART_OutUDec(corrupt);
+  if(corrupt) {
+    UART_OutString(" last at ");
+    UART_OutUHex((uint32_t) DebugBad);
+  }
+  CMD_NEXT_LINE();
+  UART_OutString("site thread process bytes");
+  CMD_NEXT_LINE();
+  OS_bWait(&heap);
+  heap_debug_walk_all(heap_debug_print);
+  heap_unlock();
+  UART_OutString("exits with blocks: thread process blocks bytes");
+  CMD_NEXT_LINE();
+  if(DebugExitsLost != 0) {
+    UART_OutString("not walked ");
+    UART_OutUDec(DebugExitsLost);
+    CMD_NEXT_LINE();
+  }
+  uint32_t first = (LeakCount > HEAP_LEAKLOG) ? LeakCount - HEAP_LEAKLOG : 0;
+  for(uint32_t i = first; i < LeakCount; i++) {
+    uint32_t entry = i%HEAP_LEAKLOG;
+    UART_OutUDec(LeakLog[entry].id);
+    UART_OutChar(' ');
+    UART_OutUHex((uint32_t) LeakLog[entry].process);
+    UART_OutChar(' ');
+    UART_OutUDec(LeakLog[entry].blocks);
+    UART_OutChar(' ');
+    UART_OutUDec(LeakLog[entry].bytes);
+    CMD_NEXT_LINE();
+  }
+}
+#endif
@@ -14,6 +14,7 @@
 #define HEAP_H
 
 #include <stdint.h>
+#include "../RTOS_Labs_common/OSConfig.h"
 
 // struct for holding statistics on the state of the heap
 typedef struct heap_stats {
@@ -22,6 +23,53 @@ typedef struct heap_stats {
   uint32_t free;   // number of bytes available to allocate
 } heap_stats_t;
 
+#define HEAP_BUCKETS 8 // free block histogram: <16, <32, ... <1024, >=1024 bytes
+
+// extended statistics of one heap, sizes in bytes
+typedef struct heap_stats_ex {
+  uint32_t size;          // heap size
+  uint32_t used;          // allocated
+  uint32_t free;          // available to allocate
+  uint32_t largestFree;   // largest block, the biggest allocation that can succeed
+  uint32_t freeBlocks;    // number of free blocks
+  uint32_t histogram[HEAP_BUCKETS]; // free blocks by size
+  uint32_t fragmentation; // 0 (one free block) to 1000, 1000*(1 - largestFree/free)
+  uint32_t peakUsed;      // most bytes allocated at once since Heap_Init
+  uint32_t mallocs;       // successful Heap_Malloc/Heap_Calloc
+  uint32_t frees;         // Heap_Free calls
+  uint32_t reallocs;      // successful Heap_Realloc
+  uint32_t failures;      // allocations that found no room
+} heap_stats_ex_t;
+
+// free lists are segregated two levels deep, HEAP_FL classes by power of
+// two of the block size, each split in HEAP_SL linear subclasses
+#define HEAP_FL 14       // block sizes up to 2^16 words
+#define HEAP_SL 4
+#define HEAP_NIL 0xFFFF  // empty free list
+
+// allocation policies, HEAP_POLICY in OSConfig.h is the default
+#define HEAP_GOODFIT  0  // first block of the next larger class, constant time
+#define HEAP_FIRSTFIT 1  // lowest address that fits
+#define HEAP_NEXTFIT  2  // first fit from where the last allocation ended
+#define HEAP_BESTFIT  3  // smallest block that fits
+
+// a region managed by the heap, the kernel heap and each process arena
+typedef struct heap {
+  int32_t* base;   // first word of the region
+  uint32_t words;  // size of the region in 32-bit words
+  uint16_t flBitmap;          // bit f set if any list of class f is not empty
+  uint8_t slBitmap[HEAP_FL];  // bit s set if list [f][s] is not empty
+  uint16_t head[HEAP_FL][HEAP_SL]; // word index of the first free block, HEAP_NIL if none
+  uint16_t rover;  // next fit starts here, always on a block boundary
+  uint8_t policy;  // HEAP_GOODFIT, HEAP_FIRSTFIT, HEAP_NEXTFIT or HEAP_BESTFIT
+  uint32_t usedWords;  // allocated words, tags excluded
+  uint32_t peakWords;  // most allocated words since the heap was formatted
+  uint32_t mallocs;
+  uint32_t frees;
+  uint32_t reallocs;
+  uint32_t failures;
+} heap_t;
+
 
 /**
  * @details Initialize the Heap
@@ -54,8 +102,12 @@ void* Heap_Calloc(int32_t desiredBytes);
 
 
 /**
- * @details Reallocate buffer to a new size. The given block may be 
- *          unallocated and its contents copied to a new block
+ * @details Reallocate buffer to a new size. Shrinking and growing into
+ *          free neighbours happen in place, otherwise the given block is
+ *          unallocated and its contents copied to a new block. A NULL
+ *          oldBlock allocates like Heap_Malloc. A block from Heap_ISRMalloc
+ *          is copied to a heap block and goes back to its pool, so call
+ *          it from a thread
  * @param  oldBlock: pointer to a block
  * @param  desiredBytes: a desired number of bytes for a new block
  * @return void* pointing to the new block or will return NULL
@@ -84,4 +136,244 @@ int32_t Heap_Free(void* pointer);
 int32_t Heap_Stats(heap_stats_t *stats);
 
 
+/**
+ * @details Allocate memory whose address is a multiple of align, e.g.,
+ *          for DMA descriptors. Heap_Free releases it as usual, Heap_Realloc
+ *          may move it to an address that is only word aligned
+ * @param  desiredBytes: desired number of bytes to allocate
+ * @param  align: alignment in bytes, a power of 2
+ * @return void* pointing to the allocated memory or NULL
+ * @brief  Allocate aligned memory
+ */
+void* Heap_MallocAligned(int32_t desiredBytes, uint32_t align);
+
+
+/**
+ * @details Allocate from a given region with a given alignment
+ * @param  region: region from Heap_AddRegion, NULL for the heap of the running thread
+ * @param  desiredBytes: desired number of bytes to allocate
+ * @param  align: alignment in bytes, a power of 2, 4 or less for word alignment
+ * @return void* pointing to the allocated memory or NULL
+ * @brief  Allocate memory in a region
+ */
+void* Heap_MallocIn(heap_t *region, int32_t desiredBytes, uint32_t align);
+
+
+/**
+ * @details Manage another block of memory as a separate heap with its own
+ *          free lists and statistics (Heap_StatsEx). Heap_Free and
+ *          Heap_Realloc find the region of a block by its address
+ * @param  memory: word aligned memory, the descriptor is kept at its start
+ * @param  bytes: size of the memory, less than 256 KB
+ * @return heap_t* describing the region or NULL if the memory is too small
+ *         or HEAP_REGIONS regions exist already
+ * @brief  Add heap region
+ */
+heap_t* Heap_AddRegion(void *memory, uint32_t bytes);
+
+
+/**
+ * @details Allocate from the interrupt pools, fixed size classes set aside
+ *          by Heap_Init (HEAP_ISR_SIZEx in OSConfig.h). Never blocks and
+ *          takes bounded time, so interrupt handlers and periodic tasks can
+ *          call it. The block can be handed to a thread and released there,
+ *          or moved to the heap with Heap_Realloc. A full class spills into
+ *          the next larger one only. The classes are empty unless
+ *          HEAP_ISR_COUNTx are set, so this returns NULL by default
+ * @param  desiredBytes: desired number of bytes, at most HEAP_ISR_SIZE2
+ * @return void* pointing to the block or NULL if the fitting classes are empty
+ * @brief  Allocate memory from an interrupt
+ */
+void* Heap_ISRMalloc(int32_t desiredBytes);
+
+
+/**
+ * @details Return a block from Heap_ISRMalloc, never blocks. Heap_Free
+ *          also accepts these blocks
+ * @param  pointer: block from Heap_ISRMalloc
+ * @return 0 if everything is ok, non-zero if the block is not from the pools
+ * @brief  Free memory from an interrupt
+ */
+int32_t Heap_ISRFree(void* pointer);
+
+
+/**
+ * @details Extended statistics: largest free block, free block histogram,
+ *          fragmentation index, peak usage and operation counters
+ * @param  h: heap to examine, NULL for the kernel heap (arenas count as used)
+ * @param  stats: reference to a heap_stats_ex_t that returns the statistics
+ * @return 0 in case of success, non-zero in case of error (e.g. corrupted heap)
+ * @brief  Get heap fragmentation
+ */
+int32_t Heap_StatsEx(heap_t *h, heap_stats_ex_t *stats);
+
+
+/**
+ * @details Draw the kernel heap as a string, one character per equal slice:
+ *          '.' all free, '#' all allocated, ':' both, 'a' process arena
+ * @param  map: buffer of columns+1 characters, gets a 0-terminated string
+ * @param  columns: number of slices
+ * @return 0 in case of success
+ * @brief  Heap map
+ */
+int32_t Heap_Map(char map[], uint32_t columns);
+
+
+/**
+ * @details Choose how a heap picks the free block for an allocation. Every
+ *          policy works on the same blocks, so it can be changed at any time,
+ *          e.g., for the kernel heap right after OS_Init. Good fit takes a
+ *          few steps whatever the fragmentation (a request in the class of
+ *          the largest free blocks looks at no more than 4 of them, so it
+ *          can fail while a big enough block exists), first and next fit walk
+ *          the blocks, best fit walks one or two free lists
+ * @param  h: heap, NULL for the kernel heap
+ * @param  policy: HEAP_GOODFIT, HEAP_FIRSTFIT, HEAP_NEXTFIT or HEAP_BESTFIT
+ * @return 0 in case of success, 1 for an unknown policy
+ * @brief  Set allocation policy
+ */
+int32_t Heap_SetPolicy(heap_t *h, uint32_t policy);
+
+
+// Heap_Check results
+#define HEAP_CHECK_OK     0
+#define HEAP_CHECK_SIZE   1  // a block is too small or runs past the end
+#define HEAP_CHECK_TAGS   2  // the two tags of a block differ
+#define HEAP_CHECK_MERGE  3  // two free blocks are neighbours
+#define HEAP_CHECK_LIST   4  // a free list is broken or misses a free block
+#define HEAP_CHECK_BITMAP 5  // a bitmap disagrees with the free lists
+#define HEAP_CHECK_COUNT  6  // the used word count disagrees with the blocks
+#define HEAP_CHECK_ROVER  7  // the next fit rover is not on a block boundary
+
+/**
+ * @details Walk a heap and verify its invariants: tags match, blocks tile
+ *          the heap, free neighbours are merged, every free block is on the
+ *          list of its class and the counters agree with the blocks.
+ *          Takes time proportional to the square of the free blocks, meant
+ *          for tests and debugging
+ * @param  h: heap to check, NULL for the kernel heap, its arenas and every region
+ * @return HEAP_CHECK_OK (0) if consistent, else the first check that failed
+ * @brief  Check heap consistency
+ */
+int32_t Heap_Check(heap_t *h);
+
+
+/**
+ * @details Carve a process arena out of the kernel heap. Heap_Malloc calls
+ *          made by threads of a process that owns an arena are served from it
+ * @param  bytes: usable size of the arena in bytes
+ * @return heap_t* describing the arena or NULL if the kernel heap has no room
+ *         or HEAP_ARENAS arenas are live already
+ * @brief  Create process arena
+ */
+heap_t* Heap_CreateArena(uint32_t bytes);
+
+
+/**
+ * @details Return a whole process arena to the kernel heap, including
+ *          every block still allocated in it
+ * @param  arena: arena returned by Heap_CreateArena
+ * @return 0 in case of success
+ * @brief  Release process arena
+ */
+int32_t Heap_DestroyArena(heap_t *arena);
+
+
+/**
+ * @details Heap_Free that never blocks, for callers that cannot wait for
+ *          the heap lock, e.g., OS_Kill with interrupts disabled. If
+ *          another thread holds the lock, the block is queued and freed
+ *          by that thread when it releases the lock
+ * @param  pointer: pointer to memory from Heap_Malloc, NULL is ignored
+ * @brief  Free without blocking
+ */
+void Heap_Release(void* pointer);
+
+
+/**
+ * @details Heap_DestroyArena that never blocks, see Heap_Release
+ * @param  arena: arena returned by Heap_CreateArena
+ * @brief  Release process arena without blocking
+ */
+void Heap_ReleaseArena(heap_t *arena);
+
+
+#if HEAP_DEBUG
+// Debug heap: each block carries a guard word, the allocating thread,
+// process and call site in front of the data and a guard word behind it.
+// Heap_Malloc and Heap_Calloc record the file and line of the caller.
+
+#define HEAP_ANYTHREAD 0xFFFF // Heap_DebugExit for a whole process
+
+#define HEAP_STRING(x) #x
+#define HEAP_LINE(x) HEAP_STRING(x)
+#define HEAP_HERE __FILE__ ":" HEAP_LINE(__LINE__)
+#define Heap_Malloc(desiredBytes) Heap_MallocAt((desiredBytes), HEAP_HERE)
+#define Heap_Calloc(desiredBytes) Heap_CallocAt((desiredBytes), HEAP_HERE)
+
+
+/**
+ * @details Heap_Malloc that records a call site
+ * @param  desiredBytes: desired number of bytes to allocate
+ * @param  site: constant string naming the caller
+ * @return void* pointing to the allocated memory or NULL
+ * @brief  Allocate memory, debug heap
+ */
+void* Heap_MallocAt(int32_t desiredBytes, const char *site);
+
+
+/**
+ * @details Heap_Calloc that records a call site
+ * @param  desiredBytes: desired number of bytes to allocate
+ * @param  site: constant string naming the caller
+ * @return void* pointing to the zeroed memory or NULL
+ * @brief  Zero-allocate memory, debug heap
+ */
+void* Heap_CallocAt(int32_t desiredBytes, const char *site);
+
+
+/**
+ * @details Check the tags and guard words of every allocated block, in the
+ *          kernel heap and in every process arena. Heap_DebugSweeper
+ *          calls it periodically
+ * @param  none
+ * @return number of corrupted blocks, the last one is shown by Heap_DebugReport
+ * @brief  Heap integrity sweep
+ */
+int32_t Heap_DebugSweep(void);
+
+
+/**
+ * @details Low priority thread OS_Init adds when HEAP_SWEEP_MS is not 0:
+ *          runs Heap_DebugSweep every HEAP_SWEEP_MS and prints
+ *          Heap_DebugReport the first time it finds a corrupted block
+ * @param  none
+ * @return none
+ * @brief  Periodic heap integrity sweep
+ */
+void Heap_DebugSweeper(void);
+
+
+/**
+ * @details Log the blocks still allocated by a thread or a process when it
+ *          exits, called by OS_Kill with interrupts disabled. Never blocks,
+ *          if the heap lock is taken the walk waits until it is let go
+ * @param  id: thread ID, HEAP_ANYTHREAD to count every thread of the process
+ * @param  process: PCB of the process, NULL to count the thread in any process
+ * @return none
+ * @brief  Record leaks at exit
+ */
+void Heap_DebugExit(uint32_t id, void *process);
+
+
+/**
+ * @details Sweep the heap, then print every outstanding block (call site,
+ *          thread, process, bytes) and the exits that left blocks behind
+ * @param  none
+ * @return none
+ * @brief  Print leak report
+ */
+void Heap_DebugReport(void);
+#endif
+
 #endif //#ifndef HEAP_H
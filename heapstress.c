@@ -0,0 +1,316 @@
+// filename *************************heapstress.c ************************
+// Heap stress test and throughput benchmark
+// Every live block is filled with a pattern that starts at its own
+// fill byte, so a block that overlaps another or is moved without its
+// data no longer matches. Only the heap calls themselves are timed.
+// The workloads run on a region of their own, the kernel heap and its
+// policy are left alone.
+#include <stdint.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/heap.h"
+#include "../RTOS_Labs_common/UART0int.h"
+#include "../RTOS_Labs_common/heapstress.h"
+
+#define CMD_NEXT_LINE() \
+          UART_OutChar('\n'); \
+          UART_OutChar(CR);
+
+#define CYCLES_PER_SECOND 80000000 // OS_Time units
+#define STRESS_OPS 2000            // random calls made by HeapStress_Run
+#define STRESS_REPEAT 50           // trace replays made by HeapStress_Run
+
+static struct {
+  uint8_t* data;   // NULL if the slot is empty
+  uint32_t bytes;
+  uint8_t fill;    // first byte of the pattern
+} Slot[HEAPSTRESS_SLOTS];
+static heap_t* Region; // heap under test
+static uint32_t Seed;
+static uint8_t Fill;  // next fill byte, changes from block to block
+static int32_t RunMemory[HEAPSTRESS_WORDS]; // region of HeapStress_Run
+static heap_t* RunRegion;
+
+//---------- trace -----------------
+// shell commands, web requests and file transfers, the way they
+// use the heap: large buffers, small tokens, growing receive buffers
+const heap_trace_op_t HeapStressTrace[] = {
+  {HEAPOP_CALLOC, 0, 1500}, {HEAPOP_CALLOC, 1, 1500},   // fprint buffers
+  {HEAPOP_MALLOC, 2, 32}, {HEAPOP_FREE, 2, 0},
+  {HEAPOP_FREE, 0, 0}, {HEAPOP_FREE, 1, 0},
+  {HEAPOP_MALLOC, 3, 256}, {HEAPOP_MALLOC, 4, 24},      // web request
+  {HEAPOP_MALLOC, 5, 40}, {HEAPOP_REALLOC, 3, 512},
+  {HEAPOP_MALLOC, 6, 16}, {HEAPOP_FREE, 4, 0},
+  {HEAPOP_MALLOC, 7, 384}, {HEAPOP_FREE, 5, 0},
+  {HEAPOP_REALLOC, 3, 1024}, {HEAPOP_FREE, 6, 0},
+  {HEAPOP_FREE, 3, 0}, {HEAPOP_FREE, 7, 0},
+  {HEAPOP_MALLOC, 8, 512}, {HEAPOP_MALLOC, 9, 12},      // file transfer
+  {HEAPOP_MALLOC, 10, 512}, {HEAPOP_FREE, 9, 0},
+  {HEAPOP_MALLOC, 11, 8}, {HEAPOP_REALLOC, 10, 64},
+  {HEAPOP_FREE, 8, 0}, {HEAPOP_MALLOC, 12, 200},
+  {HEAPOP_FREE, 11, 0}, {HEAPOP_REALLOC, 12, 700},
+  {HEAPOP_MALLOC, 13, 48}, {HEAPOP_FREE, 10, 0},
+  {HEAPOP_MALLOC, 14, 96}, {HEAPOP_FREE, 13, 0},
+  {HEAPOP_REALLOC, 14, 20}, {HEAPOP_FREE, 12, 0},
+  {HEAPOP_CALLOC, 15, 128}, {HEAPOP_FREE, 14, 0},        // long lived table
+};
+const uint32_t HeapStressTraceLength = sizeof(HeapStressTrace)/sizeof(HeapStressTrace[0]);
+
+//---------- helpers -----------------
+// linear congruential generator, the same on the board and a host
+static uint32_t stress_random(void) {
+  Seed = 1664525*Seed + 1013904223;
+  return Seed >> 8;
+}
+
+// add the time of one heap call to the result
+static void stress_time(heap_stress_result_t *result, uint32_t start) {
+  uint32_t time = OS_TimeDifference(start, OS_Time());
+  uint32_t b = 0;
+  for(uint32_t x = time >> 7; x > 0 && b < HEAPSTRESS_BUCKETS - 1; x >>= 1) {
+    b++;
+  }
+  result->histogram[b]++;
+  result->ops++;
+  result->cycles += time;
+  if(time > result->max) {
+    result->max = time;
+  }
+}
+
+// 1 if the first bytes of a slot still hold its pattern
+static int stress_intact(uint32_t slot, uint32_t bytes) {
+  for(uint32_t k = 0; k < bytes; k++) {
+    if(Slot[slot].data[k] != (uint8_t)(Slot[slot].fill + k)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void stress_fill(uint32_t slot) {
+  Slot[slot].fill = Fill;
+  Fill += 13;
+  for(uint32_t k = 0; k < Slot[slot].bytes; k++) {
+    Slot[slot].data[k] = (uint8_t)(Slot[slot].fill + k);
+  }
+}
+
+static void stress_error(heap_stress_result_t *result, int32_t check) {
+  if(result->errors == 0) {
+    result->firstError = result->ops;
+    result->check = check;
+  }
+  result->errors++;
+}
+
+// every live block holds its pattern and the heap is consistent
+static void stress_verify(heap_stress_result_t *result) {
+  heap_stats_ex_t stats;
+  Heap_StatsEx(Region, &stats);
+  if(stats.fragmentation > result->worstFragmentation) {
+    result->worstFragmentation = stats.fragmentation;
+  }
+  for(uint32_t s = 0; s < HEAPSTRESS_SLOTS; s++) {
+    if(Slot[s].data != 0 && !stress_intact(s, Slot[s].bytes)) {
+      stress_error(result, -1);
+      Slot[s].data = 0;  // do not report it again, the block is leaked
+    }
+  }
+  int32_t check = Heap_Check(Region);
+  if(check != HEAP_CHECK_OK) {
+    stress_error(result, check);
+  }
+}
+
+// one heap call on a slot, a call that does not fit the state of the
+// slot frees or allocates first
+static void stress_op(heap_stress_result_t *result, uint32_t op, uint32_t slot, uint32_t bytes) {
+  uint8_t* data = Slot[slot].data;
+  uint32_t start;
+  if(op == HEAPOP_FREE) {
+    if(data != 0) {
+      start = OS_Time();
+      Heap_Free(data);
+      stress_time(result, start);
+      Slot[slot].data = 0;
+    }
+    return;
+  }
+  if(op != HEAPOP_REALLOC && data != 0) {
+    stress_op(result, HEAPOP_FREE, slot, 0);
+  }
+  start = OS_Time();
+  if(op == HEAPOP_REALLOC && data != 0) {
+    data = Heap_Realloc(data, bytes);  // finds the region by the address
+  }
+  else {
+    // Heap_Calloc has no region version, zero the block like it does
+    data = Heap_MallocIn(Region, bytes, 4);
+    if(op == HEAPOP_CALLOC && data != 0) {
+      for(uint32_t k = 0; k < bytes; k++) {
+        data[k] = 0;
+      }
+    }
+  }
+  stress_time(result, start);
+  if(data == 0) {
+    result->failures++;   // a failed realloc keeps the old block
+    return;
+  }
+  if(op == HEAPOP_REALLOC && Slot[slot].data != 0) {
+    // the data up to the smaller size moved with the block
+    Slot[slot].data = data;
+    if(!stress_intact(slot, (bytes < Slot[slot].bytes) ? bytes : Slot[slot].bytes)) {
+      stress_error(result, -1);
+    }
+  }
+  Slot[slot].data = data;
+  Slot[slot].bytes = bytes;
+  stress_fill(slot);
+}
+
+static void stress_start(heap_t *region, heap_stress_result_t *result) {
+  Region = region;
+  result->ops = 0;
+  result->failures = 0;
+  result->errors = 0;
+  result->firstError = 0;
+  result->check = HEAP_CHECK_OK;
+  result->cycles = 0;
+  result->max = 0;
+  result->worstFragmentation = 0;
+  for(int b = 0; b < HEAPSTRESS_BUCKETS; b++) {
+    result->histogram[b] = 0;
+  }
+  for(int s = 0; s < HEAPSTRESS_SLOTS; s++) {
+    Slot[s].data = 0;
+  }
+}
+
+// free what is left, final statistics
+static int stress_end(heap_stress_result_t *result) {
+  heap_stats_ex_t stats;
+  Heap_StatsEx(Region, &stats);
+  result->fragmentation = stats.fragmentation;
+  for(uint32_t s = 0; s < HEAPSTRESS_SLOTS; s++) {
+    stress_op(result, HEAPOP_FREE, s, 0);
+  }
+  stress_verify(result);
+  result->opsPerSecond = (result->cycles == 0) ? 0 :
+    (uint32_t)(((uint64_t)result->ops*CYCLES_PER_SECOND)/result->cycles);
+  return (result->errors != 0);
+}
+
+//---------- HeapStress_Random-----------------
+// Random workload, the same seed gives the same calls
+// Input: region from Heap_AddRegion, random seed, number of heap calls,
+//        place to return the statistics
+// Output: 0 if no error was found, 1 otherwise
+int HeapStress_Random(heap_t *region, uint32_t seed, uint32_t ops, heap_stress_result_t *result){
+  stress_start(region, result);
+  Seed = seed;
+  while(result->ops < ops) {
+    uint32_t slot = stress_random()%HEAPSTRESS_SLOTS;
+    uint32_t op;
+    if(Slot[slot].data == 0) {
+      op = (stress_random()%4 == 0) ? HEAPOP_CALLOC : HEAPOP_MALLOC;
+    }
+    else {
+      op = (stress_random()%3 == 0) ? HEAPOP_REALLOC : HEAPOP_FREE;
+    }
+    // mostly small blocks, now and then a buffer, one draw per
+    // statement so every compiler makes the same calls for a seed
+    uint32_t limit = (stress_random()%8 == 0) ? 1024 : 64;
+    uint32_t bytes = 1 + stress_random()%limit;
+    stress_op(result, op, slot, bytes);
+    stress_verify(result);
+  }
+  return stress_end(result);
+}
+
+//---------- HeapStress_Trace-----------------
+// Replay a trace repeat times
+// Input: region from Heap_AddRegion, operations, their number,
+//        number of replays, place to return the statistics
+// Output: 0 if no error was found, 1 otherwise
+int HeapStress_Trace(heap_t *region, const heap_trace_op_t trace[], uint32_t length,
+  uint32_t repeat, heap_stress_result_t *result){
+  stress_start(region, result);
+  for(uint32_t r = 0; r < repeat; r++) {
+    for(uint32_t i = 0; i < length; i++) {
+      stress_op(result, trace[i].op, trace[i].slot%HEAPSTRESS_SLOTS, trace[i].bytes);
+      stress_verify(result);
+    }
+  }
+  return stress_end(result);
+}
+
+static const char* const PolicyName[] = {"good", "first", "next", "best"};
+
+static void stress_print(uint32_t policy, const char *name, heap_stress_result_t *result) {
+  UART_OutString((char*) PolicyName[policy]);
+  UART_OutChar(' ');
+  UART_OutString((char*) name);
+  UART_OutChar(' ');
+  UART_OutUDec(result->ops);
+  UART_OutChar(' ');
+  UART_OutUDec(result->failures);
+  UART_OutChar(' ');
+  UART_OutUDec(result->errors);
+  UART_OutChar(' ');
+  UART_OutUDec(result->opsPerSecond);
+  UART_OutChar(' ');
+  UART_OutUDec(result->max);
+  UART_OutChar(' ');
+  UART_OutUDec(result->fragmentation);
+  UART_OutChar(' ');
+  UART_OutUDec(result->worstFragmentation);
+  CMD_NEXT_LINE();
+  UART_OutString(" latency");
+  for(int b = 0; b < HEAPSTRESS_BUCKETS; b++) {
+    UART_OutChar(' ');
+    UART_OutUDec(result->histogram[b]);
+  }
+  CMD_NEXT_LINE();
+  if(result->errors != 0) {
+    UART_OutString(" first error after op ");
+    UART_OutUDec(result->firstError);
+    UART_OutString(" check ");
+    if(result->check < 0) {
+      UART_OutString("data");
+    }
+    else {
+      UART_OutUDec(result->check);
+    }
+    CMD_NEXT_LINE();
+  }
+}
+
+//---------- HeapStress_Run-----------------
+// Run the random workload and HeapStressTrace under every
+// allocation policy of a region of its own, print the results
+// Input: random seed
+// Output: 0 if no error was found, 1 otherwise
+int HeapStress_Run(uint32_t seed){
+  heap_stress_result_t result;
+  int errors = 0;
+  if(RunRegion == 0) {
+    // regions can't be removed, later runs use the same one
+    RunRegion = Heap_AddRegion(RunMemory, sizeof(RunMemory));
+    if(RunRegion == 0) {
+      UART_OutString("heapstress: no free heap region");
+      CMD_NEXT_LINE();
+      return 1;
+    }
+  }
+  UART_OutString("policy test ops fail err ops/s max frag worst");
+  CMD_NEXT_LINE();
+  for(uint32_t policy = HEAP_GOODFIT; policy <= HEAP_BESTFIT; policy++) {
+    Heap_SetPolicy(RunRegion, policy);
+    errors |= HeapStress_Random(RunRegion, seed, STRESS_OPS, &result);
+    stress_print(policy, "random", &result);
+    errors |= HeapStress_Trace(RunRegion, HeapStressTrace, HeapStressTraceLength, STRESS_REPEAT, &result);
+    stress_print(policy, "trace", &result);
+  }
+  return errors;
+}
@@ -0,0 +1,106 @@
+/**
+ * @file      heapstress.h
+ * @brief     Heap stress test and throughput benchmark
+ * @details   Drives Heap_Malloc/Heap_Calloc/Heap_Realloc/Heap_Free with a
+ * seeded random workload or a recorded trace. After every operation the
+ * data of every live block is compared with the pattern written into it
+ * (overlapping blocks show up here) and Heap_Check verifies the tags, free
+ * lists and counters. Only the heap calls are timed, the result holds the
+ * throughput, a latency histogram and the fragmentation they led to.<br>
+ * Every workload runs on a region (Heap_AddRegion) of its own, so the
+ * kernel heap, its blocks and its policy are left alone.<br>
+ * The core only uses heap.h and OS_Time/OS_TimeDifference, so it also
+ * builds on a host, test/test_heapstress.c runs it on the simulated kernel
+ * to validate an allocator change before it goes on the board.
+ * @version   V1.0
+ * @date      Oct 19, 2026
+ ******************************************************************************/
+
+#ifndef HEAPSTRESS_H
+#define HEAPSTRESS_H
+
+#include <stdint.h>
+#include "../RTOS_Labs_common/heap.h"
+
+#define HEAPSTRESS_SLOTS 16   // blocks live at once
+#define HEAPSTRESS_WORDS 1024 // region HeapStress_Run stresses, 32-bit words
+#define HEAPSTRESS_BUCKETS 8  // latency histogram: <128, <256, ... <8192, >=8192 cycles
+
+// trace operations
+#define HEAPOP_MALLOC  0
+#define HEAPOP_CALLOC  1
+#define HEAPOP_REALLOC 2
+#define HEAPOP_FREE    3
+
+// one recorded heap call, the block is named by its slot
+typedef struct heap_trace_op {
+  uint8_t op;     // HEAPOP_
+  uint8_t slot;   // 0 to HEAPSTRESS_SLOTS-1
+  uint16_t bytes; // size for malloc, calloc and realloc
+} heap_trace_op_t;
+
+// struct for holding the result of one run, times in 12.5ns units
+typedef struct heap_stress_result {
+  uint32_t ops;         // heap calls made
+  uint32_t failures;    // allocations that returned NULL, not an error
+  uint32_t errors;      // corrupted data or failed Heap_Check
+  uint32_t firstError;  // operation the first error was found after
+  int32_t check;        // Heap_Check result at the first error
+  uint32_t cycles;      // time spent in the heap calls
+  uint32_t opsPerSecond;
+  uint32_t max;         // slowest call
+  uint32_t histogram[HEAPSTRESS_BUCKETS];
+  uint32_t fragmentation; // Heap_StatsEx before the blocks are freed, 0-1000
+  uint32_t worstFragmentation; // highest after any call
+} heap_stress_result_t;
+
+// a trace in the pattern of the shell, web server and file paths,
+// HeapStressTraceLength ops
+extern const heap_trace_op_t HeapStressTrace[];
+extern const uint32_t HeapStressTraceLength;
+
+
+/**
+ * @details Random workload, the same seed gives the same calls.
+ *          Frees every block it allocated before returning
+ * @param  region: empty region from Heap_AddRegion to stress
+ * @param  seed: random seed
+ * @param  ops: number of heap calls
+ * @param  result: reference to a heap_stress_result_t that returns the statistics
+ * @return 0 if no error was found, 1 otherwise
+ * @brief  Random heap stress
+ */
+int HeapStress_Random(heap_t *region, uint32_t seed, uint32_t ops, heap_stress_result_t *result);
+
+
+/**
+ * @details Replay a trace repeat times. A call that does not fit the state
+ *          of its slot still works: malloc of a full slot frees it first,
+ *          realloc of an empty one allocates and free of an empty one is
+ *          skipped, so any trace can be replayed.
+ *          Frees every block it allocated before returning
+ * @param  region: empty region from Heap_AddRegion to stress
+ * @param  trace: operations to replay
+ * @param  length: number of operations in the trace
+ * @param  repeat: number of replays
+ * @param  result: reference to a heap_stress_result_t that returns the statistics
+ * @return 0 if no error was found, 1 otherwise
+ * @brief  Trace heap stress
+ */
+int HeapStress_Trace(heap_t *region, const heap_trace_op_t trace[], uint32_t length,
+  uint32_t repeat, heap_stress_result_t *result);
+
+
+/**
+ * @details Run the random workload and HeapStressTrace under every
+ *          allocation policy and print the results on the UART, so the
+ *          policies can be compared on a product's own workload.
+ *          The first run adds a region of HEAPSTRESS_WORDS words, later
+ *          runs reuse it
+ * @param  seed: random seed
+ * @return 0 if no error was found, 1 otherwise or if no region was left
+ * @brief  Compare heap policies
+ */
+int HeapStress_Run(uint32_t seed);
+
+#endif //#ifndef HEAPSTRESS_H
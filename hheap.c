@@ -0,0 +1,354 @@
+// filename *************************hheap.c ************************
+// Handle based compacting heap
+// Blocks are reached through a handle table, so a block that is not
+// locked can be moved and the free space slid together. Nothing links
+// the blocks, every block starts with a one word header and the next
+// block follows right after its data.
+#include <stdint.h>
+#include <string.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/heap.h"
+#include "../RTOS_Labs_common/hheap.h"
+
+// HHEAP_HANDLES and HHEAP_STEP are in OSConfig.h
+
+/*
+Block header, one word in front of the data of every block
+bits 15-0  size of the data in words, 0 is a header only free block
+bits 31-16 index in the handle table, HH_FREE for a free block
+*/
+#define HH_FREE 0xFFFF
+#define HH_SIZE(header) ((header) & 0xFFFF)
+#define HH_SLOT(header) ((header) >> 16)
+#define HH_HEADER(slot, size) (((uint32_t)(slot) << 16) | (size))
+
+static uint32_t* HBase;   // first header
+static uint32_t HWords;   // size of the heap in words
+static uint32_t Hole;     // no free block below this word
+static uint16_t Block[HHEAP_HANDLES]; // header of each handle's block, HH_FREE if unused
+static uint8_t Locks[HHEAP_HANDLES];  // lock count of each handle
+static uint32_t UsedWords, PeakWords, Allocs, Frees, Failures;
+static Sema4Type hheap;
+
+// table index of a handle, HH_FREE if it is not in use
+static uint32_t hheap_slot(hhandle_t handle) {
+  if(handle == HHEAP_NONE || handle > HHEAP_HANDLES || Block[handle - 1] == HH_FREE) {
+    return HH_FREE;
+  }
+  return handle - 1;
+}
+
+// free block at i absorbs the free blocks right after it
+static void hheap_merge(uint32_t i) {
+  uint32_t next = i + HH_SIZE(HBase[i]) + 1;
+  while(next < HWords && HH_SLOT(HBase[next]) == HH_FREE) {
+    next = next + HH_SIZE(HBase[next]) + 1;
+  }
+  HBase[i] = HH_HEADER(HH_FREE, next - i - 1);
+}
+
+// first free block from Hole up with at least size words, HWords if none
+// caller holds the lock
+static uint32_t hheap_fit(uint32_t size) {
+  uint32_t i = Hole;
+  int first = 1;
+  while(i < HWords) {
+    if(HH_SLOT(HBase[i]) == HH_FREE) {
+      hheap_merge(i);
+      if(first) {
+        Hole = i;
+        first = 0;
+      }
+      if(HH_SIZE(HBase[i]) >= size) {
+        return i;
+      }
+    }
+    i = i + HH_SIZE(HBase[i]) + 1;
+  }
+  if(first) {
+    Hole = HWords;
+  }
+  return HWords;
+}
+
+// slide unlocked blocks down over the free space, at least one move
+// output: words copied, 0 if there is nothing left to move
+// caller holds the lock
+static uint32_t hheap_compact(uint32_t maxWords) {
+  uint32_t moved = 0;
+  uint32_t i = Hole;
+  int pinned = 0;   // a locked block sits above a free one
+  while(i < HWords) {
+    if(HH_SLOT(HBase[i]) != HH_FREE) {
+      i = i + HH_SIZE(HBase[i]) + 1;
+      continue;
+    }
+    hheap_merge(i);
+    if(!pinned) {
+      Hole = i;
+    }
+    uint32_t next = i + HH_SIZE(HBase[i]) + 1;
+    if(next == HWords) {
+      break;        // the free space is at the end
+    }
+    uint32_t slot = HH_SLOT(HBase[next]);
+    uint32_t size = HH_SIZE(HBase[next]);
+    if(Locks[slot] != 0) {
+      pinned = 1;   // leave the hole, try the next one
+      i = next + size + 1;
+      continue;
+    }
+    if(moved != 0 && moved + size + 1 > maxWords) {
+      return moved;
+    }
+    uint32_t gap = next - i;
+    memmove(&HBase[i], &HBase[next], (size + 1)*sizeof(uint32_t));
+    Block[slot] = i;
+    i = i + size + 1;
+    HBase[i] = HH_HEADER(HH_FREE, gap - 1);
+    moved = moved + size + 1;
+  }
+  if(!pinned) {
+    Hole = i;
+  }
+  return moved;
+}
+
+//******** HHeap_Init *************** 
+// Initialize the handle heap, every handle becomes free
+// input: word aligned storage, NULL to take it from the kernel heap,
+//        size in bytes
+// output: 0 in case of success, 1 if the kernel heap has no room
+int32_t HHeap_Init(void *memory, uint32_t bytes){
+  uint32_t words = bytes/sizeof(uint32_t);
+  if(words < 2 || words > HH_FREE) {
+    return 1;
+  }
+  if(memory == 0) {
+    memory = Heap_Malloc(words*sizeof(uint32_t));
+    if(memory == 0) {
+      return 1;
+    }
+  }
+  HBase = (uint32_t*) memory;
+  HWords = words;
+  HBase[0] = HH_HEADER(HH_FREE, words - 1);
+  Hole = 0;
+  for(uint32_t h = 0; h < HHEAP_HANDLES; h++) {
+    Block[h] = HH_FREE;
+    Locks[h] = 0;
+  }
+  UsedWords = PeakWords = Allocs = Frees = Failures = 0;
+  OS_InitSemaphore(&hheap, 1);
+  OS_NameSemaphore(&hheap, "hheap");
+  return 0;
+}
+
+
+//******** HHeap_Alloc *************** 
+// Allocate a movable block, data not initialized
+// input: desired number of bytes to allocate
+// output: handle of the block, HHEAP_NONE if there is no room or no free handle
+// notes: compacts in steps of HHEAP_STEP words before giving up,
+//   letting go of the lock between steps
+hhandle_t HHeap_Alloc(int32_t desiredBytes){
+  if(desiredBytes < 0) {
+    return HHEAP_NONE;
+  }
+  uint32_t size = (desiredBytes + sizeof(uint32_t) - 1)/sizeof(uint32_t);
+  uint32_t slot, i;
+  OS_bWait(&hheap);
+  while(1) {
+    slot = 0;
+    while(slot < HHEAP_HANDLES && Block[slot] != HH_FREE) {
+      slot++;
+    }
+    i = HWords;
+    if(slot < HHEAP_HANDLES) {
+      i = hheap_fit(size);
+    }
+    if(i != HWords || slot == HHEAP_HANDLES || hheap_compact(HHEAP_STEP) == 0) {
+      break;
+    }
+    // waiting threads get the lock between two steps
+    OS_bSignal(&hheap);
+    OS_bWait(&hheap);
+  }
+  if(i == HWords) {
+    Failures++;
+    OS_bSignal(&hheap);
+    return HHEAP_NONE;
+  }
+  uint32_t available = HH_SIZE(HBase[i]);
+  if(available > size) {
+    // the rest becomes a free block, a lone header at the least
+    HBase[i + size + 1] = HH_HEADER(HH_FREE, available - size - 1);
+  }
+  else {
+    size = available;
+  }
+  HBase[i] = HH_HEADER(slot, size);
+  Block[slot] = i;
+  Locks[slot] = 0;
+  UsedWords += size;
+  if(UsedWords > PeakWords) {
+    PeakWords = UsedWords;
+  }
+  Allocs++;
+  OS_bSignal(&hheap);
+  return slot + 1;
+}
+
+
+//******** HHeap_Free *************** 
+// Free a block, it must be unlocked
+// input: handle from HHeap_Alloc
+// output: 0 in case of success, 1 for a bad or locked handle
+int32_t HHeap_Free(hhandle_t handle){
+  OS_bWait(&hheap);
+  uint32_t slot = hheap_slot(handle);
+  if(slot == HH_FREE || Locks[slot] != 0) {
+    OS_bSignal(&hheap);
+    return 1;
+  }
+  uint32_t i = Block[slot];
+  UsedWords -= HH_SIZE(HBase[i]);
+  HBase[i] = HH_HEADER(HH_FREE, HH_SIZE(HBase[i]));
+  Block[slot] = HH_FREE;
+  if(i < Hole) {
+    Hole = i;
+  }
+  Frees++;
+  OS_bSignal(&hheap);
+  return 0;
+}
+
+
+//******** HHeap_Lock *************** 
+// Pin a block and get its address, locks nest
+// input: handle from HHeap_Alloc
+// output: pointer to the data, valid until the last HHeap_Unlock,
+//         NULL for a bad handle
+void* HHeap_Lock(hhandle_t handle){
+  OS_bWait(&hheap);
+  uint32_t slot = hheap_slot(handle);
+  if(slot == HH_FREE || Locks[slot] == 0xFF) {
+    OS_bSignal(&hheap);
+    return 0;
+  }
+  Locks[slot]++;
+  void* data = &HBase[Block[slot] + 1];
+  OS_bSignal(&hheap);
+  return data;
+}
+
+
+//******** HHeap_Unlock *************** 
+// Release one HHeap_Lock
+// input: handle from HHeap_Alloc
+// output: 0 in case of success, 1 for a bad or unlocked handle
+int32_t HHeap_Unlock(hhandle_t handle){
+  OS_bWait(&hheap);
+  uint32_t slot = hheap_slot(handle);
+  if(slot == HH_FREE || Locks[slot] == 0) {
+    OS_bSignal(&hheap);
+    return 1;
+  }
+  Locks[slot]--;
+  OS_bSignal(&hheap);
+  return 0;
+}
+
+
+//******** HHeap_Size *************** 
+// Size of a block
+// input: handle from HHeap_Alloc
+// output: bytes usable in the block, 0 for a bad handle
+uint32_t HHeap_Size(hhandle_t handle){
+  uint32_t bytes = 0;
+  OS_bWait(&hheap);
+  uint32_t slot = hheap_slot(handle);
+  if(slot != HH_FREE) {
+    bytes = HH_SIZE(HBase[Block[slot]])*sizeof(uint32_t);
+  }
+  OS_bSignal(&hheap);
+  return bytes;
+}
+
+
+//******** HHeap_Compact *************** 
+// One bounded compaction step
+// input: copy budget in words, a single block is always moved whole
+// output: 1 if blocks were moved, 0 if there was nothing left to move
+int32_t HHeap_Compact(uint32_t maxWords){
+  OS_bWait(&hheap);
+  uint32_t moved = hheap_compact(maxWords);
+  OS_bSignal(&hheap);
+  return (moved != 0);
+}
+
+
+//******** HHeap_Compactor *************** 
+// Thread that compacts in steps of HHEAP_STEP words,
+// add it at the lowest priority
+// input: none
+// output: none, never returns
+void HHeap_Compactor(void){
+  while(1) {
+    if(HHeap_Compact(HHEAP_STEP)) {
+      OS_Suspend();   // let anything that became ready run
+    }
+    else {
+      OS_Sleep(100);  // nothing to move
+    }
+  }
+}
+
+
+//******** HHeap_Stats *************** 
+// Statistics of the handle heap
+// input: structure to fill
+// output: 0 in case of success, 1 if the block chain is broken
+int32_t HHeap_Stats(heap_stats_ex_t *stats){
+  uint32_t i = 0;
+  stats->used = 0;
+  stats->free = 0;
+  stats->largestFree = 0;
+  stats->freeBlocks = 0;
+  for(int b = 0; b < HEAP_BUCKETS; b++) {
+    stats->histogram[b] = 0;
+  }
+  OS_bWait(&hheap);
+  while(i < HWords) {
+    uint32_t bytes = HH_SIZE(HBase[i])*sizeof(uint32_t);
+    if(HH_SLOT(HBase[i]) == HH_FREE) {
+      hheap_merge(i);
+      bytes = HH_SIZE(HBase[i])*sizeof(uint32_t);
+      // bucket 0 is below 16 bytes, each next one doubles
+      uint32_t b = 0;
+      for(uint32_t x = bytes >> 3; x > 1; x >>= 1) {
+        b++;
+      }
+      stats->histogram[(b < HEAP_BUCKETS) ? b : HEAP_BUCKETS - 1]++;
+      stats->free += bytes;
+      stats->freeBlocks++;
+      if(bytes > stats->largestFree) {
+        stats->largestFree = bytes;
+      }
+    }
+    else {
+      stats->used += bytes;
+    }
+    i = i + bytes/sizeof(uint32_t) + 1;
+  }
+  stats->size = HWords*sizeof(uint32_t);
+  stats->peakUsed = PeakWords*sizeof(uint32_t);
+  stats->mallocs = Allocs;
+  stats->frees = Frees;
+  stats->reallocs = 0;
+  stats->failures = Failures;
+  OS_bSignal(&hheap);
+  stats->fragmentation = (stats->free == 0) ? 0 : 
+    1000 - (uint32_t)(((uint64_t)stats->largestFree*1000)/stats->free);
+  return (i == HWords) ? 0 : 1;
+}
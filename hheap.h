@@ -0,0 +1,118 @@
+/**
+ * @file      hheap.h
+ * @brief     Handle based compacting heap
+ * @details   Long lived variable size buffers (network and file paths)
+ * fragment heap.c until large requests fail. Memory from this heap is
+ * reached through a handle: HHeap_Lock gives a pointer that stays valid
+ * until the matching HHeap_Unlock, and unlocked blocks can be moved.<br>
+ * HHeap_Compact slides unlocked blocks down over the free space a few words
+ * at a time, HHeap_Compactor runs it from a low priority thread so it only
+ * works in idle time. An allocation that finds no block large enough
+ * compacts in the same bounded steps, letting go of the lock in between,
+ * so it only fails when the free space in total is too small or locked
+ * blocks split it, and no thread waits for more than one step.
+ * @version   V1.0
+ * @date      Oct 19, 2026
+ ******************************************************************************/
+
+#ifndef HHEAP_H
+#define HHEAP_H
+
+#include <stdint.h>
+#include "../RTOS_Labs_common/heap.h"
+
+typedef uint16_t hhandle_t;
+#define HHEAP_NONE 0  // no handle, returned when an allocation fails
+
+
+/**
+ * @details Initialize the handle heap, every handle becomes free
+ * @param  memory: word aligned storage, NULL to take it from the kernel heap
+ * @param  bytes: size of the storage, less than 256 KB
+ * @return 0 in case of success, 1 if the kernel heap has no room
+ * @brief  Initializes the handle heap
+ */
+int32_t HHeap_Init(void *memory, uint32_t bytes);
+
+
+/**
+ * @details Allocate a movable block, data not initialized. Without a
+ *          large enough free block it compacts HHEAP_STEP words at a time
+ *          until one forms or nothing is left to move
+ * @param  desiredBytes: desired number of bytes to allocate
+ * @return handle of the block, HHEAP_NONE if there is no room or no free handle
+ * @brief  Allocate a movable block
+ */
+hhandle_t HHeap_Alloc(int32_t desiredBytes);
+
+
+/**
+ * @details Free a block, it must be unlocked
+ * @param  handle: handle from HHeap_Alloc
+ * @return 0 in case of success, 1 for a bad or locked handle
+ * @brief  Free a movable block
+ */
+int32_t HHeap_Free(hhandle_t handle);
+
+
+/**
+ * @details Pin a block and get its address, locks nest
+ * @param  handle: handle from HHeap_Alloc
+ * @return pointer to the data, valid until the last HHeap_Unlock,
+ *         NULL for a bad handle
+ * @brief  Lock a block in place
+ */
+void* HHeap_Lock(hhandle_t handle);
+
+
+/**
+ * @details Release one HHeap_Lock, the compactor may move the block
+ *          once it is unlocked as often as it was locked
+ * @param  handle: handle from HHeap_Alloc
+ * @return 0 in case of success, 1 for a bad or unlocked handle
+ * @brief  Unlock a block
+ */
+int32_t HHeap_Unlock(hhandle_t handle);
+
+
+/**
+ * @details Size of a block
+ * @param  handle: handle from HHeap_Alloc
+ * @return bytes usable in the block, 0 for a bad handle
+ * @brief  Size of a movable block
+ */
+uint32_t HHeap_Size(hhandle_t handle);
+
+
+/**
+ * @details One bounded compaction step, moves unlocked blocks down over
+ *          the free space until about maxWords words were copied. A single
+ *          block is always moved whole, so a step can copy more
+ * @param  maxWords: copy budget of the step
+ * @return 1 if blocks were moved, 0 if there was nothing left to move
+ * @brief  Compact the handle heap
+ */
+int32_t HHeap_Compact(uint32_t maxWords);
+
+
+/**
+ * @details Thread that compacts in steps of HHEAP_STEP words, add it at
+ *          the lowest priority so it only runs when nothing else is ready,
+ *          e.g., OS_AddThread(&HHeap_Compactor, 128, 7)
+ * @param  none
+ * @return none, never returns
+ * @brief  Idle time compactor
+ */
+void HHeap_Compactor(void);
+
+
+/**
+ * @details Statistics of the handle heap, free counts the space between
+ *          blocks, largestFree what can be allocated without compacting
+ * @param  stats: structure to fill
+ * @return 0 in case of success, 1 if the block chain is broken
+ * @brief  Get handle heap statistics
+ */
+int32_t HHeap_Stats(heap_stats_ex_t *stats);
+
+#endif
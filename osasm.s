@@ -12,7 +12,7 @@
 
         EXTERN  RunPt            ; currently running thread
         EXTERN  NextRunPt        ; next thread to run
-        EXTERN  TimeSlice        ; user defined time slice
+        EXTERN  OS_SwitchHook    ; scheduler statistics
         EXPORT  StartOS
         EXPORT  ContextSwitch
         EXPORT  PendSV_Handler
@@ -111,24 +111,25 @@ PendSV_Handler
     LDR R0, =RunPt
     LDR R1, [R0]    ; R1 = RunPt
     STR SP, [R1]    ; save (updated) SP into RunPt->sp
+    PUSH {R0, LR}   ; keep EXC_RETURN, 8-byte aligned
+    BL OS_SwitchHook   ; statistics, RunPt still the old thread, empty without SCHED_STATS
+    POP {R0, LR}
     LDR R1, =NextRunPt ; R1 = &NextRunPt
     LDR R1, [R1]       ; R1 = NextRunPt
     STR R1, [R0]       ; RunPt = NextRunPt
     
     LDR R2, [R1,#4]    ; R2 = RunPt->elapsedTime
-    LDR R3, =TimeSlice ; R3 = TimeSlice
-    LDR R3, [R3]
-    SUB R2, R3, R2     ; R2 = TimeSlice - elapsedTime = remainingTime
+    LDR R3, [R1,#8]    ; R3 = RunPt->timeSlice
+    SUB R2, R3, R2     ; R2 = timeSlice - elapsedTime = remainingTime
     LDR R3, =NVIC_ST_RELOAD_R
     STR R2, [R3]               ; Reload = remainingTime
     LDR R3, =NVIC_ST_CURRENT_R ; Current = 0, resets to reload
     STR R2, [R3]
-    LDR R3, =TimeSlice  ; restore Reload to TimeSlice
-    LDR R3, [R3]
+    LDR R3, [R1,#8]     ; restore Reload to RunPt->timeSlice
     LDR R2, =NVIC_ST_RELOAD_R
     STR R3, [R2]
     
-    ;LDR R1, [R1,#4] ; R1 = RunPt->next
+    ;LDR R1, [R1,#12] ; R1 = RunPt->next
     ;STR R1, [R0]    ; RunPT = RunPt->next (R1)
     LDR SP, [R1]    ; SP = RunPt->sp (the next thread)
     POP {R4-R11}    ; recover new thread's R4-R11
@@ -151,6 +152,8 @@ PendSV_Handler
         IMPORT    OS_Sleep
         IMPORT    OS_Time
         IMPORT    OS_AddThread
+        IMPORT    OS_ThreadExit
+        IMPORT    OS_Join
 
 SVC_Handler
 ; put your Lab 5 code here
@@ -168,6 +171,10 @@ SVC_Handler
     BEQ time
     CMP R12, #4
     BEQ addthread
+    CMP R12, #5
+    BEQ threadexit
+    CMP R12, #6
+    BEQ join
     B end
 id
     ; save LR
@@ -194,6 +201,23 @@ addthread
     PUSH {LR}
     BL OS_AddThread
     POP {LR}
+    B end
+threadexit
+    PUSH {LR}
+    BL OS_ThreadExit
+    POP {LR}
+    B end
+join
+    ; the wait only starts after the SVC returns, so the result of a
+    ; timed wait is not known here, only timeout 0 (forever) is taken
+    CMP R2, #0
+    BNE notimed
+    PUSH {LR}
+    BL OS_Join
+    POP {LR}
+    B end
+notimed
+    MOV R0, #0 ; as for a handle that is not joinable
 end
     STR R0,[SP] ;store R0 at top of stack (return value)
     BX      LR                   ; Return from exception
@@ -0,0 +1,221 @@
+// filename ************** tasklet.c *****************************
+// Stackless cooperative tasklets (protothreads)
+// Many small state machines share the stack of one executor thread.
+// A tasklet never blocks the executor, the executor itself blocks on
+// TaskletWake until an event is signalled, a sleep runs out or, if a
+// tasklet polls a condition, TASKLET_POLL ms have passed.
+// Runs on LM4F120/TM4C123, the core also builds on a host (TASKLET_HOST)
+#include <stdint.h>
+#include <stddef.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/tasklet.h"
+
+// platform shim, the only target specific calls of this file
+#ifdef TASKLET_HOST
+#define TaskletLock()      0 // host tests are single threaded
+#define TaskletUnlock(sr)  ((void)(sr))
+#else
+#include "../inc/CortexM.h"
+#define TaskletLock()      StartCritical()
+#define TaskletUnlock(sr)  EndCritical(sr)
+#endif
+
+// tasklets in the order they were added
+static Tasklet_t *TaskletHead = NULL;
+static Tasklet_t *TaskletTail = NULL;
+
+// executor wakeup, signalled at most once per pass
+static Sema4Type TaskletWake;
+static volatile uint32_t WakePending;
+
+// what the last pass left to do, see Tasklet_Idle
+static uint32_t Yielded;   // tasklets that want to run again right away
+static uint32_t Polling;   // tasklets waiting on a condition
+static uint32_t NextSleep; // ms until the first sleep runs out
+
+// make the executor run a pass, safe from interrupts
+static void Wake(void) {
+  long sr = TaskletLock();
+  if(WakePending == 0) {
+    WakePending = 1;
+    OS_Signal(&TaskletWake);
+  }
+  TaskletUnlock(sr);
+}
+
+//******** Tasklet_Init *************** 
+// Remove all tasklets from the executor
+// input: none
+// output: none
+void Tasklet_Init(void){
+  long sr = TaskletLock();
+  TaskletHead = NULL;
+  TaskletTail = NULL;
+  OS_InitSemaphore(&TaskletWake, 0);
+  WakePending = 0;
+  Yielded = Polling = 0;
+  NextSleep = TASKLET_FOREVER;
+  TaskletUnlock(sr);
+}
+
+//******** Tasklet_Add *************** 
+// Add a tasklet to the end of the executor list
+// input: tasklet storage, body, user data
+// output: none
+void Tasklet_Add(Tasklet_t *t, TaskletFunc_t func, void *arg){
+  t->lc = 0;
+  t->sleep = 0;
+  t->state = TASKLET_YIELDED;
+  t->func = func;
+  t->arg = arg;
+  t->next = NULL;
+  
+  long sr = TaskletLock();
+  if(TaskletHead == NULL) {
+    TaskletHead = t;
+  }
+  else {
+    TaskletTail->next = t;
+  }
+  TaskletTail = t;
+  TaskletUnlock(sr);
+  Wake();
+}
+
+//******** Tasklet_RunOnce *************** 
+// Run every tasklet that is not sleeping once
+// input: ms elapsed since the previous pass
+// output: number of tasklets that yielded
+uint32_t Tasklet_RunOnce(uint32_t elapsedMs){
+  uint32_t yielded = 0;
+  uint32_t polling = 0;
+  uint32_t nextSleep = TASKLET_FOREVER;
+  Tasklet_t *previous = NULL;
+  Tasklet_t *t = TaskletHead;
+  WakePending = 0; // signals from here on wake the next pass
+  
+  while(t != NULL) {
+    if(t->state == TASKLET_SLEEPING) {
+      if(t->sleep > elapsedMs) {
+        t->sleep -= elapsedMs;
+        if(t->sleep < nextSleep) {
+          nextSleep = t->sleep;
+        }
+        previous = t;
+        t = t->next;
+        continue;
+      }
+      t->sleep = 0;
+    }
+    
+    t->state = t->func(t);
+    if(t->state == TASKLET_YIELDED) {
+      yielded++;
+    }
+    else if(t->state == TASKLET_WAITING) {
+      polling++;
+    }
+    else if(t->state == TASKLET_SLEEPING && t->sleep < nextSleep) {
+      nextSleep = t->sleep;
+    }
+    
+    if(t->state == TASKLET_DONE) {
+      // unlink, Tasklet_Add may be appending from another thread
+      long sr = TaskletLock();
+      Tasklet_t *next = t->next;
+      if(previous == NULL) {
+        TaskletHead = next;
+      }
+      else {
+        previous->next = next;
+      }
+      if(TaskletTail == t) {
+        TaskletTail = previous;
+      }
+      TaskletUnlock(sr);
+      t = next;
+    }
+    else {
+      previous = t;
+      t = t->next;
+    }
+  }
+  Yielded = yielded;
+  Polling = polling;
+  NextSleep = nextSleep;
+  return yielded;
+}
+
+//******** Tasklet_Idle *************** 
+// How long the executor may block after the last pass
+// input: none
+// output: 0 to run again right away, ms until a sleep runs out or the
+//         next poll, TASKLET_FOREVER if only a signal can make progress
+uint32_t Tasklet_Idle(void){
+  if(Yielded) {
+    return 0;
+  }
+  if(Polling && NextSleep > TASKLET_POLL) {
+    return TASKLET_POLL;
+  }
+  return NextSleep;
+}
+
+#ifndef TASKLET_HOST
+//******** Tasklet_Executor *************** 
+// Executor thread, runs passes back to back while some tasklet yields,
+// otherwise blocks on TaskletWake for as long as Tasklet_Idle allows
+// input: none
+// output: none
+void Tasklet_Executor(void){
+  uint32_t last = OS_MsTime();
+  while(1) {
+    uint32_t now = OS_MsTime();
+    uint32_t elapsed = (now >= last) ? now - last : now + 10000 - last; // OS_MsTime wraps at 10 s
+    last = now;
+    
+    Tasklet_RunOnce(elapsed);
+    uint32_t idle = Tasklet_Idle();
+    if(idle == TASKLET_FOREVER) {
+      OS_Wait(&TaskletWake);
+    }
+    else if(idle) {
+      OS_WaitTimeout(&TaskletWake, idle);
+    }
+  }
+}
+#endif
+
+//******** Tasklet_InitEvent *************** 
+// Clear an event
+// input: event
+// output: none
+void Tasklet_InitEvent(TaskletEvent_t *e){
+  e->count = 0;
+}
+
+//******** Tasklet_Signal *************** 
+// Signal an event, safe from interrupts
+// input: event
+// output: none
+void Tasklet_Signal(TaskletEvent_t *e){
+  long sr = TaskletLock();
+  e->count++;
+  TaskletUnlock(sr);
+  Wake();
+}
+
+//******** Tasklet_TakeEvent *************** 
+// Take one signal of an event
+// input: event
+// output: 1 if a signal was taken, 0 if none pending
+int Tasklet_TakeEvent(TaskletEvent_t *e){
+  int taken = 0;
+  long sr = TaskletLock();
+  if(e->count > 0) {
+    e->count--;
+    taken = 1;
+  }
+  TaskletUnlock(sr);
+  return taken;
+}
@@ -0,0 +1,161 @@
+/**
+ * @file      tasklet.h
+ * @brief     Stackless cooperative tasklets
+ * @details   Resumable functions (protothreads) with explicit yield points.
+ * Any number of tasklets run inside one OS thread and share its stack, so
+ * small state machines (heartbeats, keepalives, status polling) do not cost
+ * a TCB and a stack each.<br>
+ * A tasklet is a function written between TASKLET_BEGIN and TASKLET_END.
+ * Every TASKLET_ macro that can suspend returns from the function and the
+ * next call resumes right after it, so local variables do not survive a
+ * suspension; keep state in the Tasklet_t (arg) or in statics.
+ * Only one suspending macro per source line.<br>
+ * The executor thread blocks while there is nothing to do: events and
+ * Tasklet_Add wake it, sleeps wake it when they run out. Conditions and
+ * OS semaphores can not signal it, a tasklet waiting on one is polled
+ * every TASKLET_POLL ms.<br>
+ * The executor core Tasklet_RunOnce/Tasklet_Idle only needs OS_TryWait,
+ * OS_bTryWait, OS_InitSemaphore and OS_Signal, so it builds on a host with
+ * TASKLET_HOST defined (see test/test_tasklet.c).
+ * @version   V1.0
+ * @date      Oct 19, 2026
+ ******************************************************************************/
+
+#ifndef TASKLET_H
+#define TASKLET_H
+
+#include <stdint.h>
+#include "../RTOS_Labs_common/OS.h"
+
+// tasklet function return values
+#define TASKLET_WAITING  0  // condition not true yet, poll again later
+#define TASKLET_YIELDED  1  // gave up the executor, run again next pass
+#define TASKLET_SLEEPING 2  // run again after sleep ms
+#define TASKLET_DONE     3  // finished, removed from the executor
+#define TASKLET_BLOCKED  4  // waiting for a Tasklet_Signal
+
+#define TASKLET_POLL     1           // ms between polls of a waiting condition
+#define TASKLET_FOREVER  0xFFFFFFFF  // Tasklet_Idle, nothing to wait for
+
+typedef struct Tasklet Tasklet_t;
+typedef int (*TaskletFunc_t)(Tasklet_t *t);
+
+struct Tasklet {
+  uint32_t lc;        // resume point (source line), 0 to start over
+  uint32_t sleep;     // ms left while sleeping
+  int state;          // last value returned by func
+  TaskletFunc_t func; // body of the tasklet
+  void *arg;          // user data
+  Tasklet_t *next;    // next tasklet in the executor
+};
+
+// event flag, can be signalled from interrupts
+struct TaskletEvent {
+  volatile uint32_t count; // number of signals not yet taken
+};
+typedef struct TaskletEvent TaskletEvent_t;
+
+#define TASKLET_BEGIN(t)  switch((t)->lc) { case 0:
+
+#define TASKLET_END(t)    } (t)->lc = 0; return TASKLET_DONE
+
+// let the other tasklets run
+#define TASKLET_YIELD(t) \
+  do { (t)->lc = __LINE__; return TASKLET_YIELDED; case __LINE__:; } while(0)
+
+// suspend until cond is true, cond is evaluated on every executor pass
+#define TASKLET_WAIT_UNTIL(t, cond) \
+  do { (t)->lc = __LINE__; case __LINE__: if(!(cond)) return TASKLET_WAITING; } while(0)
+
+// suspend for ms milliseconds
+#define TASKLET_SLEEP(t, ms) \
+  do { (t)->sleep = (ms); (t)->lc = __LINE__; return TASKLET_SLEEPING; case __LINE__:; } while(0)
+
+// acquire an OS counting/binary semaphore without blocking the executor
+#define TASKLET_WAIT(t, semaPt)  TASKLET_WAIT_UNTIL(t, OS_TryWait(semaPt))
+#define TASKLET_BWAIT(t, semaPt) TASKLET_WAIT_UNTIL(t, OS_bTryWait(semaPt))
+
+// wait for Tasklet_Signal on an event, not polled
+#define TASKLET_WAIT_EVENT(t, e) \
+  do { (t)->lc = __LINE__; case __LINE__: if(!Tasklet_TakeEvent(e)) return TASKLET_BLOCKED; } while(0)
+
+// stop the tasklet, it is removed from the executor
+#define TASKLET_EXIT(t) \
+  do { (t)->lc = 0; return TASKLET_DONE; } while(0)
+
+
+/**
+ * @details Remove all tasklets from the executor
+ * @param  none
+ * @return none
+ * @brief  Initialize the tasklet executor
+ */
+void Tasklet_Init(void);
+
+/**
+ * @details Add a tasklet to the executor, it starts at TASKLET_BEGIN
+ * on the next pass. The Tasklet_t must stay allocated until it is done.
+ * Can be called from any foreground thread or from a tasklet.
+ * @param  t storage for the tasklet
+ * @param  func tasklet body
+ * @param  arg user data, available as t->arg
+ * @return none
+ * @brief  Add a tasklet
+ */
+void Tasklet_Add(Tasklet_t *t, TaskletFunc_t func, void *arg);
+
+/**
+ * @details Run every tasklet that is not sleeping once
+ * @param  elapsedMs time since the previous pass, used for sleeps
+ * @return number of tasklets that yielded and want to run again
+ *         right away (not waiting, sleeping or done)
+ * @brief  One executor pass
+ */
+uint32_t Tasklet_RunOnce(uint32_t elapsedMs);
+
+/**
+ * @details How long the executor may block after the last pass
+ * @param  none
+ * @return 0 if some tasklet yielded, ms until the first sleep runs out
+ *         or the next poll, TASKLET_FOREVER if only a Tasklet_Signal or
+ *         Tasklet_Add can make progress
+ * @brief  Executor idle time
+ */
+uint32_t Tasklet_Idle(void);
+
+/**
+ * @details Executor thread body, add with OS_AddThread. Runs passes
+ * back to back while some tasklet yields, otherwise blocks for
+ * Tasklet_Idle ms or until woken. Never returns.
+ * @param  none
+ * @return none
+ * @brief  Tasklet executor thread
+ */
+void Tasklet_Executor(void);
+
+/**
+ * @details Clear an event
+ * @param  e pointer to the event
+ * @return none
+ * @brief  Initialize an event
+ */
+void Tasklet_InitEvent(TaskletEvent_t *e);
+
+/**
+ * @details Signal an event, one TASKLET_WAIT_EVENT completes per signal,
+ * and wake the executor. Can be called from interrupts and foreground threads.
+ * @param  e pointer to the event
+ * @return none
+ * @brief  Signal an event
+ */
+void Tasklet_Signal(TaskletEvent_t *e);
+
+/**
+ * @details Take one signal of an event if there is one
+ * @param  e pointer to the event
+ * @return 1 if a signal was taken, 0 otherwise
+ * @brief  Poll an event
+ */
+int Tasklet_TakeEvent(TaskletEvent_t *e);
+
+#endif //#ifndef TASKLET_H
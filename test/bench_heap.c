@@ -0,0 +1,161 @@
+// filename ************** bench_heap.c *************************
+// Heap_Malloc/Heap_Free latency and fragmentation of every allocation
+// policy (Heap_SetPolicy), on the simulated kernel
+// Each policy runs in its own process on a private Heap_AddRegion heap:
+//   trace  a seeded random mix of small, medium and large blocks
+//   holes  the free list is 1000 small holes below one large block and
+//          every request needs the large one
+// frag is Heap_StatsEx fragmentation (0-1000) with the blocks of the
+// trace still allocated, worst the highest seen every 100 calls.
+// Times are host wall clock ns per call, so only compare numbers from one
+// run; the failure and fragmentation counts are the same on every run.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/heap.h"
+#include "sim.h"
+
+#define REGION_WORDS 16384
+#define TRACE_OPS    200000
+#define TRACE_SLOTS  96
+#define HOLES        1000
+#define HOLE_ROUNDS  2000
+
+static const char *const PolicyName[] = {"good fit", "first fit", "next fit", "best fit"};
+static uint32_t Policy;
+static int32_t Region[REGION_WORDS];
+static uint32_t Latency[TRACE_OPS];
+
+static uint32_t Seed = 7;
+static uint32_t Random(uint32_t n) {
+  Seed = 1664525*Seed + 1013904223;
+  return (Seed >> 8) % n;
+}
+
+static uint64_t Ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t) t.tv_sec*1000000000 + t.tv_nsec;
+}
+
+static int Compare(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+  return (x > y) - (x < y);
+}
+
+// sorts Latency[0..n-1] and prints p50, p99, max and the fragmentation
+static void Report(const char *name, uint32_t n, uint32_t failures, uint32_t frag, uint32_t worst) {
+  qsort(Latency, n, sizeof(Latency[0]), Compare);
+  printf("%-9s %-5s p50 %5u  p99 %5u  max %6u ns  failures %5u  frag %4u  worst %4u\n",
+         PolicyName[Policy], name, (unsigned) Latency[n/2], (unsigned) Latency[(99*n + 99)/100 - 1],
+         (unsigned) Latency[n - 1], (unsigned) failures, (unsigned) frag, (unsigned) worst);
+}
+
+static uint32_t Fragmentation(heap_t *region) {
+  heap_stats_ex_t stats;
+  Heap_StatsEx(region, &stats);
+  return stats.fragmentation;
+}
+
+static void Trace(heap_t *region) {
+  void *block[TRACE_SLOTS] = {0};
+  uint32_t failures = 0;
+  uint32_t worst = 0;
+  for(uint32_t k = 0; k < TRACE_OPS; k++) {
+    uint32_t j = Random(TRACE_SLOTS);
+    uint32_t r = Random(100);
+    int32_t size = r < 60 ? 4 + Random(28) : r < 90 ? 32 + Random(200) : 256 + Random(1200);
+    uint64_t start = Ns();
+    if(block[j]) {
+      Heap_Free(block[j]);
+      block[j] = 0;
+    }
+    else {
+      block[j] = Heap_MallocIn(region, size, 4);
+      failures += block[j] == 0;
+    }
+    Latency[k] = (uint32_t)(Ns() - start);
+    if(k%100 == 99) {
+      uint32_t frag = Fragmentation(region);
+      worst = frag > worst ? frag : worst;
+    }
+  }
+  uint32_t frag = Fragmentation(region);
+  for(uint32_t j = 0; j < TRACE_SLOTS; j++) {
+    Heap_Free(block[j]);
+  }
+  Report("trace", TRACE_OPS, failures, frag, worst);
+}
+
+static void Holes(heap_t *region) {
+  static void *small[2*HOLES];
+  uint32_t failures = 0;
+  for(uint32_t i = 0; i < 2*HOLES; i++) {
+    small[i] = Heap_MallocIn(region, 16, 4);
+  }
+  for(uint32_t i = 0; i < 2*HOLES; i += 2) {
+    Heap_Free(small[i]);                // holes the big request skips
+  }
+  uint32_t frag = Fragmentation(region);
+  for(uint32_t k = 0; k < HOLE_ROUNDS; k++) {
+    uint64_t start = Ns();
+    void *big = Heap_MallocIn(region, 4096, 4);
+    failures += big == 0;
+    Heap_Free(big);
+    Latency[k] = (uint32_t)(Ns() - start);
+  }
+  for(uint32_t i = 1; i < 2*HOLES; i += 2) {
+    Heap_Free(small[i]);
+  }
+  Report("holes", HOLE_ROUNDS, failures, frag, frag);
+}
+
+static void Runner(void) {
+  heap_t *region = Heap_AddRegion(Region, sizeof(Region));
+  if(region == 0 || Heap_SetPolicy(region, Policy)) {
+    printf("bench_heap: no region\n");
+    exit(1);
+  }
+  Trace(region);
+  Holes(region);
+  fflush(stdout);
+  exit(Heap_Check(region) != 0);
+}
+
+static void Idle(void) {
+  while(1) {
+    Sim_Idle();
+  }
+}
+
+static void Run(uint32_t policy) {
+  Policy = policy;
+  OS_Init();
+  OS_AddThread(Runner, 512, 1);
+  OS_AddThread(Idle, 512, 2);
+  OS_Launch(TIME_2MS);
+  exit(1);
+}
+
+int main(void) {
+  static const uint32_t policies[] = {HEAP_FIRSTFIT, HEAP_NEXTFIT, HEAP_BESTFIT, HEAP_GOODFIT};
+  int failed = 0;
+  for(uint32_t i = 0; i < sizeof(policies)/sizeof(policies[0]); i++) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid == 0) {
+      Run(policies[i]);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      printf("%s: FAIL\n", PolicyName[policies[i]]);
+      failed = 1;
+    }
+  }
+  return failed;
+}
@@ -0,0 +1,36 @@
+// filename ************** bench_kernel.c *************************
+// Kernel primitive micro-benchmarks (bench.c) on the simulated kernel
+// The table is the one the "bench" command prints on the board, in
+// simulated 12.5ns cycles, so the numbers are the same on every run.
+// The RAM disk is formatted first so file_write is not skipped.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/eFile.h"
+#include "../RTOS_Labs_common/bench.h"
+#include "sim.h"
+
+static void Runner(void) {
+  Bench_Run();
+  fflush(stdout);
+  exit(0);
+}
+
+static void Idle(void) {
+  while(1) {
+    Sim_Idle();
+  }
+}
+
+int main(void) {
+  OS_Init();
+  if(eFile_Init() || eFile_Format() || eFile_Mount()) {
+    printf("bench_kernel: no disk\n");
+    return 1;
+  }
+  OS_AddThread(Runner, 512, 1);
+  OS_AddThread(Idle, 512, 2);
+  OS_Launch(TIME_2MS);
+  return 1;
+}
@@ -0,0 +1,168 @@
+// filename ************** bench_rwlock.c *************************
+// Host benchmark of OS_RWLock, runs the real kernel on the simulator
+// Reader threads look up a shared table, one writer updates it every
+// 10 ms. A lookup computes for 50 us and then waits 1 ms for the disk
+// with the lock held, so shared readers overlap their waits while a
+// mutex (a Sema4Type of 1) serializes them. The eFile run lists the
+// directory from every reader while the writer appends to a file.
+// Each configuration runs in its own process for one virtual second,
+// the numbers are the same on every run.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/eFile.h"
+#include "sim.h"
+
+#define RUN_MS     1000
+#define LOOKUP     (SIM_CYCLES_PER_MS/20) // 50 us of table scan
+#define THINK      (SIM_CYCLES_PER_MS/40) // 25 us between lookups
+#define UPDATE     (SIM_CYCLES_PER_MS/10) // 100 us to rewrite the table
+#define PERIOD_MS  10                     // between updates
+
+enum { MODE_RWLOCK, MODE_MUTEX, MODE_EFILE };
+static const char* const ModeName[] = {"rwlock", "mutex", "eFile"};
+
+static int Mode;
+static uint32_t Readers;
+static RWLockType Lock;
+static Sema4Type Mutex;
+static uint32_t Reads;      // completed lookups or listings
+static uint32_t Updates;    // completed updates or bytes written
+static int Failures;
+static int Stop;            // set by Report, the eFile writer closes its file
+static Sema4Type Closed;
+
+static void ReadLock(void) {
+  if(Mode == MODE_RWLOCK) OS_ReadLock(&Lock);
+  else OS_Wait(&Mutex);
+}
+
+static void ReadUnlock(void) {
+  if(Mode == MODE_RWLOCK) OS_ReadUnlock(&Lock);
+  else OS_Signal(&Mutex);
+}
+
+static void Reader(void) {
+  while(1) {
+    if(Mode == MODE_EFILE) {
+      char name[8];
+      unsigned long size;
+      eFile_DOpen("");
+      while(eFile_DirNext(name, &size) == 0) {
+      }
+      eFile_DClose();
+    }
+    else {
+      ReadLock();
+      Sim_Run(LOOKUP);
+      OS_Sleep(1);            // block on the disk with the lock held
+      ReadUnlock();
+    }
+    Reads++;
+    Sim_Run(THINK);
+  }
+}
+
+static void Writer(void) {
+  if(Mode == MODE_EFILE) {
+    if(eFile_WOpen("log")) {
+      Failures++;
+    }
+    while(!Stop) {
+      if(eFile_Write((char)('a' + Updates%26))) {
+        Failures++;
+      }
+      Updates++;
+      Sim_Run(THINK);
+    }
+    if(eFile_WClose()) {
+      Failures++;
+    }
+    OS_Signal(&Closed);
+    OS_Kill();
+  }
+  while(1) {
+    OS_Sleep(PERIOD_MS);
+    if(Mode == MODE_RWLOCK) OS_WriteLock(&Lock);
+    else OS_Wait(&Mutex);
+    Sim_Run(UPDATE);
+    Updates++;
+    if(Mode == MODE_RWLOCK) OS_WriteUnlock(&Lock);
+    else OS_Signal(&Mutex);
+  }
+}
+
+// highest priority, ends the run after RUN_MS
+static void Report(void) {
+  OS_Sleep(RUN_MS);
+  uint32_t reads = Reads, updates = Updates;
+  if(Mode == MODE_EFILE) {
+    // the directory must agree with what was written
+    char name[8];
+    unsigned long size = 0;
+    Stop = 1;
+    OS_Wait(&Closed);
+    eFile_DOpen("");
+    if(eFile_DirNext(name, &size) || size != Updates) {
+      printf("eFile: size %lu, wrote %u\n", size, (unsigned) Updates);
+      Failures++;
+    }
+    eFile_DClose();
+  }
+  printf("%-7s %u readers: %6u reads/s  %6u %s/s\n", ModeName[Mode], (unsigned) Readers,
+         (unsigned)(reads*1000/RUN_MS), (unsigned)(updates*1000/RUN_MS),
+         Mode == MODE_EFILE ? "bytes" : "updates");
+  fflush(stdout);
+  exit(Failures != 0);
+}
+
+static void Idle(void) {
+  while(1) {
+    Sim_Idle();
+  }
+}
+
+static void Run(int mode, uint32_t readers) {
+  Mode = mode;
+  Readers = readers;
+  OS_Init();
+  OS_InitRWLock(&Lock, RWLOCK_WRITERPREF);
+  OS_InitSemaphore(&Mutex, 1);
+  OS_InitSemaphore(&Closed, 0);
+  if(mode == MODE_EFILE) {
+    if(eFile_Init() || eFile_Format() || eFile_Create("log")) {
+      Failures++;
+    }
+  }
+  OS_AddThread(Report, 512, 0);
+  OS_AddThread(Writer, 512, mode == MODE_EFILE ? 2 : 1); // the file writer never sleeps
+  for(uint32_t i = 0; i < readers; i++) {
+    OS_AddThread(Reader, 512, 2);
+  }
+  OS_AddThread(Idle, 512, 7);
+  OS_Launch(TIME_2MS);
+}
+
+int main(void) {
+  static const uint32_t counts[] = {1, 2, 4, 7};
+  int failed = 0;
+  for(int mode = MODE_RWLOCK; mode <= MODE_EFILE; mode++) {
+    for(uint32_t i = 0; i < sizeof(counts)/sizeof(counts[0]); i++) {
+      fflush(stdout);
+      pid_t pid = fork();
+      if(pid == 0) {
+        Run(mode, counts[i]);
+      }
+      int status;
+      waitpid(pid, &status, 0);
+      if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("%s %u readers: FAIL\n", ModeName[mode], (unsigned) counts[i]);
+        failed = 1;
+      }
+    }
+  }
+  return failed;
+}
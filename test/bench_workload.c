@@ -0,0 +1,70 @@
+// filename ************** bench_workload.c *************************
+// Scheduler workloads (workload.c) on the simulated kernel
+//   bench_workload 1              built-in script 1
+//   bench_workload burst.wl       script file, format in workload.h
+// Job work is simulated time and the interrupts arrive at their script
+// times in virtual time, so a script gives the same table on every run
+// and on every host; diff two tables to compare kernel builds.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <ctype.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/workload.h"
+#include "sim.h"
+
+static workload_t Script;
+
+static void Runner(void) {
+  workload_result_t results[WORKLOAD_MAXTHREADS];
+  if(Workload_Replay(&Script, results)) {
+    printf("bench_workload: %s could not add its threads\n", Script.name);
+    exit(1);
+  }
+  Workload_Report(&Script, results);
+  fflush(stdout);
+  exit(0);
+}
+
+static void Idle(void) {
+  while(1) {
+    Sim_Idle();
+  }
+}
+
+int main(int argc, char **argv) {
+  static char text[4096];
+  const char *source;
+  if(argc != 2) {
+    printf("usage: bench_workload <script number or file>\n");
+    return 2;
+  }
+  if(isdigit((unsigned char) argv[1][0])) {
+    source = Workload_Script(atoi(argv[1]));
+    if(source == NULL) {
+      printf("bench_workload: %d built-in scripts\n", (int) Workload_Count());
+      return 2;
+    }
+  }
+  else {
+    FILE *file = fopen(argv[1], "r");
+    if(file == NULL) {
+      perror(argv[1]);
+      return 2;
+    }
+    size_t bytes = fread(text, 1, sizeof(text) - 1, file);
+    fclose(file);
+    text[bytes] = 0;
+    source = text;
+  }
+  int line = Workload_Parse(source, &Script);
+  if(line) {
+    printf("%s:%d: bad script line\n", argv[1], line);
+    return 2;
+  }
+  OS_Init();
+  OS_AddThread(Runner, 512, 0);
+  OS_AddThread(Idle, 512, 7);
+  OS_Launch(TIME_2MS);
+  return 1;
+}
@@ -0,0 +1,37 @@
+// filename ************** check.h *************************
+// Assertions of the host tests
+// CHECK counts and prints a condition that does not hold, CHECK_EXIT
+// prints "name: ok" or "name: FAIL" and exits with status 0 only if
+// every CHECK held. Before including, define CHECK_CONTEXT as an
+// expression to print with every failure (e.g., the operation number of
+// a randomized test) and CHECK_OUT to print somewhere else than stdout.
+#ifndef __CHECK_H
+#define __CHECK_H
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef CHECK_OUT
+#define CHECK_OUT stdout
+#endif
+
+static int Failures;
+
+#ifdef CHECK_CONTEXT
+#define CHECK_PRINT(cond) \
+  fprintf(CHECK_OUT, "%s:%d: %s (op %u)\n", __FILE__, __LINE__, cond, (unsigned)(CHECK_CONTEXT))
+#else
+#define CHECK_PRINT(cond) \
+  fprintf(CHECK_OUT, "%s:%d: %s\n", __FILE__, __LINE__, cond)
+#endif
+
+#define CHECK(cond) \
+  do { if(!(cond)) { CHECK_PRINT(#cond); Failures++; } } while(0)
+
+#define CHECK_EXIT(name) \
+  do { \
+    fprintf(CHECK_OUT, "%s: %s\n", name, Failures ? "FAIL" : "ok"); \
+    fflush(CHECK_OUT); \
+    exit(Failures != 0); \
+  } while(0)
+
+#endif
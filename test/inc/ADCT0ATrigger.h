@@ -0,0 +1,6 @@
+// ADCT0ATrigger.h
+// Host stand-in, not used by the host builds
+#ifndef __ADCT0ATRIGGER_H__
+#define __ADCT0ATRIGGER_H__
+
+#endif
@@ -0,0 +1,12 @@
+// CortexM.h
+// Host stand-in, interrupt masking is simulated by test/sim.c
+#ifndef __CORTEXM_H__
+#define __CORTEXM_H__
+
+void DisableInterrupts(void);
+void EnableInterrupts(void);
+long StartCritical(void);
+void EndCritical(long sr);
+void WaitForInterrupt(void);
+
+#endif
@@ -0,0 +1,13 @@
+// LaunchPad.h
+// Host stand-in, the LEDs are a scratch word
+#ifndef __LAUNCHPAD_H__
+#define __LAUNCHPAD_H__
+#include <stdint.h>
+
+extern volatile uint32_t SimScratch;
+#define PF1 SimScratch
+#define PF2 SimScratch
+#define PF3 SimScratch
+void LaunchPad_Init(void);
+
+#endif
@@ -0,0 +1,10 @@
+// PLL.h
+// Host stand-in, the simulated clock always runs at 80 MHz
+#ifndef __PLL_H__
+#define __PLL_H__
+#include <stdint.h>
+
+#define Bus80MHz 4
+void PLL_Init(uint32_t freq);
+
+#endif
@@ -0,0 +1,10 @@
+// Timer0A.h
+// Host stand-in, test/sim.c raises the periodic interrupt in virtual time
+#ifndef __TIMER0AINTS_H__
+#define __TIMER0AINTS_H__
+#include <stdint.h>
+
+void Timer0A_Init(void(*task)(void), uint32_t period, uint32_t priority);
+void Timer0A_Stop(void);
+
+#endif
@@ -0,0 +1,10 @@
+// Timer1A.h
+// Host stand-in, test/sim.c raises the periodic interrupt in virtual time
+#ifndef __TIMER1AINTS_H__
+#define __TIMER1AINTS_H__
+#include <stdint.h>
+
+void Timer1A_Init(void(*task)(void), uint32_t period, uint32_t priority);
+void Timer1A_Stop(void);
+
+#endif
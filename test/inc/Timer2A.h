@@ -0,0 +1,10 @@
+// Timer2A.h
+// Host stand-in, test/sim.c raises the periodic interrupt in virtual time
+#ifndef __TIMER2AINTS_H__
+#define __TIMER2AINTS_H__
+#include <stdint.h>
+
+void Timer2A_Init(void(*task)(void), uint32_t period, uint32_t priority);
+void Timer2A_Stop(void);
+
+#endif
@@ -0,0 +1,10 @@
+// Timer3A.h
+// Host stand-in, test/sim.c raises the periodic interrupt in virtual time
+#ifndef __TIMER3AINTS_H__
+#define __TIMER3AINTS_H__
+#include <stdint.h>
+
+void Timer3A_Init(void(*task)(void), uint32_t period, uint32_t priority);
+void Timer3A_Stop(void);
+
+#endif
@@ -0,0 +1,10 @@
+// Timer4A.h
+// Host stand-in, test/sim.c raises the periodic interrupt in virtual time
+#ifndef __TIMER4AINTS_H__
+#define __TIMER4AINTS_H__
+#include <stdint.h>
+
+void Timer4A_Init(void(*task)(void), uint32_t period, uint32_t priority);
+void Timer4A_Stop(void);
+
+#endif
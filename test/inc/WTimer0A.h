@@ -0,0 +1,6 @@
+// WTimer0A.h
+// Host stand-in, not used by the host builds
+#ifndef __WTIMER0AINTS_H__
+#define __WTIMER0AINTS_H__
+
+#endif
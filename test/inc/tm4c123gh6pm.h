@@ -0,0 +1,53 @@
+// tm4c123gh6pm.h
+// Host stand-in for the TM4C123 register header, see test/sim.c
+// Registers the kernel reads back (SysTick, Timer5A) are variables the
+// simulator keeps current. Set-up only registers all share one scratch word.
+#ifndef __TM4C123GH6PM_H__
+#define __TM4C123GH6PM_H__
+#include <stdint.h>
+
+extern volatile uint32_t SimScratch;
+extern volatile uint32_t SimSysTickCtrl;
+extern volatile uint32_t SimSysTickReload;
+extern volatile uint32_t SimSysTickCurrent;
+extern volatile uint32_t SimTimer5Count;
+extern volatile uint32_t SimTimer5Ris;
+
+#define NVIC_ST_CTRL_R          SimSysTickCtrl
+#define NVIC_ST_RELOAD_R        SimSysTickReload
+#define NVIC_ST_CURRENT_R       SimSysTickCurrent
+#define NVIC_ST_CTRL_ENABLE     0x00000001
+#define NVIC_ST_CTRL_INTEN      0x00000002
+#define NVIC_ST_CTRL_CLK_SRC    0x00000004
+
+#define TIMER5_TAR_R            SimTimer5Count
+#define TIMER5_RIS_R            SimTimer5Ris
+#define TIMER5_ICR_R            SimScratch // the simulator clears RIS itself
+#define TIMER5_CTL_R            SimScratch
+#define TIMER5_CFG_R            SimScratch
+#define TIMER5_TAMR_R           SimScratch
+#define TIMER5_TAILR_R          SimScratch
+#define TIMER5_TAPR_R           SimScratch
+#define TIMER5_IMR_R            SimScratch
+
+#define SYSCTL_RCGCGPIO_R       SimScratch
+#define SYSCTL_RCGCTIMER_R      SimScratch
+#define NVIC_EN0_R              SimScratch
+#define NVIC_EN2_R              SimScratch
+#define NVIC_PRI7_R             SimScratch
+#define NVIC_PRI23_R            SimScratch
+
+#define GPIO_PORTF_AFSEL_R      SimScratch
+#define GPIO_PORTF_AMSEL_R      SimScratch
+#define GPIO_PORTF_DEN_R        SimScratch
+#define GPIO_PORTF_DIR_R        SimScratch
+#define GPIO_PORTF_IBE_R        SimScratch
+#define GPIO_PORTF_ICR_R        SimScratch
+#define GPIO_PORTF_IEV_R        SimScratch
+#define GPIO_PORTF_IM_R         SimScratch
+#define GPIO_PORTF_IS_R         SimScratch
+#define GPIO_PORTF_PCTL_R       SimScratch
+#define GPIO_PORTF_PUR_R        SimScratch
+#define GPIO_PORTF_RIS_R        SimScratch
+
+#endif
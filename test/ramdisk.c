@@ -0,0 +1,54 @@
+// filename ************** ramdisk.c *************************
+// Host stand-in for eDisk.c, the SD card is an array in RAM
+// Every block transfer busy-waits RamDiskCycles of virtual time, like
+// the SPI driver does on the target, so readers and writers of eFile
+// can be preempted in the middle of a disk access.
+#include <stdint.h>
+#include <string.h>
+#include "../RTOS_Labs_common/eDisk.h"
+#include "sim.h"
+
+#define RAMDISK_BLOCKS 2048   // what the eFile FAT can address
+
+uint32_t RamDiskCycles = SIM_CYCLES_PER_MS/2; // 512 bytes at 8 Mbit/s
+static BYTE Disk[RAMDISK_BLOCKS][512];
+
+void CS_Init(void) {
+}
+
+void disk_timerproc(void) {
+}
+
+DSTATUS eDisk_Init(BYTE drive) {
+  return drive == 0 ? RES_OK : STA_NOINIT;
+}
+
+DSTATUS eDisk_Status(BYTE drive) {
+  return drive == 0 ? RES_OK : STA_NOINIT;
+}
+
+DRESULT eDisk_Read(BYTE drv, BYTE *buff, DWORD sector, UINT count) {
+  if(drv != 0 || count == 0 || sector + count > RAMDISK_BLOCKS) {
+    return RES_PARERR;
+  }
+  Sim_Run(RamDiskCycles*count);
+  memcpy(buff, Disk[sector], 512*count);
+  return RES_OK;
+}
+
+DRESULT eDisk_ReadBlock(BYTE *buff, DWORD sector) {
+  return eDisk_Read(0, buff, sector, 1);
+}
+
+DRESULT eDisk_Write(BYTE drv, const BYTE *buff, DWORD sector, UINT count) {
+  if(drv != 0 || count == 0 || sector + count > RAMDISK_BLOCKS) {
+    return RES_PARERR;
+  }
+  Sim_Run(RamDiskCycles*count);
+  memcpy(Disk[sector], buff, 512*count);
+  return RES_OK;
+}
+
+DRESULT eDisk_WriteBlock(const BYTE *buff, DWORD sector) {
+  return eDisk_Write(0, buff, sector, 1);
+}
@@ -0,0 +1,357 @@
+// filename ************** sim.c *************************
+// Host port of the kernel, see sim.h
+// Interrupts are modelled the way the NVIC takes them: an event that
+// falls due sets a pending flag, and pending handlers run in priority
+// order as soon as PRIMASK is clear and no handler is active. PendSV is
+// the lowest, so a context switch requested from an ISR waits until all
+// other handlers are done, as on the target.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <ucontext.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../inc/tm4c123gh6pm.h"
+#include "../inc/CortexM.h"
+#include "sim.h"
+
+extern TCB_t *RunPt, *NextRunPt;
+void SysTick_Handler(void);
+void Timer5A_Handler(void);
+void OS_SwitchHook(void);
+
+volatile uint32_t SimScratch;
+volatile uint32_t SimSysTickCtrl;
+volatile uint32_t SimSysTickReload;
+volatile uint32_t SimSysTickCurrent;
+volatile uint32_t SimTimer5Count = SIM_CYCLES_PER_MS - 1;
+volatile uint32_t SimTimer5Ris;
+uint32_t SimCallCycles = 40;
+
+static uint64_t Now;          // virtual bus cycles
+static int Primask;
+static int InHandler;
+static int SysTickPending;
+static int PendSVPending;
+
+// periodic Timer0A-4A interrupts and one shot arrivals
+#define SIM_SOURCES 32
+typedef struct {
+  void(*task)(void);
+  uint32_t period;            // 0 for a one shot
+  uint32_t priority;
+  uint64_t next;
+  int pending;
+} Source_t;
+static Source_t Sources[SIM_SOURCES];
+
+// thread contexts, a switched out thread's sp points at its marker
+#define SIM_STACK (256*1024)
+static ucontext_t Context[NUMTHREADS];
+static ucontext_t MainContext;
+static uint32_t Marker[NUMTHREADS];
+static void(*Entry[NUMTHREADS])(void);
+static char* Stacks[NUMTHREADS];
+
+//---------- virtual time -----------------
+static uint64_t NextEvent(void) {
+  uint64_t step = SIM_CYCLES_PER_MS - Now%SIM_CYCLES_PER_MS; // Timer5A
+  if(SimSysTickCtrl & NVIC_ST_CTRL_ENABLE) {
+    uint32_t count = SimSysTickCurrent ? SimSysTickCurrent : SimSysTickReload;
+    if(count != 0 && count < step) {
+      step = count;
+    }
+  }
+  for(int i = 0; i < SIM_SOURCES; i++) {
+    // a one shot that fired keeps its time until it is dispatched
+    if(Sources[i].task != NULL && !(Sources[i].pending && Sources[i].period == 0) &&
+       Sources[i].next - Now < step) {
+      step = Sources[i].next - Now;
+    }
+  }
+  return step;
+}
+
+// move the clock by step, which must not pass NextEvent()
+static void Advance(uint64_t step) {
+  Now += step;
+  SimTimer5Count = SIM_CYCLES_PER_MS - 1 - Now%SIM_CYCLES_PER_MS;
+  if(Now%SIM_CYCLES_PER_MS == 0) {
+    SimTimer5Ris = 1;
+  }
+  if(SimSysTickCtrl & NVIC_ST_CTRL_ENABLE) {
+    uint32_t count = SimSysTickCurrent ? SimSysTickCurrent : SimSysTickReload;
+    if(count != 0) {
+      count -= step;
+      if(count == 0) {
+        if(SimSysTickCtrl & NVIC_ST_CTRL_INTEN) {
+          SysTickPending = 1;
+        }
+        count = SimSysTickReload;
+      }
+      SimSysTickCurrent = count;
+    }
+  }
+  for(int i = 0; i < SIM_SOURCES; i++) {
+    Source_t* s = &Sources[i];
+    if(s->task != NULL && s->next == Now) {
+      s->pending = 1;
+      if(s->period) {
+        s->next += s->period;
+      }
+    }
+  }
+}
+
+// spend cycles without taking interrupts, they stay pending
+static void Spend(uint32_t cycles) {
+  while(cycles) {
+    uint64_t step = NextEvent();
+    if(step > cycles) {
+      step = cycles;
+    }
+    Advance(step);
+    cycles -= step;
+  }
+}
+
+//---------- interrupts -----------------
+static void Handler(void(*isr)(void)) {
+  InHandler = 1;
+  isr();
+  InHandler = 0;
+  Primask = 0; // exception return
+}
+
+static void PendSV_Handler(void);
+
+// take everything pending, highest priority first
+static void Dispatch(void) {
+  while(!Primask && !InHandler) {
+    if(SimTimer5Ris) {
+      SimTimer5Ris = 0;
+      Handler(Timer5A_Handler);
+      continue;
+    }
+    Source_t* best = NULL;
+    for(int i = 0; i < SIM_SOURCES; i++) {
+      Source_t* s = &Sources[i];
+      if(s->pending && (best == NULL || s->priority < best->priority)) {
+        best = s;
+      }
+    }
+    if(best != NULL) {
+      void(*task)(void) = best->task;
+      best->pending = 0;
+      if(best->period == 0) {
+        best->task = NULL;    // one shot, free the slot
+      }
+      Handler(task);
+      continue;
+    }
+    if(SysTickPending) {
+      SysTickPending = 0;
+      Handler(SysTick_Handler);
+      continue;
+    }
+    if(PendSVPending) {
+      PendSVPending = 0;
+      PendSV_Handler();
+      continue;
+    }
+    break;
+  }
+}
+
+void DisableInterrupts(void) {
+  Primask = 1;
+}
+
+void EnableInterrupts(void) {
+  Spend(SimCallCycles);
+  Primask = 0;
+  Dispatch();
+}
+
+long StartCritical(void) {
+  long sr = Primask;
+  Primask = 1;
+  return sr;
+}
+
+void EndCritical(long sr) {
+  Spend(SimCallCycles);
+  Primask = sr;
+  Dispatch();
+}
+
+void WaitForInterrupt(void) {
+  Sim_Idle();
+}
+
+//---------- threads -----------------
+static void Trampoline(void) {
+  void(*task)(void) = Entry[RunPt->id];
+  Primask = 0;
+  Dispatch();
+  task();
+  fprintf(stderr, "sim: thread %u returned\n", (unsigned) RunPt->id);
+  abort();
+}
+
+static void Resume(TCB_t* old, TCB_t* next) {
+  uint32_t id = next->id;
+  if(next->sp != &Marker[id]) {
+    // fresh thread, PC is in the frame OS_AddThread built
+    Entry[id] = (void(*)(void))(uintptr_t) next->sp[14];
+    if(Stacks[id] == NULL) {
+      Stacks[id] = malloc(SIM_STACK);
+    }
+    getcontext(&Context[id]);
+    Context[id].uc_stack.ss_sp = Stacks[id];
+    Context[id].uc_stack.ss_size = SIM_STACK;
+    Context[id].uc_link = NULL;
+    makecontext(&Context[id], Trampoline, 0);
+  }
+  swapcontext(old ? &Context[old->id] : &MainContext, &Context[id]);
+}
+
+// the C version of PendSV_Handler in osasm.s
+static void PendSV_Handler(void) {
+  TCB_t* old = RunPt;
+  Primask = 1;
+  old->sp = &Marker[old->id];
+  OS_SwitchHook();
+  RunPt = NextRunPt;
+  uint32_t remaining = RunPt->timeSlice - RunPt->elapsedTime;
+  if(remaining == 0 || remaining > RunPt->timeSlice) {
+    remaining = RunPt->timeSlice;
+  }
+  SimSysTickCurrent = remaining;
+  SimSysTickReload = RunPt->timeSlice;
+  Primask = 0;
+  if(RunPt != old) {
+    Resume(old, RunPt);
+  }
+}
+
+void ContextSwitch(void) {
+  PendSVPending = 1;
+  Dispatch();
+}
+
+void StartOS(uint32_t* sp) {
+  (void) sp;
+  SimSysTickCurrent = RunPt->timeSlice;
+  Resume(NULL, RunPt);
+  fprintf(stderr, "sim: returned to main\n");
+  abort();
+}
+
+//---------- sim.h -----------------
+void Sim_Run(uint32_t cycles) {
+  while(cycles) {
+    uint64_t step = NextEvent();
+    if(step > cycles) {
+      step = cycles;
+    }
+    Advance(step);
+    cycles -= step;
+    Dispatch();
+  }
+}
+
+void Sim_Idle(void) {
+  Advance(NextEvent());
+  Dispatch();
+}
+
+uint64_t Sim_Now(void) {
+  return Now;
+}
+
+// returns the slot, -1 if the table is full
+static int AddSource(void(*task)(void), uint64_t at, uint32_t period, uint32_t priority) {
+  for(int i = 0; i < SIM_SOURCES; i++) {
+    Source_t* s = &Sources[i];
+    if(s->task == NULL) {
+      s->task = task;
+      s->period = period;
+      s->priority = priority;
+      s->next = at > Now ? at : Now + 1;
+      s->pending = 0;
+      return i;
+    }
+  }
+  return -1;
+}
+
+int Sim_Interrupt(void(*task)(void), uint64_t at, uint32_t priority) {
+  return AddSource(task, at, 0, priority) >= 0;
+}
+
+//---------- Timer0A-4A -----------------
+// one periodic source per timer, Init replaces the previous task
+static int TimerSlot[5] = {-1, -1, -1, -1, -1};
+
+static void TimerInit(int timer, void(*task)(void), uint32_t period, uint32_t priority) {
+  if(TimerSlot[timer] >= 0) {
+    Sources[TimerSlot[timer]].task = NULL;
+  }
+  TimerSlot[timer] = period ? AddSource(task, Now + period, period, priority) : -1;
+}
+
+static void TimerStop(int timer) {
+  if(TimerSlot[timer] >= 0) {
+    Sources[TimerSlot[timer]].task = NULL;
+    Sources[TimerSlot[timer]].pending = 0;
+    TimerSlot[timer] = -1;
+  }
+}
+
+void Timer0A_Init(void(*task)(void), uint32_t period, uint32_t priority) { TimerInit(0, task, period, priority); }
+void Timer1A_Init(void(*task)(void), uint32_t period, uint32_t priority) { TimerInit(1, task, period, priority); }
+void Timer2A_Init(void(*task)(void), uint32_t period, uint32_t priority) { TimerInit(2, task, period, priority); }
+void Timer3A_Init(void(*task)(void), uint32_t period, uint32_t priority) { TimerInit(3, task, period, priority); }
+void Timer4A_Init(void(*task)(void), uint32_t period, uint32_t priority) { TimerInit(4, task, period, priority); }
+void Timer0A_Stop(void) { TimerStop(0); }
+void Timer1A_Stop(void) { TimerStop(1); }
+void Timer2A_Stop(void) { TimerStop(2); }
+void Timer3A_Stop(void) { TimerStop(3); }
+void Timer4A_Stop(void) { TimerStop(4); }
+
+//---------- board -----------------
+void PLL_Init(uint32_t freq) {
+  (void) freq;
+}
+
+void LaunchPad_Init(void) {
+}
+
+void UART_Init(void) {
+}
+
+// OS.c defines fputc, so output goes through fwrite
+void UART_OutChar(char data) {
+  if(data != '\r') {
+    fwrite(&data, 1, 1, stdout);
+  }
+}
+
+char UART_InChar(void) {
+  int c = getchar();
+  return c == EOF ? '\r' : (char) c;
+}
+
+void UART_OutString(char *pt) {
+  while(*pt) {
+    UART_OutChar(*pt++);
+  }
+}
+
+void UART_OutUDec(uint32_t n) {
+  printf("%u", (unsigned) n);
+}
+
+void UART_OutUHex(uint32_t number) {
+  printf("%X", (unsigned) number);
+}
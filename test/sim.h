@@ -0,0 +1,52 @@
+// filename ************** sim.h *************************
+// Host port of the kernel for the tests and benchmarks in test/
+// OS.c runs unchanged on Linux against a virtual 80 MHz clock.
+// The stub headers in test/inc map SysTick and Timer5A onto variables
+// the simulator counts down, the PendSV handler and StartOS of osasm.s
+// are replaced by ucontext switches, and the periodic Timer0A-4A
+// interrupts fire at their period in virtual time. Nothing depends on
+// the wall clock, so every run of a program gives the same result.
+// Link with -no-pie: OS_AddThread keeps the task address in the 32 bit
+// stack frame the kernel builds.
+#ifndef __SIM_H
+#define __SIM_H
+#include <stdint.h>
+
+#define SIM_CYCLES_PER_MS 80000 // same bus clock as the target
+
+// virtual bus cycles charged to every EndCritical/EnableInterrupts,
+// a rough cost of the kernel call the critical section belongs to
+// (default 40, 0 turns it off)
+extern uint32_t SimCallCycles;
+
+/**
+ * @details The running thread computes for some cycles of its own time.
+ * Interrupts that fall in between are taken when they are enabled, and
+ * a preemption may give the CPU to other threads before this returns.
+ * @param  cycles bus cycles of work
+ */
+void Sim_Run(uint32_t cycles);
+
+/**
+ * @details Sleep until the next interrupt, the host WaitForInterrupt.
+ * Call it in the idle loop of the lowest priority thread.
+ */
+void Sim_Idle(void);
+
+/**
+ * @details Virtual time since the program started
+ * @return bus cycles
+ */
+uint64_t Sim_Now(void);
+
+/**
+ * @details Schedule a one shot interrupt, e.g., an arrival read from a
+ * workload script. Sim_Interrupt from inside an ISR chains the next one.
+ * @param  task ISR to run
+ * @param  at absolute virtual time in bus cycles
+ * @param  priority NVIC priority 0 to 7, 0 is highest
+ * @return 1 if scheduled, 0 if the table of pending arrivals is full
+ */
+int Sim_Interrupt(void(*task)(void), uint64_t at, uint32_t priority);
+
+#endif
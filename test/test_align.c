@@ -0,0 +1,122 @@
+// filename ************** test_align.c *************************
+// Host test of aligned allocation and heap regions on the simulated
+// kernel, see sim.h
+// A seeded random mix of Heap_MallocAligned on the kernel heap and
+// Heap_MallocIn on a region, alignments 1 to 256 bytes, under every
+// allocation policy of the region: each block is aligned, keeps its
+// contents until it is freed or reallocated, Heap_Check passes for every
+// heap and both heaps are empty again at the end.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/heap.h"
+#include "sim.h"
+#define CHECK_CONTEXT Op
+#include "check.h"
+
+
+#define SLOTS 64
+#define OPS   50000
+
+static int32_t Region[3000];
+static uint8_t *Block[SLOTS];
+static int32_t Size[SLOTS];
+static uint8_t Pattern[SLOTS];
+static uint32_t Op;
+
+static uint32_t Seed = 5;
+static uint32_t Random(uint32_t n) {
+  Seed = 1664525*Seed + 1013904223;
+  return (Seed >> 8) % n;
+}
+
+static void Fill(uint32_t j) {
+  for(int32_t b = 0; b < Size[j]; b++) {
+    Block[j][b] = Pattern[j] + b;
+  }
+}
+
+static int Kept(uint32_t j, int32_t bytes) {
+  for(int32_t b = 0; b < bytes; b++) {
+    if(Block[j][b] != (uint8_t)(Pattern[j] + b)) return 0;
+  }
+  return 1;
+}
+
+static void Mix(heap_t *region) {
+  for(uint32_t k = 0; k < OPS && Failures < 10; k++, Op++) {
+    uint32_t j = Random(SLOTS);
+    if(Block[j] != NULL) {
+      CHECK(Kept(j, Size[j]));
+      if(Random(4) == 0) {
+        int32_t size = Random(200);
+        uint8_t *block = Heap_Realloc(Block[j], size);
+        if(block != NULL) {
+          Block[j] = block;
+          CHECK(Kept(j, size < Size[j] ? size : Size[j]));
+          Size[j] = size;
+          Fill(j);
+        }
+      }
+      else {
+        CHECK(Heap_Free(Block[j]) == 0);
+        Block[j] = NULL;
+      }
+    }
+    else {
+      uint32_t align = 1u << Random(9);
+      int32_t size = Random(Random(8) == 0 ? 1500 : 80);
+      Block[j] = Random(2) ? Heap_MallocIn(region, size, align) : Heap_MallocAligned(size, align);
+      if(Block[j] != NULL) {
+        CHECK(((uintptr_t) Block[j] & ((align < 4 ? 4 : align) - 1)) == 0);
+        Size[j] = size;
+        Pattern[j] = Random(256);
+        Fill(j);
+      }
+    }
+    CHECK(Heap_Check(0) == 0);
+  }
+  for(uint32_t j = 0; j < SLOTS; j++) {
+    if(Block[j] != NULL) {
+      CHECK(Kept(j, Size[j]));
+      Heap_Free(Block[j]);
+      Block[j] = NULL;
+    }
+  }
+}
+
+static void Checker(void) {
+  heap_stats_ex_t kernel, empty, stats;
+  Heap_StatsEx(0, &kernel);
+  int32_t tiny[3];
+  CHECK(Heap_AddRegion(tiny, sizeof(tiny)) == NULL);
+  heap_t *region = Heap_AddRegion(Region, sizeof(Region));
+  CHECK(region != NULL);
+  Heap_StatsEx(region, &empty);
+  CHECK(Heap_MallocAligned(8, 12) == NULL);       // not a power of 2
+  CHECK(Heap_MallocIn(region, 8, 48) == NULL);
+  for(uint32_t policy = HEAP_GOODFIT; policy <= HEAP_BESTFIT; policy++) {
+    CHECK(Heap_SetPolicy(region, policy) == 0);
+    Mix(region);
+    Heap_StatsEx(region, &stats);
+    CHECK(stats.used == empty.used && stats.free == empty.free && stats.freeBlocks == 1);
+  }
+  Heap_StatsEx(0, &stats);
+  CHECK(stats.used == kernel.used && stats.free == kernel.free);
+  CHECK_EXIT("test_align");
+}
+
+static void Idle(void) {
+  while(1) {
+    Sim_Idle();
+  }
+}
+
+int main(void) {
+  OS_Init();
+  OS_AddThread(Checker, 512, 2);
+  OS_AddThread(Idle, 512, 7);
+  OS_Launch(TIME_2MS);
+  return 1;
+}
@@ -0,0 +1,114 @@
+// filename ************** test_arena.c *************************
+// Host test of process arenas on the simulated kernel, see sim.h
+// Two processes allocate blocks in their arenas and hand them out: an OS
+// thread frees one of each, the other process frees the last. Each block
+// goes back to the arena it came from, not to the kernel heap or to the
+// arena of the thread that frees it. Once both processes exit, their
+// arenas are gone from the kernel heap and no longer claim blocks.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/heap.h"
+#include "sim.h"
+#include "check.h"
+
+
+#define ARENA 512
+#define BLOCK 64
+
+static heap_t *Arena[2];
+static int32_t *Block[3];  // 0 and 2 in process 0, 1 in process 1
+static Sema4Type Handed, Go1, Done[2];
+
+static int Inside(int32_t *block, heap_t *h) {
+  return block > h->base && block < h->base + h->words;
+}
+
+static uint32_t Used(heap_t *h) {
+  heap_stats_ex_t stats;
+  Heap_StatsEx(h, &stats);
+  return stats.used;
+}
+
+static void Entry0(void) {
+  Arena[0] = OS_CurrentProcess()->arena;
+  Block[0] = Heap_Malloc(BLOCK);
+  Block[2] = Heap_Malloc(BLOCK);
+  OS_Signal(&Handed);
+  OS_Wait(&Done[0]);
+  OS_Kill();
+}
+
+static void Entry1(void) {
+  Arena[1] = OS_CurrentProcess()->arena;
+  Block[1] = Heap_Malloc(BLOCK);
+  OS_Signal(&Handed);
+  OS_Wait(&Go1);
+  Heap_Free(Block[2]);      // a block of the other process
+  OS_Signal(&Handed);
+  OS_Wait(&Done[1]);
+  OS_Kill();
+}
+
+static void Checker(void) {
+  heap_stats_t empty, stats;
+  Heap_Stats(&empty);
+  CHECK(OS_AddProcessArena(Entry0, NULL, NULL, 256, 2, ARENA));
+  CHECK(OS_AddProcessArena(Entry1, NULL, NULL, 256, 2, ARENA));
+  OS_Wait(&Handed);
+  OS_Wait(&Handed);
+  CHECK(Arena[0] != NULL && Arena[1] != NULL && Arena[0] != Arena[1]);
+  CHECK(Inside(Block[0], Arena[0]) && Inside(Block[2], Arena[0]));
+  CHECK(Inside(Block[1], Arena[1]));
+  uint32_t kernel = Used(NULL);
+  for(int p = 0; p < 2; p++) {
+    uint32_t used = Used(Arena[p]);
+    Heap_Free(Block[p]);    // an OS thread frees a process block
+    CHECK(Used(Arena[p]) < used);
+    CHECK(Used(NULL) == kernel);
+  }
+  uint32_t used1 = Used(Arena[1]);
+  OS_Signal(&Go1);
+  OS_Wait(&Handed);
+  CHECK(Used(Arena[0]) == 0);
+  CHECK(Used(Arena[1]) == used1);
+  CHECK(Used(NULL) == kernel);
+  CHECK(Heap_Check(0) == 0);
+  CHECK(Heap_Check(Arena[0]) == 0 && Heap_Check(Arena[1]) == 0);
+  OS_Signal(&Done[0]);
+  OS_Signal(&Done[1]);
+  OS_Sleep(2);
+  Heap_Stats(&stats);
+  CHECK(stats.free == empty.free);  // both arenas are back
+  // the kernel heap reuses the arena memory, blocks there are its own
+  for(int i = 0; i < 3; i++) {
+    Block[i] = Heap_Malloc(ARENA/2);
+    CHECK(Block[i] != NULL);
+  }
+  for(int i = 0; i < 3; i++) {
+    Heap_Free(Block[i]);
+  }
+  CHECK(Heap_Check(0) == 0);
+  Heap_Stats(&stats);
+  CHECK(stats.free == empty.free);
+  CHECK_EXIT("test_arena");
+}
+
+static void Idle(void) {
+  while(1) {
+    Sim_Idle();
+  }
+}
+
+int main(void) {
+  OS_Init();
+  OS_InitSemaphore(&Handed, 0);
+  OS_InitSemaphore(&Go1, 0);
+  OS_InitSemaphore(&Done[0], 0);
+  OS_InitSemaphore(&Done[1], 0);
+  OS_AddThread(Checker, 512, 3);
+  OS_AddThread(Idle, 512, 7);
+  OS_Launch(TIME_2MS);
+  return 1;
+}
@@ -0,0 +1,133 @@
+// filename ************** test_barrier.c *************************
+// Host test of OS_Barrier and OS_Latch on the simulated kernel, see sim.h
+// Four workers at priorities 1 to 4 meet at one barrier for many phases,
+// arriving in a different order every phase. In every phase exactly one
+// of them is the last to arrive, the others return in priority order,
+// and none of them is still waiting for a phase once a thread has come
+// out of it. Then three threads wait on a latch that interrupts count
+// down: nobody is released before the last count down, everybody
+// exactly once after it, and later waits return at once.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "sim.h"
+#include "check.h"
+
+#define PARTIES 4
+#define PHASES  50
+#define WAITERS 3
+#define COUNT   3
+
+static BarrierType Barrier;
+static Sema4Type Done;
+static uint16_t Ids[PARTIES];
+static volatile uint32_t Phase[PARTIES];    // phase each worker is in
+static uint32_t Last[PHASES];               // workers that returned 1
+static uint32_t Order[PHASES][PARTIES];     // the others, in return order
+static uint32_t Woken[PHASES];
+
+static LatchType Latch;
+static uint32_t Released[WAITERS];
+static uint32_t Again[WAITERS];
+
+// no thread on the barrier is still waiting for phase
+static void NoneLeftIn(uint32_t phase) {
+  for(TCB_t* tcb = Barrier.head; tcb != NULL; tcb = tcb->next) {
+    for(uint32_t k = 0; k < PARTIES; k++) {
+      if(Ids[k] == tcb->id) {
+        CHECK(Phase[k] == phase + 1);
+      }
+    }
+  }
+}
+
+static void Worker(void) {
+  uint32_t slot = OS_GetPriority(OS_Id()) - 1;
+  Ids[slot] = OS_Id();
+  for(uint32_t phase = 0; phase < PHASES; phase++) {
+    OS_Sleep(1 + (slot + phase)%PARTIES);  // the last to arrive changes
+    Phase[slot] = phase;
+    if(OS_BarrierWait(&Barrier)) {
+      Last[phase]++;
+    }
+    else {
+      Order[phase][Woken[phase]++] = slot;
+    }
+    NoneLeftIn(phase);
+    Phase[slot] = phase + 1;
+  }
+  OS_Signal(&Done);
+  OS_Kill();
+}
+
+static void Waiter(void) {
+  uint32_t slot = OS_GetPriority(OS_Id()) - 1;
+  OS_LatchWait(&Latch);
+  CHECK(Latch.count == 0);
+  Released[slot]++;
+  OS_LatchWait(&Latch);                // open for good, returns at once
+  Again[slot]++;
+  OS_Signal(&Done);
+  OS_Kill();
+}
+
+static void CountDown(void) {
+  OS_LatchCountDown(&Latch);
+}
+
+static void Checker(void) {
+  for(uint32_t i = 0; i < PARTIES; i++) {
+    OS_Wait(&Done);
+  }
+  for(uint32_t phase = 0; phase < PHASES; phase++) {
+    CHECK(Last[phase] == 1);
+    CHECK(Woken[phase] == PARTIES - 1);
+    for(uint32_t i = 1; i < Woken[phase]; i++) {
+      CHECK(Order[phase][i - 1] < Order[phase][i]);
+    }
+  }
+  CHECK(Barrier.arrived == 0 && Barrier.head == NULL);
+
+  OS_InitLatch(&Latch, COUNT);
+  for(uint32_t i = 0; i < WAITERS; i++) {
+    OS_AddThread(Waiter, 512, i + 1);
+  }
+  OS_Sleep(1);                         // every waiter is blocked
+  uint64_t now = Sim_Now();
+  for(uint32_t i = 1; i <= COUNT + 1; i++) { // one more than needed
+    Sim_Interrupt(CountDown, now + i*SIM_CYCLES_PER_MS + SIM_CYCLES_PER_MS/2, 2);
+  }
+  OS_Sleep(COUNT);                     // COUNT - 1 count downs so far
+  for(uint32_t i = 0; i < WAITERS; i++) {
+    CHECK(Released[i] == 0);
+  }
+  for(uint32_t i = 0; i < WAITERS; i++) {
+    OS_Wait(&Done);
+  }
+  OS_Sleep(COUNT);                     // past the extra count down
+  for(uint32_t i = 0; i < WAITERS; i++) {
+    CHECK(Released[i] == 1 && Again[i] == 1);
+  }
+  CHECK(Latch.count == 0 && Latch.head == NULL);
+  CHECK_EXIT("test_barrier");
+}
+
+static void Idle(void) {
+  while(1) {
+    Sim_Idle();
+  }
+}
+
+int main(void) {
+  OS_Init();
+  OS_InitBarrier(&Barrier, PARTIES);
+  OS_InitSemaphore(&Done, 0);
+  OS_AddThread(Checker, 512, 0);
+  for(uint32_t i = 0; i < PARTIES; i++) {
+    OS_AddThread(Worker, 512, i + 1);
+  }
+  OS_AddThread(Idle, 512, 7);
+  OS_Launch(TIME_2MS);
+  return 1;
+}
@@ -0,0 +1,120 @@
+// filename ************** test_cond.c *************************
+// Host test of OS_Cond on the simulated kernel, see sim.h
+// Five waiters at priorities 1 to 5 sleep on one condition guarded by
+// a binary semaphore. A low priority broadcaster checks that every
+// broadcast wakes them once each, in priority order, with one switch
+// per waiter. A high priority thread then fires bursts of broadcasts
+// faster than the waiters can re-wait, which must not lose any update.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "sim.h"
+#include "check.h"
+
+
+#define WAITERS 5
+#define ROUNDS  1000    // broadcasts from the low priority thread
+#define BURSTS  100     // bursts from the high priority thread
+#define BURST   20      // broadcasts per burst
+
+static Sema4Type Mutex;
+static CondType Cond;
+static Sema4Type Done;
+static uint32_t Gen;                 // the condition, guarded by Mutex
+static uint32_t Waiting;             // waiters blocked in OS_CondWait
+static uint32_t Seen[WAITERS];       // last Gen each waiter saw
+static uint32_t Wakeups[WAITERS];    // times each waiter saw a new Gen
+static uint32_t Returns[WAITERS];    // times OS_CondWait returned
+static uint32_t Order[WAITERS];
+static uint32_t OrderLength;
+
+static void Waiter(void) {
+  uint32_t slot = OS_GetPriority(OS_Id()) - 1;
+  OS_bWait(&Mutex);
+  while(1) {
+    Waiting++;
+    while(Gen == Seen[slot]) {
+      OS_CondWait(&Cond, &Mutex);
+      Returns[slot]++;
+    }
+    Waiting--;
+    Seen[slot] = Gen;
+    Wakeups[slot]++;
+    if(OrderLength < WAITERS) {
+      Order[OrderLength++] = slot;
+    }
+  }
+}
+
+// lowest priority, all waiters are blocked whenever it runs
+static void Broadcaster(void) {
+  for(uint32_t round = 0; round < ROUNDS; round++) {
+    CHECK(Waiting == WAITERS);
+    OrderLength = 0;
+    OS_bWait(&Mutex);
+    Gen++;
+    OS_bSignal(&Mutex);
+    uint32_t switches = OS_ContextSwitches();
+    OS_CondBroadcast(&Cond);
+    // every waiter ran once and blocked again before we got back
+    CHECK(OS_ContextSwitches() - switches == WAITERS + 1);
+    CHECK(OrderLength == WAITERS);
+    for(uint32_t i = 0; i < OrderLength; i++) {
+      CHECK(Order[i] == i);
+    }
+  }
+  OS_Signal(&Done);
+  OS_Kill();
+}
+
+static void CheckAllSeen(uint32_t expected) {
+  for(uint32_t i = 0; i < WAITERS; i++) {
+    CHECK(Seen[i] == Gen);
+    CHECK(Wakeups[i] == expected);
+    CHECK(Returns[i] == expected); // no spurious returns
+  }
+}
+
+static void Controller(void) {
+  OS_Wait(&Done);
+  CheckAllSeen(ROUNDS);
+
+  // bursts while the waiters are still ready from the previous wakeup
+  for(uint32_t burst = 0; burst < BURSTS; burst++) {
+    for(uint32_t i = 0; i < BURST; i++) {
+      OS_bWait(&Mutex);
+      Gen++;
+      OS_bSignal(&Mutex);
+      OS_CondBroadcast(&Cond);
+      Sim_Run(100);
+    }
+    OS_Sleep(1);
+    CHECK(Waiting == WAITERS);
+  }
+  CheckAllSeen(ROUNDS + BURSTS);
+
+  CHECK_EXIT("test_cond");
+}
+
+static void Idle(void) {
+  while(1) {
+    Sim_Idle();
+  }
+}
+
+int main(void) {
+  static const uint32_t priorities[WAITERS] = {3, 1, 5, 2, 4}; // added out of order
+  OS_Init();
+  OS_InitSemaphore(&Mutex, 1);
+  OS_InitSemaphore(&Done, 0);
+  OS_InitCond(&Cond);
+  OS_AddThread(Controller, 512, 0);
+  for(uint32_t i = 0; i < WAITERS; i++) {
+    OS_AddThread(Waiter, 512, priorities[i]);
+  }
+  OS_AddThread(Broadcaster, 512, WAITERS + 1);
+  OS_AddThread(Idle, 512, WAITERS + 2);
+  OS_Launch(TIME_2MS);
+  return 1;
+}
@@ -0,0 +1,289 @@
+// filename ************** test_elfload.c *************************
+// Host harness of the streaming ELF loader on the simulated kernel
+// Builds a relocatable ARM object in memory (4 KB of code, read-only
+// data, data, bss, 600 relocations and an undefined symbol), writes it
+// to a file on the RAM disk and loads it with ELF_Load. Every relocated
+// field is decoded and checked, then the load time is compared with
+// reading the same file a byte at a time with eFile_ReadNext.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/eFile.h"
+#include "../RTOS_Labs_common/heap.h"
+#include "../RTOS_Labs_common/elfload.h"
+#include "sim.h"
+#include "check.h"
+
+
+//---------- sample object -----------------
+#define TEXT_BYTES   4096
+#define RODATA_BYTES 16
+#define DATA_BYTES   1024
+#define BSS_BYTES    512
+#define LITERALS     600     // extra ABS32 relocations at 0x200
+enum { S_NULL, S_TEXT, S_RODATA, S_DATA, S_BSS, S_RELTEXT, S_SYMTAB, S_STRTAB, S_RELDATA, S_SHSTRTAB, SECTIONS };
+enum { Y_NULL, Y_TEXT, Y_DATA, Y_MAIN, Y_HELPER, Y_COUNTER, Y_EXPORTED, Y_BUFFER, Y_MESSAGE, SYMBOLS };
+
+static uint8_t Image[32*1024];
+static uint32_t ImageBytes;
+
+static void Put16(uint8_t *p, uint32_t v) { p[0] = v; p[1] = v >> 8; }
+static void Put32(uint8_t *p, uint32_t v) { Put16(p, v); Put16(p + 2, v >> 16); }
+static uint32_t Get16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+static uint32_t Get32(const uint8_t *p) { return Get16(p) | (Get16(p + 2) << 16); }
+
+static uint32_t Append(const void *data, uint32_t bytes) {
+  uint32_t offset = (ImageBytes + 3) & ~3u;
+  if(data) memcpy(&Image[offset], data, bytes);
+  else memset(&Image[offset], 0, bytes);
+  ImageBytes = offset + bytes;
+  return offset;
+}
+
+static uint32_t Rel[2][2*(LITERALS + 8)];
+static uint32_t RelCount[2];
+static void AddRel(int data, uint32_t offset, uint32_t symbol, uint32_t type) {
+  uint32_t *r = &Rel[data][2*RelCount[data]++];
+  r[0] = offset;
+  r[1] = (symbol << 8) | type;
+}
+
+// sample object, exported names the undefined symbol
+static void BuildObject(const char *exported) {
+  static uint8_t text[TEXT_BYTES], data[DATA_BYTES];
+  static const char rodata[RODATA_BYTES] = "hello, loader";
+  char strtab[64], shstrtab[96];
+  uint32_t name[SYMBOLS], shname[SECTIONS];
+  uint32_t strBytes = 1, shstrBytes = 1;
+  static const char *const symbolNames[SYMBOLS] = {"", "", "", "main", "helper", "counter", 0, "buffer", "message"};
+  static const char *const sectionNames[SECTIONS] = {"", ".text", ".rodata", ".data", ".bss",
+    ".rel.text", ".symtab", ".strtab", ".rel.data", ".shstrtab"};
+  memset(strtab, 0, sizeof(strtab));
+  memset(shstrtab, 0, sizeof(shstrtab));
+  for(int i = 0; i < SYMBOLS; i++) {
+    const char *n = i == Y_EXPORTED ? exported : symbolNames[i];
+    name[i] = n[0] ? strBytes : 0;
+    strcpy(&strtab[strBytes], n);
+    strBytes += n[0] ? strlen(n) + 1 : 0;
+  }
+  for(int i = 0; i < SECTIONS; i++) {
+    shname[i] = shstrBytes;
+    strcpy(&shstrtab[shstrBytes], sectionNames[i]);
+    shstrBytes += strlen(sectionNames[i]) + 1;
+  }
+
+  // code is NOPs around the relocated fields
+  for(int i = 0; i < TEXT_BYTES; i += 2) Put16(&text[i], 0xBF00);
+  RelCount[0] = RelCount[1] = 0;
+  Put16(&text[0x40], 0xF7FF); Put16(&text[0x42], 0xFFFE);   // BL Exported, addend -4
+  AddRel(0, 0x40, Y_EXPORTED, 10);
+  Put16(&text[0x44], 0xF7FF); Put16(&text[0x46], 0xBFFE);   // B.W helper
+  AddRel(0, 0x44, Y_HELPER, 30);
+  Put16(&text[0x48], 0xF240); Put16(&text[0x4A], 0x0000);   // MOVW r0,#:lower16:counter
+  AddRel(0, 0x48, Y_COUNTER, 47);
+  Put16(&text[0x4C], 0xF2C0); Put16(&text[0x4E], 0x0000);   // MOVT r0,#:upper16:counter
+  AddRel(0, 0x4C, Y_COUNTER, 48);
+  Put32(&text[0x100], 0x10);                                  // .data+16
+  AddRel(0, 0x100, Y_DATA, 2);
+  Put32(&text[0x104], 0);                                     // message
+  AddRel(0, 0x104, Y_MESSAGE, 2);
+  Put32(&text[0x108], 0);                                     // buffer-.
+  AddRel(0, 0x108, Y_BUFFER, 3);
+  for(uint32_t i = 0; i < LITERALS; i++) {
+    Put32(&text[0x200 + 4*i], i);                             // counter+i
+    AddRel(0, 0x200 + 4*i, Y_COUNTER, 2);
+  }
+  memset(data, 0x5A, sizeof(data));
+  Put32(&data[0], 0);                                         // function table
+  AddRel(1, 0, Y_MAIN, 2);
+  Put32(&data[4], 0);
+  AddRel(1, 4, Y_HELPER, 2);
+
+  uint8_t symtab[SYMBOLS*16];
+  static const struct { uint32_t value; uint8_t info; uint16_t shndx; } sym[SYMBOLS] = {
+    {0, 0, 0}, {0, 0x03, S_TEXT}, {0, 0x03, S_DATA}, {0x21, 0x12, S_TEXT}, {0x101, 0x02, S_TEXT},
+    {8, 0x11, S_DATA}, {0, 0x10, 0}, {0, 0x11, S_BSS}, {0, 0x11, S_RODATA}};
+  memset(symtab, 0, sizeof(symtab));
+  for(int i = 0; i < SYMBOLS; i++) {
+    Put32(&symtab[16*i], name[i]);
+    Put32(&symtab[16*i + 4], sym[i].value);
+    symtab[16*i + 12] = sym[i].info;
+    Put16(&symtab[16*i + 14], sym[i].shndx);
+  }
+
+  ImageBytes = 52;
+  uint32_t offset[SECTIONS] = {0}, size[SECTIONS] = {0};
+  offset[S_TEXT] = Append(text, size[S_TEXT] = TEXT_BYTES);
+  offset[S_RODATA] = Append(rodata, size[S_RODATA] = RODATA_BYTES);
+  offset[S_DATA] = Append(data, size[S_DATA] = DATA_BYTES);
+  size[S_BSS] = BSS_BYTES;
+  offset[S_RELTEXT] = Append(Rel[0], size[S_RELTEXT] = 8*RelCount[0]);
+  offset[S_SYMTAB] = Append(symtab, size[S_SYMTAB] = sizeof(symtab));
+  offset[S_STRTAB] = Append(strtab, size[S_STRTAB] = strBytes);
+  offset[S_RELDATA] = Append(Rel[1], size[S_RELDATA] = 8*RelCount[1]);
+  offset[S_SHSTRTAB] = Append(shstrtab, size[S_SHSTRTAB] = shstrBytes);
+  static const uint32_t type[SECTIONS] = {0, 1, 1, 1, 8, 9, 2, 3, 9, 3};
+  static const uint32_t flags[SECTIONS] = {0, 6, 2, 3, 3, 0, 0, 0, 0, 0};
+  static const uint32_t link[SECTIONS] = {0, 0, 0, 0, 0, S_SYMTAB, S_STRTAB, 0, S_SYMTAB, 0};
+  static const uint32_t info[SECTIONS] = {0, 0, 0, 0, 0, S_TEXT, Y_COUNTER, 0, S_DATA, 0};
+  static const uint32_t align[SECTIONS] = {0, 4, 4, 8, 4, 4, 4, 1, 4, 1};
+  uint32_t shoff = Append(0, 40*SECTIONS);
+  for(int i = 0; i < SECTIONS; i++) {
+    uint8_t *sh = &Image[shoff + 40*i];
+    Put32(sh, i ? shname[i] : 0);
+    Put32(sh + 4, type[i]);
+    Put32(sh + 8, flags[i]);
+    Put32(sh + 16, offset[i]);
+    Put32(sh + 20, size[i]);
+    Put32(sh + 24, link[i]);
+    Put32(sh + 28, info[i]);
+    Put32(sh + 32, align[i]);
+    Put32(sh + 36, type[i] == 2 ? 16 : type[i] == 9 ? 8 : 0);
+  }
+  memset(Image, 0, 52);
+  memcpy(Image, "\177ELF\1\1\1", 7);
+  Put16(&Image[16], 1);         // ET_REL
+  Put16(&Image[18], 40);        // EM_ARM
+  Put32(&Image[20], 1);
+  Put32(&Image[32], shoff);
+  Put16(&Image[40], 52);
+  Put16(&Image[46], 40);
+  Put16(&Image[48], SECTIONS);
+  Put16(&Image[50], S_SHSTRTAB);
+}
+
+static void WriteFile(const char *name) {
+  CHECK(eFile_Create(name) == 0);
+  CHECK(eFile_WOpen(name) == 0);
+  for(uint32_t i = 0; i < ImageBytes; i++) {
+    eFile_Write(Image[i]);
+  }
+  CHECK(eFile_WClose() == 0);
+}
+
+//---------- checks -----------------
+static uint32_t Branch(const uint8_t *p, uint32_t place) {
+  uint32_t upper = Get16(p), lower = Get16(p + 2);
+  uint32_t s = (upper >> 10) & 1;
+  uint32_t i1 = !(((lower >> 13) & 1) ^ s), i2 = !(((lower >> 11) & 1) ^ s);
+  int32_t offset = (s << 24) | (i1 << 23) | (i2 << 22) | ((upper & 0x3FF) << 12) | ((lower & 0x7FF) << 1);
+  if(s) offset -= 1 << 25;
+  return place + 4 + offset;
+}
+
+static uint32_t Movw(const uint8_t *p) {
+  uint32_t upper = Get16(p), lower = Get16(p + 2);
+  return ((upper & 0xF) << 12) | ((upper & 0x400) << 1) | ((lower & 0x7000) >> 4) | (lower & 0xFF);
+}
+
+// stands in for a kernel function, host code has no Thumb alignment
+static uint16_t Exported[2] __attribute__((aligned(4)));
+
+static const ELF_Symbol_t Symbols[] = {
+  {"Other", 0},
+  {"Exported", Exported},
+};
+
+static void CheckImage(const ELF_Image_t *image) {
+  uint8_t *text = image->text, *data = image->data;
+  uint32_t t = (uint32_t)(uintptr_t) text, d = (uint32_t)(uintptr_t) data;
+  uint32_t rodata = t + TEXT_BYTES, counter = d + 8, bss = d + DATA_BYTES;
+  CHECK(image->textBytes == TEXT_BYTES + RODATA_BYTES);
+  CHECK(image->dataBytes == DATA_BYTES + BSS_BYTES);
+  CHECK(image->relocations == RelCount[0] + RelCount[1]);
+  CHECK((uint32_t)(uintptr_t) image->entry == t + 0x21);
+  CHECK(Branch(&text[0x40], t + 0x40) == (uint32_t)(uintptr_t) Exported);
+  CHECK((Get16(&text[0x42]) & 0xD000) == 0xD000);           // still a BL
+  CHECK(Branch(&text[0x44], t + 0x44) == t + 0x100);
+  CHECK((Get16(&text[0x46]) & 0xD000) == 0x9000);           // still a B.W
+  CHECK((Movw(&text[0x48]) | (Movw(&text[0x4C]) << 16)) == counter);
+  CHECK(Get32(&text[0x100]) == d + 16);
+  CHECK(Get32(&text[0x104]) == rodata);
+  CHECK(Get32(&text[0x108]) == bss - (t + 0x108));
+  for(uint32_t i = 0; i < LITERALS; i += 97) {
+    CHECK(Get32(&text[0x200 + 4*i]) == counter + i);
+  }
+  CHECK(Get16(&text[0x50]) == 0xBF00 && Get16(&text[TEXT_BYTES - 2]) == 0xBF00);
+  CHECK(strcmp((char*) &text[TEXT_BYTES], "hello, loader") == 0);
+  CHECK(Get32(&data[0]) == t + 0x21);
+  CHECK(Get32(&data[4]) == t + 0x101);
+  CHECK(data[8] == 0x5A && data[DATA_BYTES - 1] == 0x5A);
+  CHECK(data[DATA_BYTES] == 0 && data[DATA_BYTES + BSS_BYTES - 1] == 0);
+}
+
+static void Test(void) {
+  heap_stats_t before, after;
+  ELF_Image_t image;
+
+  BuildObject("Exported");
+  WriteFile("user");
+  Heap_Stats(&before);
+  uint64_t start = Sim_Now();
+  int error = ELF_Load("user", Symbols, 2, &image);
+  uint64_t loadCycles = Sim_Now() - start;
+  CHECK(error == ELF_OK);
+  if(error != ELF_OK) {
+    printf("test_elfload: ELF_Load error %d\n", error);
+    exit(1);
+  }
+  CheckImage(&image);
+  uint32_t relocations = image.relocations;
+  CHECK(image.fileBytes <= ImageBytes);
+  Heap_Free(image.text);
+  Heap_Free(image.data);
+  Heap_Stats(&after);
+  CHECK(after.free == before.free);                          // temporaries freed
+
+  // what a byte at a time reader pays just to get the bytes
+  char c;
+  uint32_t bytes = 0;
+  start = Sim_Now();
+  CHECK(eFile_ROpen("user") == 0);
+  while(eFile_ReadNext(&c) == 0) {
+    bytes++;
+  }
+  eFile_RClose();
+  uint64_t byteCycles = Sim_Now() - start;
+  CHECK(bytes == ImageBytes);
+  CHECK(loadCycles < byteCycles);
+
+  // errors leave nothing allocated
+  BuildObject("Missing");
+  WriteFile("bad");
+  CHECK(ELF_Load("bad", Symbols, 2, &image) == ELF_ERR_SYMBOL);
+  CHECK(ELF_Load("none", Symbols, 2, &image) == ELF_ERR_FILE);
+  CHECK(eFile_Create("empty") == 0);
+  CHECK(eFile_WOpen("empty") == 0);
+  for(int i = 0; i < 64; i++) eFile_Write(0);
+  CHECK(eFile_WClose() == 0);
+  CHECK(ELF_Load("empty", Symbols, 2, &image) == ELF_ERR_FORMAT);
+  // no room for the arena, the loaded image is freed again
+  CHECK(ELF_Exec("user", Symbols, 2, 128, 1, HEAP_SIZE*sizeof(int32_t)) == ELF_ERR_MEMORY);
+  Heap_Stats(&after);
+  CHECK(after.free == before.free);
+
+  printf("elfload: %u byte object, %u relocations: ELF_Load %u us, eFile_ReadNext loop %u us\n",
+         (unsigned) ImageBytes, (unsigned) relocations,
+         (unsigned)(loadCycles/80), (unsigned)(byteCycles/80));
+  CHECK_EXIT("test_elfload");
+}
+
+static void Idle(void) {
+  while(1) {
+    Sim_Idle();
+  }
+}
+
+int main(void) {
+  OS_Init();
+  if(eFile_Init() || eFile_Format()) {
+    printf("test_elfload: no disk\n");
+    return 1;
+  }
+  OS_AddThread(Test, 512, 1);
+  OS_AddThread(Idle, 512, 2);
+  OS_Launch(TIME_2MS);
+  return 1;
+}
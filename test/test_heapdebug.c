@@ -0,0 +1,84 @@
+// filename ************** test_heapdebug.c *************************
+// Host test of the debug heap (HEAP_DEBUG) on the simulated kernel, see sim.h
+// A thread that exits holding a block is logged both when the heap lock
+// is free and when another thread holds it, in which case the walk waits
+// for the lock to be let go. A block whose trailing guard is overwritten
+// is reported by the sweep thread OS_Init adds.
+// The UART output is captured and searched.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/heap.h"
+#include "sim.h"
+#define CHECK_OUT stderr
+#include "check.h"
+
+
+extern Sema4Type heap;   // the heap lock
+
+static Sema4Type Go;
+static volatile uint32_t Leaked;
+static char *Output;
+static size_t OutputSize;
+
+static void Leaker(void) {
+  Heap_Malloc(40);
+  OS_Wait(&Go);
+  Leaked++;
+  OS_Kill();
+}
+
+// log lines in the captured output after the line starting with header
+static uint32_t LinesAfter(const char *header) {
+  fflush(stdout);
+  char *line = strstr(Output, header);
+  uint32_t n = 0;
+  if(line != NULL) {
+    for(line = strchr(line, '\n'); line != NULL && line[1] != 0; line = strchr(line + 1, '\n')) {
+      n++;
+    }
+  }
+  return n;
+}
+
+static void Checker(void) {
+  OS_AddThread(Leaker, 128, 1);
+  OS_Signal(&Go);                      // exits with the lock free
+  OS_AddThread(Leaker, 128, 1);
+  OS_bWait(&heap);                     // exits with the lock held
+  OS_Signal(&Go);
+  CHECK(Leaked == 2);
+  OS_bSignal(&heap);                   // plain signal, the walk is still queued
+  heap_stats_t stats;
+  Heap_Stats(&stats);                  // its unlock walks it
+  Heap_DebugReport();
+  CHECK(LinesAfter("exits with blocks") == 2);
+  int32_t *block = Heap_Malloc(40);
+  block[10] = 0;                       // the guard word behind the data
+  OS_Sleep(2*HEAP_SWEEP_MS);
+  fflush(stdout);
+  CHECK(strstr(Output, "corrupt 1") != NULL);
+  fclose(stdout);
+  if(Failures) {
+    fputs(Output, stderr);
+  }
+  CHECK_EXIT("test_heapdebug");
+}
+
+static void Idle(void) {
+  while(1) {
+    Sim_Idle();
+  }
+}
+
+int main(void) {
+  stdout = open_memstream(&Output, &OutputSize);
+  OS_Init();
+  OS_InitSemaphore(&Go, 0);
+  OS_AddThread(Checker, 512, 2);
+  OS_AddThread(Idle, 512, 7);
+  OS_Launch(TIME_2MS);
+  return 1;
+}
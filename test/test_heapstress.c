@@ -0,0 +1,59 @@
+// filename ************** test_heapstress.c *************************
+// Host build of the heap stress test (heapstress.c) on the simulated
+// kernel, see sim.h
+// The random workload and HeapStressTrace run under every policy on a
+// region of the test's own and must find no error; the kernel heap sees
+// none of their calls. HeapStress_Run prints its table with
+// "test_heapstress -v", its time columns come from the simulated clock
+// and say nothing about the board.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/heap.h"
+#include "../RTOS_Labs_common/heapstress.h"
+#include "sim.h"
+#include "check.h"
+
+
+static int32_t Memory[4096];
+static int Verbose;
+
+static void Checker(void) {
+  heap_stats_ex_t before, after;
+  heap_stress_result_t result;
+  Heap_StatsEx(0, &before);
+  heap_t *region = Heap_AddRegion(Memory, sizeof(Memory));
+  CHECK(region != NULL);
+  for(uint32_t policy = HEAP_GOODFIT; policy <= HEAP_BESTFIT; policy++) {
+    CHECK(Heap_SetPolicy(region, policy) == 0);
+    for(uint32_t seed = 1; seed <= 4; seed++) {
+      CHECK(HeapStress_Random(region, seed, 20000, &result) == 0);
+      CHECK(result.ops >= 20000 && result.failures < result.ops/2);
+    }
+    CHECK(HeapStress_Trace(region, HeapStressTrace, HeapStressTraceLength, 200, &result) == 0);
+    CHECK(result.failures == 0);
+  }
+  if(Verbose) {
+    CHECK(HeapStress_Run(1) == 0);
+  }
+  Heap_StatsEx(0, &after);
+  CHECK(after.mallocs == before.mallocs && after.used == before.used);
+  CHECK_EXIT("test_heapstress");
+}
+
+static void Idle(void) {
+  while(1) {
+    Sim_Idle();
+  }
+}
+
+int main(int argc, char **argv) {
+  Verbose = argc > 1 && !strcmp(argv[1], "-v");
+  OS_Init();
+  OS_AddThread(Checker, 512, 2);
+  OS_AddThread(Idle, 512, 7);
+  OS_Launch(TIME_2MS);
+  return 1;
+}
@@ -0,0 +1,151 @@
+// filename ************** test_hheap.c *************************
+// Randomized test of the compacting heap (hheap.c) on the simulated
+// kernel, see sim.h
+// A thread allocates, frees, locks and unlocks blocks at random and keeps
+// some locked across sleeps while HHeap_Compactor moves the rest in idle
+// time and HHeap_Compact steps of random size run in between. Every block
+// keeps its contents, a locked block never moves, the statistics add up,
+// and with nothing locked an allocation of all the free space succeeds.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/hheap.h"
+#include "sim.h"
+#define CHECK_CONTEXT Op
+#include "check.h"
+
+
+#define OPS 100000
+
+static uint32_t Memory[2048];
+static hhandle_t Handle[HHEAP_HANDLES];
+static int32_t Size[HHEAP_HANDLES];
+static uint8_t Pattern[HHEAP_HANDLES];
+static uint8_t *Locked[HHEAP_HANDLES];  // address while locked, else NULL
+static uint32_t Op;
+static uint32_t Full, FullOk;
+
+static uint32_t Seed = 1;
+static uint32_t Random(uint32_t n) {
+  Seed = 1664525*Seed + 1013904223;
+  return (Seed >> 8) % n;
+}
+
+static int Kept(uint32_t j, uint8_t *data) {
+  for(int32_t b = 0; b < Size[j]; b++) {
+    if(data[b] != (uint8_t)(Pattern[j] + b)) return 0;
+  }
+  return 1;
+}
+
+// statistics agree with the blocks the test holds
+static void Consistent(void) {
+  heap_stats_ex_t stats;
+  uint32_t used = 0;
+  CHECK(HHeap_Stats(&stats) == 0);
+  for(uint32_t j = 0; j < HHEAP_HANDLES; j++) {
+    if(Handle[j] != HHEAP_NONE) {
+      uint32_t bytes = HHeap_Size(Handle[j]);
+      CHECK(bytes >= (uint32_t) Size[j]);
+      used += bytes;
+    }
+  }
+  CHECK(stats.used == used);
+}
+
+// with every block unlocked all of the free space can be allocated
+static void AllFree(void) {
+  heap_stats_ex_t stats;
+  uint32_t slot = 0;
+  for(uint32_t j = 0; j < HHEAP_HANDLES; j++) {
+    if(Locked[j] != NULL) {
+      CHECK(Kept(j, Locked[j]));
+      CHECK(HHeap_Unlock(Handle[j]) == 0);
+      Locked[j] = NULL;
+    }
+    if(Handle[j] == HHEAP_NONE) slot = 1;
+  }
+  HHeap_Stats(&stats);
+  // headers of the free blocks turn into space as they merge
+  int32_t bytes = stats.free + 4*(stats.freeBlocks - 1);
+  if(slot && bytes > 0) {
+    Full++;
+    hhandle_t all = HHeap_Alloc(bytes);
+    CHECK(all != HHEAP_NONE);
+    if(all != HHEAP_NONE) {
+      FullOk++;
+      HHeap_Free(all);
+    }
+  }
+}
+
+static void Mutator(void) {
+  CHECK(HHeap_Init(Memory, sizeof(Memory)) == 0);
+  for(Op = 0; Op < OPS && Failures < 10; Op++) {
+    uint32_t j = Random(HHEAP_HANDLES);
+    uint32_t r = Random(100);
+    if(r < 3) {
+      HHeap_Compact(Random(200));
+    }
+    else if(r < 6) {
+      OS_Sleep(1);                     // the compactor runs
+    }
+    else if(Handle[j] == HHEAP_NONE) {
+      Size[j] = Random(Random(10) == 0 ? 2000 : 120);
+      Handle[j] = HHeap_Alloc(Size[j]);
+      if(Handle[j] != HHEAP_NONE) {
+        uint8_t *data = HHeap_Lock(Handle[j]);
+        Pattern[j] = Random(256);
+        for(int32_t b = 0; b < Size[j]; b++) {
+          data[b] = Pattern[j] + b;
+        }
+        HHeap_Unlock(Handle[j]);
+      }
+    }
+    else if(r < 20 && Locked[j] == NULL) {
+      Locked[j] = HHeap_Lock(Handle[j]);
+      CHECK(Locked[j] != NULL);
+    }
+    else if(r < 45 && Locked[j] != NULL) {
+      CHECK(HHeap_Lock(Handle[j]) == Locked[j]); // never moved
+      CHECK(Kept(j, Locked[j]));
+      HHeap_Unlock(Handle[j]);
+      HHeap_Unlock(Handle[j]);
+      Locked[j] = NULL;
+    }
+    else if(Locked[j] == NULL) {
+      uint8_t *data = HHeap_Lock(Handle[j]);
+      CHECK(Kept(j, data));
+      HHeap_Unlock(Handle[j]);
+      CHECK(HHeap_Free(Handle[j]) == 0);
+      Handle[j] = HHEAP_NONE;
+    }
+    else {
+      CHECK(HHeap_Free(Handle[j]) == 1); // locked blocks can't be freed
+    }
+    Consistent();
+    if(Op%1000 == 999) {
+      AllFree();
+    }
+  }
+  CHECK(FullOk == Full && Full > 0);
+  CHECK(HHeap_Free(HHEAP_NONE) == 1 && HHeap_Unlock(HHEAP_HANDLES + 1) == 1);
+  CHECK(HHeap_Lock(HHEAP_HANDLES + 1) == NULL);
+  CHECK_EXIT("test_hheap");
+}
+
+static void Idle(void) {
+  while(1) {
+    Sim_Idle();
+  }
+}
+
+int main(void) {
+  OS_Init();
+  OS_AddThread(Mutator, 512, 2);
+  OS_AddThread(HHeap_Compactor, 512, 6);
+  OS_AddThread(Idle, 512, 7);
+  OS_Launch(TIME_2MS);
+  return 1;
+}
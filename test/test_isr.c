@@ -0,0 +1,84 @@
+// filename ************** test_isr.c *************************
+// Host test of the interrupt pools (Heap_ISRMalloc) on the simulated
+// kernel, see sim.h, built with 4, 2 and 1 blocks in the three classes
+// Blocks allocated by an interrupt handler are handed to a thread, which
+// moves some to the heap with Heap_Realloc: the data is kept, the new
+// block is a heap block and the pool block is free again.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/heap.h"
+#include "sim.h"
+#include "check.h"
+
+
+#define SMALL (HEAP_ISR_COUNT0 + HEAP_ISR_COUNT1)  // 16 byte requests, with the spill
+
+static uint8_t *Block[SMALL + 1];
+static volatile int Ran;
+
+static void Handler(void) {
+  for(int i = 0; i <= SMALL; i++) {
+    Block[i] = Heap_ISRMalloc(12);
+    if(Block[i]) {
+      for(int b = 0; b < 12; b++) {
+        Block[i][b] = i + b;
+      }
+    }
+  }
+  Ran = 1;
+}
+
+static int Kept(uint8_t *block, int i, int bytes) {
+  for(int b = 0; b < bytes; b++) {
+    if(block[b] != (uint8_t)(i + b)) return 0;
+  }
+  return 1;
+}
+
+static void Checker(void) {
+  heap_stats_t stats;
+  Heap_Stats(&stats);
+  uint32_t empty = stats.free;
+  Sim_Interrupt(Handler, Sim_Now() + 1000, 0);
+  OS_Sleep(2);
+  CHECK(Ran);
+  for(int i = 0; i < SMALL; i++) {
+    CHECK(Block[i] != NULL);
+  }
+  CHECK(Block[SMALL] == NULL);         // the 512 byte class is not used
+  for(int i = 0; i < SMALL; i++) {
+    int bytes = (i & 1) ? 200 : 8;     // grow or shrink, both move
+    uint8_t *block = Heap_Realloc(Block[i], bytes);
+    CHECK(block != NULL && block != Block[i]);
+    CHECK(Kept(block, i, bytes < 12 ? bytes : 12));
+    CHECK(Heap_ISRFree(block) != 0);   // not a pool block
+    Block[i] = block;
+  }
+  for(int i = 0; i < SMALL; i++) {     // the pools are full again
+    void *pooled = Heap_ISRMalloc(12);
+    CHECK(pooled != NULL);
+    Heap_Free(pooled);
+    Heap_Free(Block[i]);
+  }
+  CHECK(Heap_Realloc(Heap_ISRMalloc(16), 100000) == NULL);
+  CHECK(Heap_Check(0) == 0);
+  Heap_Stats(&stats);
+  CHECK(stats.free == empty);
+  CHECK_EXIT("test_isr");
+}
+
+static void Idle(void) {
+  while(1) {
+    Sim_Idle();
+  }
+}
+
+int main(void) {
+  OS_Init();
+  OS_AddThread(Checker, 512, 2);
+  OS_AddThread(Idle, 512, 7);
+  OS_Launch(TIME_2MS);
+  return 1;
+}
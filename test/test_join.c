@@ -0,0 +1,95 @@
+// filename ************** test_join.c *************************
+// Host test of OS_Join on the simulated kernel, see sim.h
+// A timed join gives up after its timeout while the thread still runs,
+// and wakes as soon as the thread exits when that comes first. A
+// finished thread's code can be joined until its ID is given to a new
+// thread; from then on the old handle is rejected at once, as is a
+// handle that was never handed out.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "sim.h"
+#include "check.h"
+
+#define MS SIM_CYCLES_PER_MS
+
+static Sema4Type Hold;
+
+static void Slow(void) {
+  OS_Sleep(20);
+  OS_ThreadExit(7);
+}
+
+static void Quick(void) {
+  OS_Sleep(3);
+  OS_ThreadExit(9);
+}
+
+static void Holder(void) {
+  OS_Wait(&Hold);
+  OS_ThreadExit(11);
+}
+
+static void Checker(void) {
+  int32_t code = -1;
+  int32_t slow = OS_AddThreadId(Slow, 256, 2);
+  CHECK(slow >= 0);
+  uint64_t start = Sim_Now();
+  CHECK(OS_Join(slow, &code, 5) == 0);   // times out
+  uint64_t waited = Sim_Now() - start;
+  CHECK(waited >= 4*MS && waited <= 6*MS);
+  CHECK(code == -1);
+  CHECK(OS_Join(slow, &code, 0) == 1);   // forever
+  CHECK(code == 7);
+  CHECK(Sim_Now() - start >= 19*MS);
+
+  int32_t quick = OS_AddThreadId(Quick, 256, 2);
+  CHECK(quick >= 0);
+  start = Sim_Now();
+  CHECK(OS_Join(quick, &code, 50) == 1); // the exit comes first
+  CHECK(code == 9);
+  CHECK(Sim_Now() - start < 5*MS);
+  code = -1;
+  CHECK(OS_Join(quick, &code, 10) == 1); // already gone, code kept
+  CHECK(code == 9);
+
+  // give the ID of Quick to a new thread
+  int32_t holder;
+  int holders = 0;
+  do {
+    holder = OS_AddThreadId(Holder, 256, 2);
+    CHECK(holder >= 0);
+    holders++;
+  } while(holder >= 0 && OS_THREAD_ID(holder) != OS_THREAD_ID(quick) && holders < NUMTHREADS);
+  CHECK(OS_THREAD_ID(holder) == OS_THREAD_ID(quick) && holder != quick);
+  code = -1;
+  start = Sim_Now();
+  CHECK(OS_Join(quick, &code, 10) == 0); // stale handle
+  CHECK(Sim_Now() - start < MS);
+  CHECK(code == -1);
+  CHECK(OS_Join(holder + (5 << 8), &code, 10) == 0); // never handed out
+  CHECK(Sim_Now() - start < MS);
+  CHECK(OS_Join(OS_Id(), &code, 10) == 0); // itself
+  for(int i = 0; i < holders; i++) {
+    OS_Signal(&Hold);
+  }
+  CHECK(OS_Join(holder, &code, 0) == 1);
+  CHECK(code == 11);
+  CHECK_EXIT("test_join");
+}
+
+static void Idle(void) {
+  while(1) {
+    Sim_Idle();
+  }
+}
+
+int main(void) {
+  OS_Init();
+  OS_InitSemaphore(&Hold, 0);
+  OS_AddThread(Checker, 512, 1);
+  OS_AddThread(Idle, 512, 7);
+  OS_Launch(TIME_2MS);
+  return 1;
+}
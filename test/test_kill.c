@@ -0,0 +1,74 @@
+// filename ************** test_kill.c *************************
+// Host test of OS_Kill on the simulated kernel, see sim.h
+// A thread kills itself while every other TCB is in use, and an
+// interrupt that becomes pending inside OS_Kill runs before PendSV and
+// tries to add a thread. The dying thread is still RunPt on its own
+// stack at that point, so its TCB must not be handed out; once PendSV
+// has switched away the next OS_AddThread gets it.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "sim.h"
+#include "check.h"
+
+
+#define ROUNDS 100
+
+static Sema4Type Forever;
+static volatile int IsrAdded;
+static volatile int IsrRan;
+static volatile uint32_t ChildRuns;
+
+static void Child(void) {
+  ChildRuns++;
+  OS_Kill();
+}
+
+static void AddFromISR(void) {
+  IsrRan = 1;
+  IsrAdded = OS_AddThread(Child, 128, 1);
+}
+
+static void Killer(void) {
+  Sim_Interrupt(AddFromISR, Sim_Now() + 1, 0);
+  OS_Kill();
+}
+
+static void Filler(void) {
+  OS_Wait(&Forever);
+}
+
+static void Checker(void) {
+  for(uint32_t round = 0; round < ROUNDS; round++) {
+    IsrRan = IsrAdded = 0;
+    CHECK(OS_AddThread(Killer, 128, 1));
+    OS_Sleep(2);
+    CHECK(IsrRan);
+    CHECK(IsrAdded == 0);              // the dying TCB was not reused
+    CHECK(OS_AddThread(Child, 128, 1)); // now it is free
+    OS_Sleep(2);
+    CHECK(ChildRuns == round + 1);
+    if(Failures > 10) break;
+  }
+  CHECK_EXIT("test_kill");
+}
+
+static void Idle(void) {
+  while(1) {
+    Sim_Idle();
+  }
+}
+
+int main(void) {
+  OS_Init();
+  OS_InitSemaphore(&Forever, 0);
+  OS_AddThread(Checker, 512, 2);
+  OS_AddThread(Idle, 512, 7);
+  // every TCB but the one Checker's threads take turns in
+  for(int i = 0; i < NUMTHREADS - 3; i++) {
+    OS_AddThread(Filler, 128, 3);
+  }
+  OS_Launch(TIME_2MS);
+  return 1;
+}
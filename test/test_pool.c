@@ -0,0 +1,87 @@
+// filename ************** test_pool.c *************************
+// Host test of the heap storage of OS_InitPool and OS_DestroyPool on the
+// simulated kernel, see sim.h
+// A pool initialized again with memory NULL keeps or replaces its heap
+// block instead of leaking it, and a pool on a stack leaves the list
+// OS_Pools reports, and gives its block back, when it is destroyed.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/heap.h"
+#include "sim.h"
+#include "check.h"
+
+
+static uint32_t HeapFree(void) {
+  heap_stats_t stats;
+  Heap_Stats(&stats);
+  return stats.free;
+}
+
+static int Listed(PoolType *poolPt) {
+  PoolType *list[16];
+  uint32_t n = OS_Pools(list, 16);
+  for(uint32_t i = 0; i < n; i++) {
+    if(list[i] == poolPt) return 1;
+  }
+  return 0;
+}
+
+static PoolType Static;
+static uint32_t Memory[32];
+
+static void OnStack(void) {
+  PoolType pool;
+  uint32_t before = HeapFree();
+  CHECK(OS_InitPool(&pool, "stack", NULL, 24, 10));
+  CHECK(Listed(&pool));
+  CHECK(HeapFree() < before);
+  CHECK(OS_DestroyPool(&pool));
+  CHECK(!Listed(&pool));
+  CHECK(HeapFree() == before);
+  CHECK(OS_DestroyPool(&pool) == 0);
+}
+
+static void Checker(void) {
+  uint32_t before = HeapFree();
+  CHECK(OS_InitPool(&Static, "static", NULL, 16, 8));
+  uint32_t one = HeapFree();
+  for(int i = 0; i < 100; i++) {       // same size, the block is reused
+    CHECK(OS_InitPool(&Static, "static", NULL, 16, 8));
+    CHECK(OS_PoolAlloc(&Static) != NULL);
+  }
+  CHECK(HeapFree() == one);
+  CHECK(OS_InitPool(&Static, "static", NULL, 16, 4)); // smaller, reused too
+  CHECK(HeapFree() == one);
+  CHECK(OS_InitPool(&Static, "static", NULL, 64, 8)); // bigger, replaced
+  CHECK(HeapFree() < one);
+  CHECK(OS_InitPool(&Static, "static", NULL, 16, 8));
+  CHECK(OS_InitPool(&Static, "static", Memory, 16, 8)); // caller memory
+  CHECK(HeapFree() == before);
+  CHECK(OS_PoolAlloc(&Static) == (void*) &Memory[0]);
+  CHECK(OS_InitPool(&Static, "static", NULL, 16, 1000000) == 0); // no room
+  CHECK(OS_PoolAlloc(&Static) != NULL); // left as it was
+  for(int i = 0; i < 100; i++) {
+    OnStack();
+  }
+  CHECK(Listed(&Static));
+  CHECK(OS_DestroyPool(&Static));
+  CHECK(HeapFree() == before);
+  CHECK(Heap_Check(0) == 0);
+  CHECK_EXIT("test_pool");
+}
+
+static void Idle(void) {
+  while(1) {
+    Sim_Idle();
+  }
+}
+
+int main(void) {
+  OS_Init();
+  OS_AddThread(Checker, 512, 2);
+  OS_AddThread(Idle, 512, 7);
+  OS_Launch(TIME_2MS);
+  return 1;
+}
@@ -0,0 +1,148 @@
+// filename ************** test_priority.c *************************
+// Host test of OS_SetPriority on the simulated kernel, see sim.h
+// The priority of a thread changes while it is blocked on a semaphore,
+// while it sleeps and while it is NextRunPt with the switch to it still
+// pending. A blocked thread moves in the wait list so it is woken in
+// the new order, a sleeping thread wakes at its new priority, and a
+// thread picked to run next whose priority drops below the running
+// one does not run until its turn in the active ring.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../inc/CortexM.h"
+#include "sim.h"
+#include "check.h"
+
+#define WAITERS 3
+
+static Sema4Type Sem, Again;
+static uint32_t Ids[WAITERS];
+static uint32_t Order[WAITERS];
+static uint32_t Woken;
+
+static volatile int SpinDone;
+static volatile int SleeperFirst;
+
+static uint32_t Ran[2];   // order the picked thread and the spinner ran in
+static uint32_t Runs;
+
+static uint32_t Add(void(*task)(void), uint32_t priority) {
+  int32_t handle = OS_AddThreadId(task, 256, priority);
+  CHECK(handle >= 0);
+  return OS_THREAD_ID(handle);
+}
+
+static void Waiter(void) {
+  OS_Wait(&Sem);
+  for(uint32_t k = 0; k < WAITERS; k++) {
+    if(Ids[k] == OS_Id()) {
+      Order[Woken++] = k;
+    }
+  }
+  OS_Kill();
+}
+
+static void Sleeper(void) {
+  while(1) {
+    OS_Sleep(5);
+    SleeperFirst = !SpinDone;
+    OS_Wait(&Again);
+  }
+}
+
+static void Spinner(void) {
+  for(int i = 0; i < 20; i++) {
+    Sim_Run(SIM_CYCLES_PER_MS);
+  }
+  SpinDone = 1;
+  OS_Kill();
+}
+
+static void Picked(void) {
+  Ran[Runs++] = 0;
+  OS_Kill();
+}
+
+static void Other(void) {
+  Ran[Runs++] = 1;
+  OS_Kill();
+}
+
+static void Blocked(void) {
+  for(uint32_t k = 0; k < WAITERS; k++) {
+    Ids[k] = Add(Waiter, 4);
+    OS_Sleep(1);            // blocks in the order added
+  }
+  CHECK(OS_SetPriority(Ids[2], 2));
+  CHECK(OS_SetPriority(Ids[0], 5));
+  uint32_t last = 0;
+  uint32_t count = 0;
+  for(TCB_t* tcb = Sem.head; tcb != NULL; tcb = tcb->next) {
+    CHECK(tcb->priority >= last);
+    last = tcb->priority;
+    count++;
+  }
+  CHECK(count == WAITERS);
+  for(uint32_t k = 0; k < WAITERS; k++) {
+    OS_Signal(&Sem);
+  }
+  OS_Sleep(1);
+  CHECK(Woken == WAITERS);
+  CHECK(Order[0] == 2 && Order[1] == 1 && Order[2] == 0);
+}
+
+static void Sleeping(void) {
+  uint32_t sleeper = Add(Sleeper, 2);
+  for(int round = 0; round < 2; round++) {
+    if(round > 0) {
+      OS_Signal(&Again);
+    }
+    OS_Sleep(1);            // the sleeper is asleep for 5 ms now
+    SpinDone = 0;
+    SleeperFirst = -1;
+    CHECK(OS_SetPriority(sleeper, round == 0 ? 5 : 2));
+    Add(Spinner, 3);
+    OS_Sleep(30);
+    CHECK(SpinDone);
+    CHECK(SleeperFirst == round); // preempts the spinner only at 2
+  }
+  CHECK(OS_GetPriority(sleeper) == 2);
+}
+
+static void Pending(void) {
+  uint32_t picked = Add(Picked, 3);
+  Add(Other, 4);
+  // make Picked NextRunPt with the switch pending, then drop it below Other
+  long sr = StartCritical();
+  CHECK(OS_SetPriority(picked, 0));
+  CHECK(OS_SetPriority(picked, 5));
+  EndCritical(sr);
+  CHECK(Runs == 0);         // the Checker is still the highest
+  OS_Sleep(1);
+  CHECK(Runs == 2);
+  CHECK(Ran[0] == 1 && Ran[1] == 0);
+}
+
+static void Checker(void) {
+  Blocked();
+  Sleeping();
+  Pending();
+  CHECK_EXIT("test_priority");
+}
+
+static void Idle(void) {
+  while(1) {
+    Sim_Idle();
+  }
+}
+
+int main(void) {
+  OS_Init();
+  OS_InitSemaphore(&Sem, 0);
+  OS_InitSemaphore(&Again, 0);
+  OS_AddThread(Checker, 512, 1);
+  OS_AddThread(Idle, 512, 7);
+  OS_Launch(TIME_2MS);
+  return 1;
+}
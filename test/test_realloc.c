@@ -0,0 +1,140 @@
+// filename ************** test_realloc.c *************************
+// Property test of Heap_Realloc on the simulated kernel, see sim.h
+// A seeded random mix of Heap_Malloc, Heap_Realloc and Heap_Free on the
+// kernel heap is mirrored with the C library allocator as the reference:
+// every block keeps the bytes the reference copy has, shrinking stays in
+// place, a failed realloc leaves the block as it was and only fails when
+// a plain Heap_Malloc of that size fails too, live blocks never overlap
+// and Heap_Check passes after every call.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/heap.h"
+#include "sim.h"
+#define CHECK_CONTEXT Op
+#include "check.h"
+
+
+#define SLOTS 24
+#define OPS   200000
+
+static uint8_t *Block[SLOTS];     // kernel heap
+static uint8_t *Reference[SLOTS]; // C library copy of the same contents
+static int32_t Size[SLOTS];
+static uint32_t Op;
+static uint32_t InPlace, Moved, Refused;
+
+static uint32_t Seed = 11;
+static uint32_t Random(uint32_t n) {
+  Seed = 1664525*Seed + 1013904223;
+  return (Seed >> 8) % n;
+}
+
+static int32_t RandomSize(void) {
+  return Random(8) == 0 ? Random(2000) : Random(200);
+}
+
+static void Fill(uint32_t j, int32_t from) {
+  for(int32_t b = from; b < Size[j]; b++) {
+    Block[j][b] = Reference[j][b] = (uint8_t) Random(256);
+  }
+}
+
+static int Same(uint32_t j) {
+  return Size[j] == 0 || memcmp(Block[j], Reference[j], Size[j]) == 0;
+}
+
+// no two live blocks share a byte
+static int Disjoint(void) {
+  for(uint32_t i = 0; i < SLOTS; i++) {
+    for(uint32_t j = i + 1; j < SLOTS; j++) {
+      if(Block[i] && Block[j] && Block[i] < Block[j] + Size[j] && Block[j] < Block[i] + Size[i]) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+static void Resize(uint32_t j, int32_t size) {
+  uint8_t *old = Block[j];
+  uint8_t *block = Heap_Realloc(old, size);
+  if(block == NULL) {
+    Refused++;
+    CHECK(size > Size[j]);             // shrinking can't fail
+    CHECK(Same(j));                    // the old block is untouched
+    void *other = Heap_Malloc(size);   // nor could a new block be found
+    CHECK(other == NULL);
+    Heap_Free(other);
+    return;
+  }
+  if(size <= Size[j]) {
+    CHECK(block == old);
+  }
+  if(block == old) InPlace++; else Moved++;
+  Block[j] = block;
+  Reference[j] = realloc(Reference[j], size ? size : 1);
+  int32_t kept = size < Size[j] ? size : Size[j];
+  CHECK(memcmp(Block[j], Reference[j], kept) == 0);
+  Size[j] = size;
+  Fill(j, kept);
+}
+
+static void Checker(void) {
+  heap_stats_t stats;
+  Heap_Stats(&stats);
+  uint32_t empty = stats.free;
+  for(Op = 0; Op < OPS && Failures < 10; Op++) {
+    uint32_t j = Random(SLOTS);
+    uint32_t r = Random(4);
+    if(Block[j] == NULL) {
+      int32_t size = RandomSize();
+      Block[j] = r ? Heap_Malloc(size) : Heap_Realloc(NULL, size);
+      if(Block[j]) {
+        Reference[j] = malloc(size ? size : 1);
+        Size[j] = size;
+        Fill(j, 0);
+      }
+    }
+    else if(r == 0) {
+      CHECK(Same(j));
+      CHECK(Heap_Free(Block[j]) == 0);
+      free(Reference[j]);
+      Block[j] = Reference[j] = NULL;
+      Size[j] = 0;
+    }
+    else {
+      CHECK(Same(j));
+      Resize(j, r == 1 ? Random(Size[j] + 1) : RandomSize());
+    }
+    CHECK(Heap_Check(0) == 0);
+    CHECK(Disjoint());
+  }
+  for(uint32_t j = 0; j < SLOTS; j++) {
+    if(Block[j]) {
+      CHECK(Same(j));
+      Heap_Free(Block[j]);
+      free(Reference[j]);
+    }
+  }
+  Heap_Stats(&stats);
+  CHECK(stats.free == empty);
+  CHECK(InPlace > 0 && Moved > 0 && Refused > 0); // every path was taken
+  CHECK_EXIT("test_realloc");
+}
+
+static void Idle(void) {
+  while(1) {
+    Sim_Idle();
+  }
+}
+
+int main(void) {
+  OS_Init();
+  OS_AddThread(Checker, 512, 2);
+  OS_AddThread(Idle, 512, 7);
+  OS_Launch(TIME_2MS);
+  return 1;
+}
@@ -0,0 +1,91 @@
+// filename ************** test_slice.c *************************
+// Host test of adaptive time slices on the simulated kernel, see sim.h
+// An adaptive thread shares its priority with a fixed slice one. While
+// it computes and is preempted at the end of every slice, its slice
+// doubles from SLICE_MIN up to SLICE_MAX and stays there. Once it
+// blocks early in every slice, the slice halves back down to SLICE_MIN.
+// Time used before a block counts against the same slice, so the
+// halving starts after the rest of the last computed slice is used up.
+// The fixed thread keeps the OS_Launch slice throughout.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "sim.h"
+#include "check.h"
+
+#define STEPS 16
+
+static Sema4Type Done;
+static volatile int Stop;
+static uint32_t FixedId;
+static uint32_t Grown[STEPS], Shrunk[STEPS];
+static uint32_t Grows, Shrinks;
+
+// note every new slice of the running thread
+static void Note(uint32_t *seen, uint32_t *count) {
+  uint32_t slice = OS_GetTimeSlice(OS_Id());
+  if(slice != seen[*count - 1] && *count < STEPS) {
+    seen[(*count)++] = slice;
+  }
+}
+
+static void Adaptive(void) {
+  CHECK(OS_SetTimeSlice(OS_Id(), SLICE_MIN, 1));
+  Grown[Grows++] = SLICE_MIN;
+  uint64_t start = Sim_Now();
+  while(Sim_Now() - start < 300*SIM_CYCLES_PER_MS) {
+    Sim_Run(SIM_CYCLES_PER_MS/10);        // used up, preempted
+    Note(Grown, &Grows);
+  }
+  Shrunk[Shrinks++] = Grown[Grows - 1];
+  for(int i = 0; i < 3000 && Shrunk[Shrinks - 1] != SLICE_MIN; i++) {
+    Sim_Run(SIM_CYCLES_PER_MS/100);       // blocks early
+    OS_Sleep(1);
+    Note(Shrunk, &Shrinks);
+  }
+  Stop = 1;
+  OS_Signal(&Done);
+  OS_Kill();
+}
+
+static void Fixed(void) {
+  while(!Stop) {
+    Sim_Run(SIM_CYCLES_PER_MS/10);
+  }
+  OS_Kill();
+}
+
+static void Checker(void) {
+  uint32_t fixed = OS_GetTimeSlice(FixedId);
+  OS_Wait(&Done);
+  CHECK(Grows > 2 && Grown[Grows - 1] == SLICE_MAX);
+  for(uint32_t i = 1; i < Grows; i++) {
+    uint32_t twice = Grown[i - 1] >= SLICE_MAX/2 ? SLICE_MAX : 2*Grown[i - 1];
+    CHECK(Grown[i] == twice);
+  }
+  CHECK(Shrinks > 2 && Shrunk[Shrinks - 1] == SLICE_MIN);
+  for(uint32_t i = 1; i < Shrinks; i++) {
+    uint32_t half = Shrunk[i - 1] <= 2*SLICE_MIN ? SLICE_MIN : Shrunk[i - 1]/2;
+    CHECK(Shrunk[i] == half);
+  }
+  CHECK(OS_GetTimeSlice(FixedId) == fixed && fixed == TIME_2MS);
+  CHECK_EXIT("test_slice");
+}
+
+static void Idle(void) {
+  while(1) {
+    Sim_Idle();
+  }
+}
+
+int main(void) {
+  OS_Init();
+  OS_InitSemaphore(&Done, 0);
+  OS_AddThread(Checker, 512, 1);
+  OS_AddThread(Adaptive, 512, 3);
+  FixedId = OS_THREAD_ID(OS_AddThreadId(Fixed, 512, 3));
+  OS_AddThread(Idle, 512, 7);
+  OS_Launch(TIME_2MS);
+  return 1;
+}
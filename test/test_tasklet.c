@@ -0,0 +1,196 @@
+// filename ************** test_tasklet.c *************************
+// Host test of the tasklet executor core, built with TASKLET_HOST
+// The few OS calls tasklet.c makes are stubbed here, OS_Signal only
+// counts executor wakeups.
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/tasklet.h"
+#include "check.h"
+
+
+//---------- OS stubs -----------------
+static uint32_t Wakeups; // OS_Signal calls on the executor semaphore
+
+void OS_InitSemaphore(Sema4Type *semaPt, int32_t value){
+  semaPt->Value = value;
+  semaPt->head = NULL;
+}
+
+void OS_Signal(Sema4Type *semaPt){
+  semaPt->Value++;
+  Wakeups++;
+}
+
+int OS_TryWait(Sema4Type *semaPt){
+  if(semaPt->Value > 0) {
+    semaPt->Value--;
+    return 1;
+  }
+  return 0;
+}
+
+int OS_bTryWait(Sema4Type *semaPt){
+  if(semaPt->Value != 0) {
+    semaPt->Value = 0;
+    return 1;
+  }
+  return 0;
+}
+
+//---------- tasklets -----------------
+static char Trace[64];
+static uint32_t TraceLength;
+
+static void Mark(char c) {
+  if(TraceLength < sizeof(Trace) - 1) {
+    Trace[TraceLength++] = c;
+    Trace[TraceLength] = 0;
+  }
+}
+
+static void ClearTrace(void) {
+  TraceLength = 0;
+  Trace[0] = 0;
+}
+
+// arg is the letter to record, yields twice
+static int Yielder(Tasklet_t *t) {
+  TASKLET_BEGIN(t);
+  Mark(*(char*) t->arg);
+  TASKLET_YIELD(t);
+  Mark(*(char*) t->arg);
+  TASKLET_YIELD(t);
+  Mark(*(char*) t->arg);
+  TASKLET_END(t);
+}
+
+static int Sleeper(Tasklet_t *t) {
+  TASKLET_BEGIN(t);
+  Mark('s');
+  TASKLET_SLEEP(t, 5);
+  Mark('w');
+  TASKLET_END(t);
+}
+
+static TaskletEvent_t Event;
+static int Waiter(Tasklet_t *t) {
+  TASKLET_BEGIN(t);
+  TASKLET_WAIT_EVENT(t, &Event);
+  Mark('e');
+  TASKLET_WAIT_EVENT(t, &Event);
+  Mark('e');
+  TASKLET_END(t);
+}
+
+static Sema4Type Sema;
+static int SemaWaiter(Tasklet_t *t) {
+  TASKLET_BEGIN(t);
+  TASKLET_WAIT(t, &Sema);
+  Mark('m');
+  TASKLET_END(t);
+}
+
+static Tasklet_t Child;
+static int Parent(Tasklet_t *t) {
+  static char letter = 'c';
+  TASKLET_BEGIN(t);
+  Mark('p');
+  Tasklet_Add(&Child, Yielder, &letter);
+  TASKLET_END(t);
+}
+
+//---------- tests -----------------
+static void TestYield(void) {
+  static Tasklet_t a, b;
+  static char la = 'a', lb = 'b';
+  Tasklet_Init();
+  ClearTrace();
+  Tasklet_Add(&a, Yielder, &la);
+  Tasklet_Add(&b, Yielder, &lb);
+  CHECK(Tasklet_RunOnce(0) == 2);
+  CHECK(Tasklet_Idle() == 0);
+  CHECK(Tasklet_RunOnce(0) == 2);
+  CHECK(Tasklet_RunOnce(0) == 0);
+  CHECK(Tasklet_RunOnce(0) == 0); // both done and removed
+  CHECK(strcmp(Trace, "ababab") == 0);
+  CHECK(Tasklet_Idle() == TASKLET_FOREVER);
+}
+
+static void TestSleep(void) {
+  static Tasklet_t s;
+  Tasklet_Init();
+  ClearTrace();
+  Tasklet_Add(&s, Sleeper, NULL);
+  Tasklet_RunOnce(0);
+  CHECK(Tasklet_Idle() == 5);
+  Tasklet_RunOnce(3);
+  CHECK(strcmp(Trace, "s") == 0);
+  CHECK(Tasklet_Idle() == 2);
+  Tasklet_RunOnce(2);
+  CHECK(strcmp(Trace, "sw") == 0);
+  CHECK(Tasklet_Idle() == TASKLET_FOREVER);
+}
+
+static void TestEvent(void) {
+  static Tasklet_t w;
+  Tasklet_Init();
+  Tasklet_InitEvent(&Event);
+  ClearTrace();
+  Tasklet_Add(&w, Waiter, NULL);
+  Tasklet_RunOnce(0);
+  CHECK(w.state == TASKLET_BLOCKED);
+  CHECK(Tasklet_Idle() == TASKLET_FOREVER); // blocked, not polled
+
+  // two signals before the next pass wake the executor once
+  Wakeups = 0;
+  Tasklet_Signal(&Event);
+  Tasklet_Signal(&Event);
+  CHECK(Wakeups == 1);
+  Tasklet_RunOnce(0); // both signals are taken in one pass
+  CHECK(strcmp(Trace, "ee") == 0);
+  CHECK(Tasklet_Idle() == TASKLET_FOREVER);
+
+  // a signal during or after a pass wakes it again
+  Tasklet_Signal(&Event);
+  CHECK(Wakeups == 2);
+}
+
+static void TestSemaphorePoll(void) {
+  static Tasklet_t m;
+  Tasklet_Init();
+  OS_InitSemaphore(&Sema, 0);
+  ClearTrace();
+  Tasklet_Add(&m, SemaWaiter, NULL);
+  Tasklet_RunOnce(0);
+  CHECK(m.state == TASKLET_WAITING);
+  CHECK(Tasklet_Idle() == TASKLET_POLL);
+  Sema.Value = 1;
+  Tasklet_RunOnce(TASKLET_POLL);
+  CHECK(strcmp(Trace, "m") == 0);
+  CHECK(Sema.Value == 0);
+}
+
+static void TestAddFromTasklet(void) {
+  static Tasklet_t p;
+  Tasklet_Init();
+  ClearTrace();
+  Wakeups = 0;
+  Tasklet_Add(&p, Parent, NULL);
+  CHECK(Wakeups == 1);
+  Tasklet_RunOnce(0); // child appended behind the parent runs in the same pass
+  CHECK(strcmp(Trace, "pc") == 0);
+  while(Tasklet_RunOnce(0)) {
+  }
+  CHECK(strcmp(Trace, "pccc") == 0);
+}
+
+int main(void) {
+  TestYield();
+  TestSleep();
+  TestEvent();
+  TestSemaphorePoll();
+  TestAddFromTasklet();
+  CHECK_EXIT("test_tasklet");
+}
@@ -0,0 +1,82 @@
+// filename ************** test_time64.c *************************
+// Host test of OS_Time64 on the simulated kernel, see sim.h
+// The tick count starts just below 2^32 so the 32 bit part wraps early
+// in the run, and the run lasts past the 10 s wrap of msSystemTime.
+// Every read must equal the simulated clock exactly, including reads
+// with interrupts masked across a Timer5A timeout whose tick has not
+// been counted yet, and must never step back.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../inc/CortexM.h"
+#include "sim.h"
+#include "check.h"
+
+
+extern volatile uint64_t TimerTicks;
+
+#define START_TICKS (0xFFFFFFFFull - 5)
+#define RUN_MS      12000
+
+static uint32_t Seed = 1;
+static uint32_t Random(uint32_t n) {
+  Seed = 1664525*Seed + 1013904223;
+  return (Seed >> 8) % n;
+}
+
+static uint64_t Expected(void) {
+  return START_TICKS*80000 + Sim_Now();
+}
+
+static void Reader(void) {
+  uint64_t prev = OS_Time64();
+  uint32_t reads = 0, masked = 0;
+  while(Sim_Now() < (uint64_t) RUN_MS*SIM_CYCLES_PER_MS) {
+    uint64_t now;
+    if(Random(4) == 0) {
+      // mask across a timeout, the tick is pending when we read
+      long sr = StartCritical();
+      Sim_Run(Random(SIM_CYCLES_PER_MS/2));
+      now = OS_Time64();
+      CHECK(now == Expected());
+      EndCritical(sr);
+      masked++;
+    }
+    else {
+      Sim_Run(1 + Random(2*SIM_CYCLES_PER_MS));
+      now = OS_Time64();
+      CHECK(now == Expected());
+    }
+    CHECK(now >= prev);
+    prev = now;
+    reads++;
+    if(Failures > 10) break;
+  }
+  CHECK(TimerTicks > 0xFFFFFFFFull);          // the low word wrapped
+  CHECK(masked > 1000 && reads > masked);
+
+  // conversions
+  CHECK(OS_CyclesToUs(79) == 0);
+  CHECK(OS_CyclesToUs(80) == 1);
+  CHECK(OS_CyclesToMs(80000) == 1);
+  CHECK(OS_CyclesToMs(START_TICKS*80000) == START_TICKS);
+  CHECK(OS_CyclesToUs(UINT64_MAX) == UINT64_MAX/80);
+
+  CHECK_EXIT("test_time64");
+}
+
+static void Idle(void) {
+  while(1) {
+    Sim_Idle();
+  }
+}
+
+int main(void) {
+  OS_Init();
+  TimerTicks = START_TICKS;
+  OS_AddThread(Reader, 512, 1);
+  OS_AddThread(Idle, 512, 2);
+  OS_Launch(TIME_2MS);
+  return 1;
+}
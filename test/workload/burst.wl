@@ -0,0 +1,21 @@
+# bursts of interrupts into a two stage pipeline, next to a 10 ms
+# control loop; the third burst is closer than rx can keep up with
+name burst
+duration 100
+thread ctrl 1 10 2000 10
+thread rx 2 0 400 2 proc
+thread proc 3 0 1500 8
+thread hog 5 20 6000 20
+arrive 1000 rx
+arrive 1200 rx
+arrive 1400 rx
+arrive 30000 rx
+arrive 30500 rx
+arrive 31000 rx
+arrive 31500 rx
+arrive 60000 rx
+arrive 60100 rx
+arrive 60200 rx
+arrive 60300 rx
+arrive 60400 rx
+arrive 60500 rx
@@ -0,0 +1,508 @@
+// filename *************************workload.c ************************
+// Scripted scheduler workloads
+// Each script thread becomes a worker thread, periodic workers release
+// themselves from OS_Time64, the others wait on their stage semaphore,
+// which the previous stage or the Timer1A interrupt signals. Timer1A is
+// rearmed for every arrival, so periodic and one shot interrupts of a
+// script come at their exact times.
+#include <stdint.h>
+#include <string.h>
+#include "../inc/CortexM.h"
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/UART0int.h"
+#include "../RTOS_Labs_common/workload.h"
+#include "../inc/Timer1A.h"
+
+#define CMD_NEXT_LINE() \
+          UART_OutChar('\n'); \
+          UART_OutChar(CR);
+
+#define CYCLES_PER_MS 80000 // OS_Time64 units
+#define CYCLES_PER_US 80
+#define RELEASE_QUEUE 4     // releases a stage can have outstanding
+#define WORKLOAD_LINE 64    // longest script line
+#define WORKLOAD_WORDS 8    // most words on a script line
+
+//---------- scripts -----------------
+static const char *const Scripts[] = {
+  "# rate monotonic set, about 60% load\n"
+  "name periodic\n"
+  "duration 2000\n"
+  "thread ctrl 1 5 1000 5\n"
+  "thread filter 2 10 2000 10\n"
+  "thread log 3 50 10000 50\n",
+
+  "# interrupt driven pipeline over a low priority hog, about 95% load\n"
+  "name pipeline\n"
+  "duration 2000\n"
+  "isr 2000 rx\n"
+  "thread rx 1 0 300 1 proc\n"
+  "thread proc 2 0 800 2 tx\n"
+  "thread tx 3 0 200 4\n"
+  "thread hog 4 20 6000 20\n",
+};
+#define WORKLOAD_SCRIPTS (sizeof(Scripts)/sizeof(Scripts[0]))
+
+//---------- replay state -----------------
+static const workload_t *Script;
+static workload_t Parsed;             // built-in script being run
+static volatile int Running;
+static uint64_t Start;                // OS_Time64 at the start of the replay
+static uint32_t ScriptSwitches;       // context switches during the replay
+static uint32_t ThreadIndex[NUMTHREADS]; // thread ID to script index
+static uint32_t IsrNext;              // us of the next periodic interrupt
+static uint32_t ArrivalNext;          // next one shot interrupt
+
+// outstanding release times of each stage, filled by Release
+static Sema4Type Stage[WORKLOAD_MAXTHREADS];
+static uint64_t ReleaseTime[WORKLOAD_MAXTHREADS][RELEASE_QUEUE];
+static uint32_t ReleaseHead[WORKLOAD_MAXTHREADS];
+static uint32_t ReleaseTail[WORKLOAD_MAXTHREADS];
+
+// accumulated by the workers
+static uint32_t Releases[WORKLOAD_MAXTHREADS];
+static uint32_t Lost[WORKLOAD_MAXTHREADS]; // releases dropped by Release
+static uint32_t Misses[WORKLOAD_MAXTHREADS];
+static uint64_t TotalResponse[WORKLOAD_MAXTHREADS];
+static uint64_t MaxResponse[WORKLOAD_MAXTHREADS];
+static uint32_t Switches[WORKLOAD_MAXTHREADS];
+static uint64_t RunTime[WORKLOAD_MAXTHREADS];
+
+#ifdef WORKLOAD_HOST
+#include "sim.h"
+// the work of a job is simulated time, preemption stretches it like real work
+static void Spin(uint32_t us) {
+  Sim_Run(us*CYCLES_PER_US);
+}
+#define Calibrate()
+#else
+static uint32_t LoopsPerMs;           // busy loop calibration
+
+// burn CPU for a number of us, preemption stretches it like real work
+static void Spin(uint32_t us) {
+  volatile uint32_t loops = (uint32_t)(((uint64_t) us*LoopsPerMs)/1000);
+  while(loops) {
+    loops--;
+  }
+}
+
+// loops of Spin per ms, best of a few tries to dodge preemption
+static void Calibrate(void) {
+  uint64_t best = 0;
+  LoopsPerMs = 100000; // Spin(1000) runs 100000 loops
+  for(int i = 0; i < 4; i++) {
+    uint64_t start = OS_Time64();
+    Spin(1000);
+    uint64_t elapsed = OS_Time64() - start;
+    if(best == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  LoopsPerMs = (uint32_t)(((uint64_t) 100000*CYCLES_PER_MS)/best);
+}
+#endif
+
+//---------- parser -----------------
+// split a line into words, cuts it at #, returns WORKLOAD_WORDS+1 if too many
+static uint32_t Split(char *p, char *word[]) {
+  uint32_t words = 0;
+  while(1) {
+    while(*p == ' ' || *p == '\t') {
+      *p++ = 0;
+    }
+    if(*p == 0 || *p == '#') {
+      *p = 0;
+      return words;
+    }
+    if(words == WORKLOAD_WORDS) {
+      return WORKLOAD_WORDS + 1;
+    }
+    word[words++] = p;
+    while(*p && *p != ' ' && *p != '\t' && *p != '#') {
+      p++;
+    }
+  }
+}
+
+// decimal number, returns 1 if not a number or too large
+static int Number(const char *word, uint32_t *value) {
+  uint32_t n = 0;
+  if(*word == 0 || strlen(word) > 9) {
+    return 1;
+  }
+  for(; *word; word++) {
+    if(*word < '0' || *word > '9') {
+      return 1;
+    }
+    n = 10*n + (*word - '0');
+  }
+  *value = n;
+  return 0;
+}
+
+// index of the thread with that name, -1 if none
+static int32_t Find(const workload_t *script, const char *name) {
+  for(uint32_t i = 0; i < script->count; i++) {
+    if(strcmp(script->threads[i].name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// one line, the names pass only collects the thread names
+// returns 1 if the line is bad
+static int ParseLine(char *word[], uint32_t words, workload_t *script, int names) {
+  if(words == 0) {
+    return 0;
+  }
+  if(strcmp(word[0], "thread") == 0) {
+    if(words < 6 || words > 7 || strlen(word[1]) >= sizeof(script->threads[0].name)) {
+      return 1;
+    }
+    if(names) {
+      if(script->count == WORKLOAD_MAXTHREADS || Find(script, word[1]) >= 0) {
+        return 1;
+      }
+      strcpy(script->threads[script->count++].name, word[1]);
+      return 0;
+    }
+    workload_thread_t *thread = &script->threads[Find(script, word[1])];
+    if(Number(word[2], &thread->priority) || Number(word[3], &thread->period) ||
+       Number(word[4], &thread->work) || Number(word[5], &thread->deadline) || thread->deadline == 0) {
+      return 1;
+    }
+    thread->signal = words == 7 ? Find(script, word[6]) : WORKLOAD_NOSIGNAL;
+    return words == 7 && thread->signal < 0;
+  }
+  if(names) {
+    return 0;
+  }
+  if(strcmp(word[0], "name") == 0) {
+    if(words != 2 || strlen(word[1]) >= sizeof(script->name)) {
+      return 1;
+    }
+    strcpy(script->name, word[1]);
+    return 0;
+  }
+  if(strcmp(word[0], "duration") == 0) {
+    return words != 2 || Number(word[1], &script->duration) || script->duration == 0;
+  }
+  if(strcmp(word[0], "isr") == 0) {
+    if(words != 3 || Number(word[1], &script->isrPeriod) || script->isrPeriod == 0) {
+      return 1;
+    }
+    script->isrSignal = Find(script, word[2]);
+    return script->isrSignal < 0;
+  }
+  if(strcmp(word[0], "arrive") == 0) {
+    uint32_t n = script->arrivals;
+    if(words != 3 || n == WORKLOAD_MAXARRIVALS || Number(word[1], &script->arrivalTime[n]) ||
+       (n > 0 && script->arrivalTime[n] < script->arrivalTime[n-1])) {
+      return 1;
+    }
+    script->arrivalSignal[n] = Find(script, word[2]);
+    script->arrivals++;
+    return script->arrivalSignal[n] < 0;
+  }
+  return 1;
+}
+
+// one pass over the text, returns the bad line or 0, lines counts them
+static int ParseText(const char *text, workload_t *script, int names, int *lines) {
+  char buffer[WORKLOAD_LINE];
+  char *word[WORKLOAD_WORDS];
+  *lines = 0;
+  while(*text) {
+    uint32_t length = 0;
+    int comment = 0;
+    (*lines)++;
+    while(*text && *text != '\n' && *text != '\r') {
+      comment |= *text == '#';   // the rest of the line is not kept
+      if(!comment) {
+        if(length == WORKLOAD_LINE - 1) {
+          return *lines;
+        }
+        buffer[length++] = *text;
+      }
+      text++;
+    }
+    if(*text == '\r') {
+      text++;
+    }
+    if(*text == '\n') {
+      text++;
+    }
+    buffer[length] = 0;
+    uint32_t words = Split(buffer, word);
+    if(words > WORKLOAD_WORDS || ParseLine(word, words, script, names)) {
+      return *lines;
+    }
+  }
+  return 0;
+}
+
+//---------- Workload_Parse-----------------
+// Turn the text of a script into a workload_t
+// Input: script text, workload_t to fill in
+// Output: 0 if valid, else the number of the first bad line
+int Workload_Parse(const char *text, workload_t *script){
+  int lines;
+  memset(script, 0, sizeof(*script));
+  script->isrSignal = WORKLOAD_NOSIGNAL;
+  // thread names first, so a line can name a thread listed further down
+  int error = ParseText(text, script, 1, &lines);
+  if(error == 0) {
+    error = ParseText(text, script, 0, &lines);
+  }
+  if(error == 0 && (script->count == 0 || script->duration == 0)) {
+    error = lines + 1; // missing a thread or the duration
+  }
+  return error;
+}
+
+//---------- replay -----------------
+// queue a release of a stage, called by threads and the Timer1A ISR
+static void Release(int32_t stage) {
+  long sr = StartCritical();
+  uint32_t next = (ReleaseHead[stage] + 1) % RELEASE_QUEUE;
+  if(next == ReleaseTail[stage]) {
+    Lost[stage]++; // stage too far behind, the release is lost
+    EndCritical(sr);
+    return;
+  }
+  ReleaseTime[stage][ReleaseHead[stage]] = OS_Time64();
+  ReleaseHead[stage] = next;
+  EndCritical(sr);
+  OS_Signal(&Stage[stage]);
+}
+
+// next interrupt of the script in us after Start and the stage it
+// releases, take moves past it, returns 0 if there is none left
+static int NextArrival(uint32_t *at, int32_t *stage, int take) {
+  int oneShot = ArrivalNext < Script->arrivals;
+  if(oneShot && (Script->isrPeriod == 0 || Script->arrivalTime[ArrivalNext] < IsrNext)) {
+    *at = Script->arrivalTime[ArrivalNext];
+    *stage = Script->arrivalSignal[ArrivalNext];
+    ArrivalNext += take;
+  }
+  else if(Script->isrPeriod) {
+    *at = IsrNext;
+    *stage = Script->isrSignal;
+    IsrNext += take ? Script->isrPeriod : 0;
+  }
+  else {
+    return 0;
+  }
+  return *at < Script->duration*1000;
+}
+
+// Timer1A ISR, releases every interrupt that is due, then sets the
+// timer to the next one
+static void ArrivalISR(void) {
+  uint32_t at;
+  int32_t stage;
+  while(Running && NextArrival(&at, &stage, 0)) {
+    uint64_t due = Start + (uint64_t) at*CYCLES_PER_US;
+    uint64_t now = OS_Time64();
+    if(due > now) {
+      Timer1A_Init(&ArrivalISR, (uint32_t)(due - now), 2);
+      return;
+    }
+    NextArrival(&at, &stage, 1);
+    Release(stage);
+  }
+  Timer1A_Stop();
+}
+
+// record one finished job
+static void Finish(uint32_t index, uint64_t release) {
+  const workload_thread_t *thread = &Script->threads[index];
+  uint64_t response = OS_Time64() - release;
+  Releases[index]++;
+  TotalResponse[index] += response;
+  if(response > MaxResponse[index]) {
+    MaxResponse[index] = response;
+  }
+  if(response > (uint64_t) thread->deadline*CYCLES_PER_MS) {
+    Misses[index]++;
+  }
+  if(thread->signal != WORKLOAD_NOSIGNAL) {
+    Release(thread->signal);
+  }
+}
+
+//---------- worker thread -----------------
+// one per script thread, exits when Running is cleared
+static void Worker(void) {
+  uint32_t index = ThreadIndex[OS_Id()];
+  const workload_thread_t *thread = &Script->threads[index];
+  if(thread->period) {
+    // nominal release times, lateness counts toward the response
+    uint64_t release = Start;
+    while(Running) {
+      Spin(thread->work);
+      Finish(index, release);
+      release += (uint64_t) thread->period*CYCLES_PER_MS;
+      // Start is on a tick, so rounding up wakes on the release tick;
+      // never start the next job before its release
+      uint64_t now;
+      while(Running && (now = OS_Time64()) < release) {
+        OS_Sleep((uint32_t)((release - now + CYCLES_PER_MS - 1)/CYCLES_PER_MS));
+      }
+    }
+  }
+  else {
+    while(1) {
+      OS_Wait(&Stage[index]);
+      if(!Running) {
+        break;
+      }
+      uint64_t release = ReleaseTime[index][ReleaseTail[index]];
+      ReleaseTail[index] = (ReleaseTail[index] + 1) % RELEASE_QUEUE;
+      Spin(thread->work);
+      Finish(index, release);
+    }
+  }
+  OS_ThreadStats(OS_Id(), &Switches[index], &RunTime[index]);
+  OS_ThreadExit(0);
+}
+
+//---------- Workload_Replay-----------------
+// Replay a parsed script, the caller blocks until it is done
+// Input: parsed script, array of WORKLOAD_MAXTHREADS results
+// Output: 0 if the script ran, 1 if a thread could not be added
+int Workload_Replay(const workload_t *script, workload_result_t results[]){
+  int32_t ids[WORKLOAD_MAXTHREADS];
+  uint32_t added = 0;
+  Script = script;
+  Calibrate();
+  for(uint32_t i = 0; i < Script->count; i++) {
+    OS_InitSemaphore(&Stage[i], 0);
+    ReleaseHead[i] = ReleaseTail[i] = 0;
+    Releases[i] = Lost[i] = Misses[i] = Switches[i] = 0;
+    TotalResponse[i] = MaxResponse[i] = RunTime[i] = 0;
+  }
+  IsrNext = 0;
+  ArrivalNext = 0;
+
+  // add every worker before any of them runs, so all share one Start,
+  // which is the last Timer5A tick so that releases fall on ticks
+  long sr = StartCritical();
+  Running = 1;
+  Start = OS_Time64();
+  Start -= Start%CYCLES_PER_MS;
+  ScriptSwitches = OS_ContextSwitches();
+  for(; added < Script->count; added++) {
+    ids[added] = OS_AddThreadId(&Worker, 128, Script->threads[added].priority);
+    if(ids[added] < 0) {
+      Running = 0;
+      break;
+    }
+    ThreadIndex[OS_THREAD_ID(ids[added])] = added;
+  }
+  if(Running) {
+    ArrivalISR(); // releases what is due at Start and sets Timer1A
+  }
+  EndCritical(sr);
+
+  if(Running) {
+    OS_Sleep(Script->duration);
+    sr = StartCritical();
+    Running = 0;
+    Timer1A_Stop();
+    EndCritical(sr);
+    ScriptSwitches = OS_ContextSwitches() - ScriptSwitches;
+  }
+  // wake the stage workers so they see Running cleared
+  for(uint32_t i = 0; i < added; i++) {
+    OS_Signal(&Stage[i]);
+  }
+  for(uint32_t i = 0; i < added; i++) {
+    OS_Join(ids[i], 0, 0);
+  }
+  if(added < Script->count) {
+    return 1;
+  }
+
+  uint64_t elapsed = (uint64_t) Script->duration*CYCLES_PER_MS;
+  for(uint32_t i = 0; i < Script->count; i++) {
+    results[i].releases = Releases[i];
+    results[i].misses = Misses[i] + Lost[i];
+    results[i].meanResponse = Releases[i] ? OS_CyclesToUs(TotalResponse[i]/Releases[i]) : 0;
+    results[i].maxResponse = OS_CyclesToUs(MaxResponse[i]);
+    results[i].switches = Switches[i];
+    results[i].share = (uint32_t)((RunTime[i]*1000)/elapsed);
+  }
+  return 0;
+}
+
+//---------- Workload_Report-----------------
+// Print the results of a replay as a table on the UART
+// Input: the script that was replayed, its results
+// Output: none
+void Workload_Report(const workload_t *script, const workload_result_t results[]){
+  UART_OutString((char*) script->name);
+  UART_OutString(" switches ");
+  UART_OutUDec(ScriptSwitches);
+  CMD_NEXT_LINE();
+  UART_OutString("thread jobs miss mean_us max_us switches cpu_0.1%");
+  CMD_NEXT_LINE();
+  for(uint32_t i = 0; i < script->count; i++) {
+    UART_OutString((char*) script->threads[i].name);
+    UART_OutChar(' ');
+    UART_OutUDec(results[i].releases);
+    UART_OutChar(' ');
+    UART_OutUDec(results[i].misses);
+    UART_OutChar(' ');
+    UART_OutUDec(results[i].meanResponse);
+    UART_OutChar(' ');
+    UART_OutUDec(results[i].maxResponse);
+    UART_OutChar(' ');
+    UART_OutUDec(results[i].switches);
+    UART_OutChar(' ');
+    UART_OutUDec(results[i].share);
+    CMD_NEXT_LINE();
+  }
+}
+
+//---------- Workload_Count-----------------
+// Number of built-in scripts
+// Input: none
+// Output: number of scripts
+uint32_t Workload_Count(void){
+  return WORKLOAD_SCRIPTS;
+}
+
+//---------- Workload_Script-----------------
+// Text of a built-in script
+// Input: index of the script
+// Output: the script, 0 if the index is invalid
+const char *Workload_Script(uint32_t script){
+  return script < WORKLOAD_SCRIPTS ? Scripts[script] : 0;
+}
+
+//---------- Workload_RunOne-----------------
+// Parse and replay one built-in script, the caller blocks until it is done
+// Input: index of the script, array of WORKLOAD_MAXTHREADS results
+// Output: 0 if the script ran, 1 if invalid or a thread could not be added
+int Workload_RunOne(uint32_t script, workload_result_t results[]){
+  if(script >= WORKLOAD_SCRIPTS || Workload_Parse(Scripts[script], &Parsed)) {
+    return 1;
+  }
+  return Workload_Replay(&Parsed, results);
+}
+
+//---------- Workload_Run-----------------
+// Replay one built-in script and print a table on the UART
+// Input: index of the script
+// Output: none
+void Workload_Run(uint32_t script){
+  workload_result_t results[WORKLOAD_MAXTHREADS];
+  if(Workload_RunOne(script, results)) {
+    UART_OutString("workload failed");
+    CMD_NEXT_LINE();
+    return;
+  }
+  Workload_Report(&Parsed, results);
+}
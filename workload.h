@@ -0,0 +1,137 @@
+/**
+ * @file      workload.h
+ * @brief     Scripted scheduler workloads
+ * @details   Replays a script of periodic threads, semaphore hand-offs
+ * and interrupt arrivals on the running kernel and reports, per thread,
+ * response times, deadline misses, context switches and CPU share. Running
+ * the same script on two kernel builds gives numbers that can be compared
+ * directly.<br>
+ * Scripts are text, one item per line, # starts a comment:<br>
+ *   name periodic<br>
+ *   duration 2000               replay time in ms<br>
+ *   thread rx 1 0 300 1 proc    name priority period_ms work_us deadline_ms [released thread]<br>
+ *   isr 2000 rx                 periodic interrupt every 2000 us releasing rx<br>
+ *   arrive 150 rx               one interrupt 150 us after the start, in time order<br>
+ * A thread with period 0 runs once per release by an interrupt or by the
+ * thread named at the end of another thread line.<br>
+ * Needs SCHED_STATS for the switch and CPU columns, they read 0 otherwise.
+ * Uses Timer1A for the interrupt arrivals, run it on an otherwise idle system.
+ * With WORKLOAD_HOST defined it builds for the simulated kernel of test/,
+ * where the work of a job is simulated time and every run of a script
+ * gives the same numbers (see test/bench_workload.c).
+ * @version   V1.0
+ * @date      Oct 19, 2026
+ ******************************************************************************/
+
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stdint.h>
+
+#define WORKLOAD_MAXTHREADS  6  // threads in one script
+#define WORKLOAD_MAXARRIVALS 32 // arrive lines in one script
+#define WORKLOAD_NOSIGNAL   -1  // no stage released
+
+// one thread of a script
+typedef struct workload_thread {
+  char name[8];
+  uint32_t priority;  // 0 is highest
+  uint32_t period;    // ms between releases, 0 if released by another stage
+  uint32_t work;      // us of computation per release
+  uint32_t deadline;  // ms after the release
+  int32_t signal;     // thread released after each job, WORKLOAD_NOSIGNAL for none
+} workload_thread_t;
+
+// a parsed script, threads are indexed in the order listed
+typedef struct workload {
+  char name[16];
+  uint32_t duration;  // ms
+  uint32_t isrPeriod; // us between periodic interrupts, 0 for none
+  int32_t isrSignal;  // thread released by each periodic interrupt
+  uint32_t arrivals;  // number of one shot interrupts
+  uint32_t arrivalTime[WORKLOAD_MAXARRIVALS];  // us after the start, ascending
+  int32_t arrivalSignal[WORKLOAD_MAXARRIVALS]; // thread each one releases
+  uint32_t count;     // number of threads
+  workload_thread_t threads[WORKLOAD_MAXTHREADS];
+} workload_t;
+
+// per-thread result, times in us
+typedef struct workload_result {
+  uint32_t releases;  // jobs completed
+  uint32_t misses;    // jobs finished after their deadline or releases lost
+  uint32_t meanResponse;
+  uint32_t maxResponse;
+  uint32_t switches;  // times switched in
+  uint32_t share;     // CPU share in 0.1%
+} workload_result_t;
+
+
+/**
+ * @details Turn the text of a script into a workload_t
+ * @param  text: script, lines end in \n or \r
+ * @param  script: reference to the workload_t to fill in
+ * @return 0 if the script is valid, else the number of the first bad line
+ * @brief  Parse a workload script
+ */
+int Workload_Parse(const char *text, workload_t *script);
+
+
+/**
+ * @details Replay a parsed script, called from a foreground thread that
+ * blocks for the duration of the script
+ * @param  script: parsed script
+ * @param  results: array of WORKLOAD_MAXTHREADS results, one per script thread
+ * @return 0 if the script ran, 1 if a thread could not be added
+ * @brief  Replay a workload
+ */
+int Workload_Replay(const workload_t *script, workload_result_t results[]);
+
+
+/**
+ * @details Print the results of a replay as a table on the UART
+ * @param  script: the script that was replayed
+ * @param  results: its results
+ * @return none
+ * @brief  Print workload results
+ */
+void Workload_Report(const workload_t *script, const workload_result_t results[]);
+
+
+/**
+ * @details Number of built-in scripts
+ * @param  none
+ * @return number of scripts
+ * @brief  Number of workloads
+ */
+uint32_t Workload_Count(void);
+
+
+/**
+ * @details Text of a built-in script
+ * @param  script: index of the script, 0 to Workload_Count()-1
+ * @return the script, or 0 if the index is invalid
+ * @brief  Built-in workload
+ */
+const char *Workload_Script(uint32_t script);
+
+
+/**
+ * @details Parse and replay one built-in script
+ * @param  script: index of the script, 0 to Workload_Count()-1
+ * @param  results: array of WORKLOAD_MAXTHREADS results, one per script thread
+ * @return 0 if the script ran, 1 if the index is invalid or a thread could
+ *         not be added
+ * @brief  Run one workload
+ */
+int Workload_RunOne(uint32_t script, workload_result_t results[]);
+
+
+/**
+ * @details Replay one built-in script and print a table on the UART
+ * @param  script: index of the script
+ * @return none
+ * @brief  Run and print one workload
+ */
+void Workload_Run(uint32_t script);
+
+#endif //#ifndef WORKLOAD_H